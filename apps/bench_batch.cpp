@@ -0,0 +1,102 @@
+/*! Benchmark batched requests
+
+  Run a broker and echo workers in actors and report requests per
+  second for plain requests and for batches of 1 to 1024 requests.
+
+  $ ./build/bench_batch [server|router [nworkers [nrequests]]]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/worker.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <chrono>
+#include <cstdio>
+
+using namespace generaldomo;
+
+static
+double plain_rate(Client& client, size_t nrequests)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t ind=0; ind<nrequests; ++ind) {
+        zmq::multipart_t mmsg("hello");
+        client.send("echo", mmsg);
+        client.recv(mmsg);
+        if (mmsg.empty()) {
+            return 0;
+        }
+    }
+    auto dt = std::chrono::steady_clock::now() - t0;
+    return nrequests / std::chrono::duration<double>(dt).count();
+}
+
+static
+double batch_rate(Client& client, size_t nrequests, size_t batch)
+{
+    const size_t nbatches = std::max<size_t>(1, nrequests / batch);
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t ibatch=0; ibatch<nbatches; ++ibatch) {
+        std::vector<zmq::multipart_t> requests(batch);
+        for (auto& one : requests) {
+            one.addstr("hello");
+        }
+        client.send_batch("echo", requests);
+        std::vector<zmq::multipart_t> replies;
+        client.recv_batch(replies);
+        if (replies.size() != batch) {
+            return 0;
+        }
+    }
+    auto dt = std::chrono::steady_clock::now() - t0;
+    return nbatches * batch / std::chrono::duration<double>(dt).count();
+}
+
+int main(int argc, char* argv[])
+{
+    std::string which = "server";
+    size_t nworkers = 1;
+    size_t nrequests = 10000;
+    if (argc > 1) { which = argv[1]; }
+    if (argc > 2) { nworkers = atol(argv[2]); }
+    if (argc > 3) { nrequests = atol(argv[3]); }
+
+    int serverish = ZMQ_SERVER, clientish = ZMQ_CLIENT;
+    if (which == "router") {
+        serverish = ZMQ_ROUTER;
+        clientish = ZMQ_DEALER;
+    }
+
+    console_log log;
+    log.level = console_log::log_level::error;
+    zmq::context_t ctx;
+    std::string address = "tcp://127.0.0.1:5557";
+
+    std::vector<zmq::actor_t*> actors;
+    actors.push_back(new zmq::actor_t(ctx, broker_actor, address, serverish));
+    for (size_t ind=0; ind<nworkers; ++ind) {
+        actors.push_back(new zmq::actor_t(ctx, echo_worker, address, clientish));
+    }
+
+    {
+        zmq::socket_t sock(ctx, clientish);
+        Client client(sock, address, log);
+        sleep_ms(time_unit_t{500}); // let workers say READY
+
+        printf("%s, %ld workers, %ld requests\n", which.c_str(), nworkers, nrequests);
+        printf("%-8s %12s\n", "batch", "requests/s");
+        printf("%-8s %12.0f\n", "plain", plain_rate(client, nrequests));
+        for (size_t batch = 1; batch <= 1024; batch *= 2) {
+            printf("%-8ld %12.0f\n", batch, batch_rate(client, nrequests, batch));
+        }
+    }
+
+    for (auto it = actors.rbegin(); it != actors.rend(); ++it) {
+        (*it)->pipe().send(zmq::message_t{}, zmq::send_flags::none);
+        delete *it;
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*! Benchmark the busy-poll broker mode
+
+  Run a broker actor and an echo worker and have a client make
+  requests one at a time, first with the broker blocking as usual and
+  then with it spinning.  Report round-trip latency quantiles of each.
+
+  The spinning broker is configured through the environment as
+  broker_actor() reads it, eg its thread may be pinned by giving cpus.
+
+  $ ./build/bench_busypoll [nrequests [spin_us [cpus [address]]]]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/histogram.hpp"
+#include "generaldomo/worker.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace generaldomo;
+
+static
+void run(zmq::context_t& ctx, const std::string& address,
+         const std::string& name, size_t nrequests)
+{
+    console_log log;
+    log.level = console_log::log_level::error;
+    auto broker = new zmq::actor_t(ctx, broker_actor, address, ZMQ_SERVER);
+    auto worker = new zmq::actor_t(ctx, echo_worker, address, ZMQ_CLIENT);
+
+    Histogram hist;
+    {
+        zmq::socket_t sock(ctx, ZMQ_CLIENT);
+        Client client(sock, address, log);
+        sleep_ms(time_unit_t{500}); // let the worker say READY
+
+        for (size_t ind=0; ind<nrequests; ++ind) {
+            auto t0 = std::chrono::steady_clock::now();
+            zmq::multipart_t mmsg("hello");
+            client.send("echo", mmsg);
+            client.recv(mmsg);
+            auto dt = std::chrono::steady_clock::now() - t0;
+            if (mmsg.empty()) {
+                printf("%-10s failed\n", name.c_str());
+                break;
+            }
+            hist.record(std::chrono::duration_cast<std::chrono::microseconds>(dt).count());
+        }
+    }
+    printf("%-10s %10.1f %10lu %10lu %10lu %10lu\n", name.c_str(), hist.mean(),
+           (unsigned long)hist.percentile(50), (unsigned long)hist.percentile(99),
+           (unsigned long)hist.percentile(99.9), (unsigned long)hist.max());
+
+    for (auto* actor : {worker, broker}) {
+        actor->pipe().send(zmq::message_t{}, zmq::send_flags::none);
+        delete actor;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nrequests = 10000;
+    std::string spin = "1000";
+    std::string cpus = "";
+    std::string address = "tcp://127.0.0.1:5567";
+    if (argc > 1) { nrequests = atol(argv[1]); }
+    if (argc > 2) { spin = argv[2]; }
+    if (argc > 3) { cpus = argv[3]; }
+    if (argc > 4) { address = argv[4]; }
+
+    zmq::context_t ctx;
+    printf("%ld requests to %s, spin %s us, cpus \"%s\"\n",
+           nrequests, address.c_str(), spin.c_str(), cpus.c_str());
+    printf("%-10s %10s %10s %10s %10s %10s\n",
+           "mode", "mean us", "p50 us", "p99 us", "p99.9 us", "max us");
+
+    unsetenv("GENERALDOMO_BROKER_BUSY_POLL");
+    run(ctx, address, "blocking", nrequests);
+
+    setenv("GENERALDOMO_BROKER_BUSY_POLL", spin.c_str(), 1);
+    if (cpus.size()) {
+        setenv("GENERALDOMO_BROKER_CPUS", cpus.c_str(), 1);
+    }
+    run(ctx, address, "busy-poll", nrequests);
+    return 0;
+}
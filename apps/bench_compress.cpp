@@ -0,0 +1,151 @@
+/*! Benchmark body compression
+
+  Measure the cost and gain of body compression for several kinds of
+  payload and the three ways a Compressor may be used: off, always
+  (not adaptive) and adaptive.  For each, report the coded size
+  ratio, the CPU time and throughput to code and decode and the
+  payload throughput one would get over a link of the given
+  bandwidth.
+
+  $ ./build/bench_compress [frame_size [nframes [link_mbps]]]
+
+ */
+
+#include "generaldomo/compress.hpp"
+
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+
+using namespace generaldomo;
+
+static
+zmq::message_t make_payload(const std::string& kind, size_t size, std::mt19937& rng)
+{
+    zmq::message_t msg(size);
+    auto data = static_cast<unsigned char*>(msg.data());
+    if (kind == "zeros") {
+        std::fill(data, data+size, 0);
+    }
+    else if (kind == "text") {
+        const char* words[] = {"request ", "reply ", "worker ", "broker ",
+                               "service ", "heartbeat ", "client "};
+        std::uniform_int_distribution<int> pick(0, 6);
+        size_t ind = 0;
+        while (ind < size) {
+            const char* word = words[pick(rng)];
+            while (*word and ind < size) {
+                data[ind++] = *word++;
+            }
+        }
+    }
+    else if (kind == "numeric") {
+        // slowly varying 32 bit integers as from a digitizer
+        std::normal_distribution<double> noise(0, 4);
+        int32_t val = 2048;
+        for (size_t ind=0; ind+4 <= size; ind += 4) {
+            val += (int32_t)noise(rng);
+            std::memcpy(data+ind, &val, 4);
+        }
+    }
+    else {                      // random
+        std::uniform_int_distribution<int> byte(0, 255);
+        for (size_t ind=0; ind<size; ++ind) {
+            data[ind] = byte(rng);
+        }
+    }
+    return msg;
+}
+
+struct result_t {
+    double ratio{1}, enc_cpu{0}, dec_cpu{0}, enc_mbps{0}, dec_mbps{0};
+};
+
+static
+result_t run(const std::string& kind, const compression_t& policy,
+             size_t frame_size, size_t nframes)
+{
+    std::mt19937 rng(1234);
+    std::vector<zmq::multipart_t> bodies(nframes);
+    for (auto& body : bodies) {
+        body.add(make_payload(kind, frame_size, rng));
+    }
+
+    Compressor enc(policy), dec(policy);
+    std::vector<properties_t> props(nframes);
+    const std::string codec = enc.choose(enc.accept());
+
+    result_t res;
+    const double mb = 1e-6 * frame_size * nframes;
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::clock_t c0 = std::clock();
+    for (size_t ind=0; ind<nframes; ++ind) {
+        enc.compress(bodies[ind], props[ind], codec);
+    }
+    std::clock_t c1 = std::clock();
+    auto t1 = std::chrono::steady_clock::now();
+    for (size_t ind=0; ind<nframes; ++ind) {
+        dec.decompress(bodies[ind], props[ind]);
+    }
+    std::clock_t c2 = std::clock();
+    auto t2 = std::chrono::steady_clock::now();
+
+    const auto& st = enc.stats();
+    if (st.bytes_in) {
+        res.ratio = double(st.bytes_out) / st.bytes_in;
+    }
+    res.enc_cpu = double(c1-c0) / CLOCKS_PER_SEC;
+    res.dec_cpu = double(c2-c1) / CLOCKS_PER_SEC;
+    res.enc_mbps = mb / std::chrono::duration<double>(t1-t0).count();
+    res.dec_mbps = mb / std::chrono::duration<double>(t2-t1).count();
+    return res;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t frame_size = 64*1024;
+    size_t nframes = 1000;
+    double link_mbps = 125;     // 1 Gbps
+    if (argc > 1) { frame_size = atol(argv[1]); }
+    if (argc > 2) { nframes = atol(argv[2]); }
+    if (argc > 3) { link_mbps = atof(argv[3]); }
+
+    auto have = codecs_available();
+    if (have.empty()) {
+        printf("no codecs compiled in, nothing to benchmark\n");
+        return 0;
+    }
+
+    std::vector<std::pair<std::string, compression_t>> modes;
+    modes.push_back({"off", compression_t{}});
+    compression_t always{have};
+    always.adaptive = false;
+    always.max_ratio = 1e9;
+    modes.push_back({"always", always});
+    modes.push_back({"adaptive", compression_t{have}});
+
+    printf("codec %s, %ld frames of %ld bytes, link %.0f MB/s\n",
+           have.front().c_str(), nframes, frame_size, link_mbps);
+    printf("%-8s %-9s %6s %9s %9s %9s %9s %9s\n",
+           "payload", "mode", "ratio", "enc_cpu_s", "enc_MB/s",
+           "dec_cpu_s", "dec_MB/s", "link_MB/s");
+    for (std::string kind : {"zeros", "text", "numeric", "random"}) {
+        for (const auto& [mode, policy] : modes) {
+            result_t r = run(kind, policy, frame_size, nframes);
+            // Payload rate through the link is bound by the slowest
+            // of coding, decoding and the link carrying coded bytes.
+            double link = link_mbps / r.ratio;
+            double eff = std::min({link, r.enc_mbps, r.dec_mbps});
+            printf("%-8s %-9s %6.3f %9.3f %9.1f %9.3f %9.1f %9.1f\n",
+                   kind.c_str(), mode.c_str(), r.ratio, r.enc_cpu, r.enc_mbps,
+                   r.dec_cpu, r.dec_mbps, eff);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*! Simulate dispatch policies
+
+  A discrete event simulation of one service with workers of mixed
+  speed, half of them slower by a factor, fed with Poisson arrivals.
+  Requests queue in order and each time a request and an idle worker
+  meet, the dispatch policy chooses the worker, as the broker does.
+  Service times are exponential and learned by the workers' info as
+  in the broker.  Report mean, median and 99th percentile latency for
+  each built-in policy at several loads.
+
+  $ ./build/bench_dispatch [nworkers [slow_factor [nrequests]]]
+
+ */
+
+#include "generaldomo/dispatch.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <list>
+#include <queue>
+#include <random>
+
+using namespace generaldomo;
+
+struct stats_t {
+    double mean{0}, p50{0}, p99{0};
+};
+
+static
+stats_t simulate(const std::string& policy_name, const std::vector<double>& means,
+                 double load, size_t nrequests)
+{
+    auto policy = make_dispatch(policy_name);
+    std::mt19937 rng(1234);
+
+    const size_t nworkers = means.size();
+    double capacity = 0;
+    for (double mean : means) {
+        capacity += 1/mean;
+    }
+    std::exponential_distribution<double> interarrival(load * capacity);
+
+    std::vector<worker_info_t> info(nworkers);
+    std::vector<double> arrived(nworkers), started(nworkers);
+    std::list<size_t> idle;
+    for (size_t ind=0; ind<nworkers; ++ind) {
+        idle.push_back(ind);
+    }
+    std::deque<double> queue;   // arrival times
+    typedef std::pair<double, size_t> event_t; // (done time, worker)
+    std::priority_queue<event_t, std::vector<event_t>, std::greater<event_t>> done;
+
+    std::vector<double> latency;
+    latency.reserve(nrequests);
+
+    auto dispatch = [&](double now) {
+        std::vector<std::list<size_t>::iterator> candidates;
+        std::vector<const worker_info_t*> infos;
+        while (queue.size() and idle.size()) {
+            candidates.clear();
+            infos.clear();
+            for (auto it = idle.begin(); it != idle.end(); ++it) {
+                candidates.push_back(it);
+                infos.push_back(&info[*it]);
+            }
+            auto chosen = candidates[policy->choose(infos)];
+            size_t wrk = *chosen;
+            idle.erase(chosen);
+            arrived[wrk] = queue.front();
+            queue.pop_front();
+            started[wrk] = now;
+            std::exponential_distribution<double> service(1/means[wrk]);
+            done.push(event_t{now + service(rng), wrk});
+        }
+    };
+
+    double next_arrival = interarrival(rng);
+    size_t sent = 0;
+    while (latency.size() < nrequests) {
+        if (sent < nrequests and (done.empty() or next_arrival < done.top().first)) {
+            queue.push_back(next_arrival);
+            ++sent;
+            dispatch(next_arrival);
+            next_arrival += interarrival(rng);
+            continue;
+        }
+        auto [now, wrk] = done.top();
+        done.pop();
+        latency.push_back(now - arrived[wrk]);
+        info[wrk].learn(now - started[wrk]);
+        idle.push_back(wrk);
+        dispatch(now);
+    }
+
+    stats_t st;
+    for (double one : latency) {
+        st.mean += one;
+    }
+    st.mean /= latency.size();
+    std::sort(latency.begin(), latency.end());
+    st.p50 = latency[latency.size()/2];
+    st.p99 = latency[std::min(latency.size()-1, size_t(0.99*latency.size()))];
+    return st;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nworkers = 8;
+    double slow_factor = 4;
+    size_t nrequests = 200000;
+    if (argc > 1) { nworkers = atol(argv[1]); }
+    if (argc > 2) { slow_factor = atof(argv[2]); }
+    if (argc > 3) { nrequests = atol(argv[3]); }
+
+    // Fast workers take 1 ms per request on average.
+    std::vector<double> means;
+    for (size_t ind=0; ind<nworkers; ++ind) {
+        means.push_back(ind < nworkers/2 ? 0.001 : 0.001*slow_factor);
+    }
+
+    printf("%ld workers, half %.1fx slower, %ld requests\n",
+           nworkers, slow_factor, nrequests);
+    printf("%-6s %-6s %9s %9s %9s\n", "load", "policy", "mean_ms", "p50_ms", "p99_ms");
+    for (double load : {0.5, 0.8, 0.95}) {
+        for (std::string policy : {"fifo", "lifo", "ewma", "p2c"}) {
+            auto st = simulate(policy, means, load, nrequests);
+            printf("%-6.2f %-6s %9.3f %9.3f %9.3f\n", load, policy.c_str(),
+                   1e3*st.mean, 1e3*st.p50, 1e3*st.p99);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,230 @@
+/*! Benchmark the broker with a large simulated fleet
+
+  Many workers and clients are simulated in process.  Each has its
+  own identity on a frontend without a socket (Broker::add_outlet())
+  so that only the broker's own costs are measured.  The fleet grows
+  in steps and at each size a number of ticks are run, each of which
+
+  - replaces a fraction of workers (churn), by DISCONNECT and a READY
+    under a new identity,
+  - runs the broker heartbeat and has every worker heartbeat back,
+  - has clients make one request per worker, each answered at once.
+
+  For each size the broker RSS per worker, the cost of a heartbeat
+  tick in proc_heartbeat() and of taking the workers' heartbeats, the
+  cost of dispatching a client request and of taking a reply, and the
+  rate of messages in and out are reported.  RSS includes the small
+  cost of the simulated peers' identities.
+
+  $ ./build/bench_fleet [max_workers [clients_per_worker [churn [ticks [nservices]]]]]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#include <unistd.h>
+
+using namespace generaldomo;
+
+typedef std::chrono::steady_clock clock_type;
+
+// Resident set size in bytes.
+static
+size_t rss_bytes()
+{
+    std::ifstream fstr("/proc/self/statm");
+    size_t total = 0, resident = 0;
+    fstr >> total >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static
+double seconds_since(clock_type::time_point t0)
+{
+    return std::chrono::duration<double>(clock_type::now() - t0).count();
+}
+
+struct outbox_t {
+    std::vector<std::pair<remote_identity_t, zmq::multipart_t>> msgs;
+    size_t total{0};
+};
+
+struct fleet_t {
+    Broker& broker;
+    size_t frontend;
+    outbox_t& outbox;
+    size_t nservices;
+    std::vector<remote_identity_t> workers;
+    size_t next_id{0};
+    size_t injected{0};
+
+    void worker_send(const remote_identity_t& id, const char* command,
+                     zmq::multipart_t mmsg = zmq::multipart_t{}) {
+        mmsg.pushstr(command);
+        mmsg.pushstr(mdp::worker::ident);
+        broker.inject(frontend, id, mmsg);
+        ++injected;
+    }
+
+    void add_worker() {
+        remote_identity_t id = "w" + std::to_string(next_id++);
+        zmq::multipart_t mmsg;
+        mmsg.addstr("svc" + std::to_string(next_id % nservices));
+        worker_send(id, mdp::worker::ready, std::move(mmsg));
+        workers.push_back(id);
+    }
+
+    void replace_worker(size_t index) {
+        worker_send(workers[index], mdp::worker::disconnect);
+        remote_identity_t id = "w" + std::to_string(next_id++);
+        zmq::multipart_t mmsg;
+        mmsg.addstr("svc" + std::to_string(next_id % nservices));
+        worker_send(id, mdp::worker::ready, std::move(mmsg));
+        workers[index] = id;
+    }
+
+    void client_send(const remote_identity_t& id, const std::string& service) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::client::ident);
+        mmsg.addstr(service);
+        mmsg.addstr("hello");
+        broker.inject(frontend, id, mmsg);
+        ++injected;
+    }
+};
+
+struct tick_t {
+    double hb_out{0}, hb_in{0}, dispatch{0}, reply{0}, busy{0};
+    size_t requests{0}, replies{0}, messages{0};
+};
+
+static
+void run_tick(fleet_t& fleet, size_t nclients, double churn, tick_t& tick)
+{
+    auto& outbox = fleet.outbox;
+    const size_t nworkers = fleet.workers.size();
+
+    const size_t nchurn = churn * nworkers;
+    for (size_t ind=0; ind<nchurn; ++ind) {
+        fleet.replace_worker((fleet.next_id * 7919 + ind) % nworkers);
+    }
+    outbox.msgs.clear();
+
+    auto t0 = clock_type::now();
+    fleet.broker.proc_heartbeat(time_unit_t{0});
+    tick.hb_out += seconds_since(t0);
+    outbox.msgs.clear();
+
+    t0 = clock_type::now();
+    for (const auto& id : fleet.workers) {
+        fleet.worker_send(id, mdp::worker::heartbeat);
+    }
+    tick.hb_in += seconds_since(t0);
+
+    const size_t before = outbox.total + fleet.injected;
+    const auto tbusy = clock_type::now();
+    for (size_t ind=0; ind<nworkers; ++ind) {
+        t0 = clock_type::now();
+        fleet.client_send("c" + std::to_string(ind % nclients),
+                          "svc" + std::to_string(ind % fleet.nservices));
+        tick.dispatch += seconds_since(t0);
+        ++tick.requests;
+
+        // Workers answer at once, which may dispatch a queued
+        // request.  The broker's replies to clients are only counted.
+        while (outbox.msgs.size()) {
+            std::vector<std::pair<remote_identity_t, zmq::multipart_t>> msgs;
+            msgs.swap(outbox.msgs);
+            for (auto& [peer, mmsg] : msgs) {
+                if (peer[0] != 'w') {
+                    ++tick.replies;
+                    continue;
+                }
+                mmsg.pop();              // header
+                mmsg.pop();              // command
+                std::string client = mmsg.popstr();
+                mmsg.pop();              // properties
+                mmsg.pushmem(NULL, 0);
+                mmsg.pushstr(client);
+                t0 = clock_type::now();
+                fleet.worker_send(peer, mdp::worker::reply, std::move(mmsg));
+                tick.reply += seconds_since(t0);
+            }
+        }
+    }
+    tick.busy += seconds_since(tbusy);
+    tick.messages += outbox.total + fleet.injected - before;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t max_workers = 50000;
+    size_t clients_per_worker = 2;
+    double churn = 0.01;
+    size_t nticks = 5;
+    size_t nservices = 10;
+    if (argc > 1) { max_workers = atol(argv[1]); }
+    if (argc > 2) { clients_per_worker = atol(argv[2]); }
+    if (argc > 3) { churn = atof(argv[3]); }
+    if (argc > 4) { nticks = atol(argv[4]); }
+    if (argc > 5) { nservices = atol(argv[5]); }
+
+    console_log log;
+    log.level = console_log::log_level::error;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind("inproc://bench_fleet");
+
+    const size_t rss0 = rss_bytes();
+    outbox_t outbox;
+    Broker broker(sock, log);
+    // Long enough that workers live between ticks of a large fleet.
+    broker.set_heartbeat(time_unit_t{60000}, 3);
+    size_t frontend = broker.add_outlet(
+        [&outbox](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.msgs.emplace_back(peer, std::move(mmsg));
+            ++outbox.total;
+        });
+    fleet_t fleet{broker, frontend, outbox, nservices};
+
+    printf("%ld clients per worker, %.3f churn, %ld ticks, %ld services\n",
+           clients_per_worker, churn, nticks, nservices);
+    printf("%8s %8s %9s %9s %10s %10s %12s %12s %10s\n",
+           "workers", "clients", "rss MB", "KB/wkr", "hb ms", "hb in ms",
+           "dispatch us", "reply us", "msg/s");
+    for (size_t size = std::min<size_t>(1000, max_workers); ; ) {
+        while (fleet.workers.size() < size) {
+            fleet.add_worker();
+        }
+        outbox.msgs.clear();
+        const size_t rss = rss_bytes();
+
+        tick_t tick;
+        for (size_t itick=0; itick<nticks; ++itick) {
+            run_tick(fleet, size * clients_per_worker, churn, tick);
+        }
+        if (tick.replies < tick.requests) {
+            printf("warning: %ld requests, %ld replies\n", tick.requests, tick.replies);
+        }
+
+        printf("%8ld %8ld %9.1f %9.2f %10.3f %10.3f %12.3f %12.3f %10.0f\n",
+               size, size * clients_per_worker,
+               rss / 1e6, (rss - rss0) / 1e3 / size,
+               tick.hb_out * 1e3 / nticks, tick.hb_in * 1e3 / nticks,
+               tick.dispatch * 1e6 / tick.requests,
+               tick.reply * 1e6 / tick.requests,
+               tick.messages / tick.busy);
+        fflush(stdout);
+
+        if (size == max_workers) {
+            break;
+        }
+        size = std::min(max_workers, 2 * size);
+    }
+    return 0;
+}
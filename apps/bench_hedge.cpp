@@ -0,0 +1,146 @@
+/*! Benchmark hedged requests
+
+  Run a broker, some echo workers and one echo worker which stalls on
+  a fraction of its requests.  A client sends requests one at a time
+  without hedging, with a fixed hedge delay and with a delay taken
+  from the 95th percentile of recent latencies.  Report latency
+  quantiles and hedge counts for each.
+
+  $ ./build/bench_hedge [nrequests [stall_ms [stall_fraction [nworkers]]]]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/worker.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace generaldomo;
+
+// An echo worker which sometimes stalls before replying.
+static
+void stalling_echo(zmq::socket_t& pipe, std::string address, int socktype,
+                   int stall_ms, double stall_fraction)
+{
+    console_log log;
+    log.level = console_log::log_level::error;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, socktype);
+    Worker worker(sock, address, "echo", log);
+
+    zmq::poller_t<> poller;
+    poller.add(pipe, zmq::event_flags::pollin);
+    poller.add(sock, zmq::event_flags::pollin);
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> uni(0, 1);
+
+    pipe.send(zmq::message_t{}, zmq::send_flags::none); // ready
+
+    while (!interrupted()) {
+        std::vector< zmq::poller_event<> > events(2);
+        int nevents = poller.wait_all(events, time_unit_t{500});
+        for (int iev=0; iev < nevents; ++iev) {
+            if (events[iev].socket == pipe) {
+                return;
+            }
+            zmq::multipart_t request;
+            worker.recv(request);
+            if (request.empty()) {
+                break;
+            }
+            if (uni(rng) < stall_fraction) {
+                sleep_ms(time_unit_t{stall_ms});
+            }
+            worker.send(request);
+        }
+    }
+}
+
+static
+double quantile(std::vector<double>& lat, double q)
+{
+    size_t ind = std::min(lat.size()-1, size_t(q*lat.size()));
+    std::nth_element(lat.begin(), lat.begin()+ind, lat.end());
+    return lat[ind];
+}
+
+static
+void run(zmq::context_t& ctx, const std::string& address,
+         const std::string& name, const hedging_t& hedging, size_t nrequests)
+{
+    console_log log;
+    log.level = console_log::log_level::error;
+    zmq::socket_t sock(ctx, ZMQ_CLIENT);
+    Client client(sock, address, log, compression_t{}, hedging);
+
+    std::vector<double> lat;
+    for (size_t ind=0; ind<nrequests; ++ind) {
+        auto t0 = std::chrono::steady_clock::now();
+        zmq::multipart_t mmsg("hello");
+        client.send("echo", mmsg);
+        client.recv(mmsg);
+        auto dt = std::chrono::steady_clock::now() - t0;
+        if (mmsg.empty()) {
+            printf("%s: timeout\n", name.c_str());
+            return;
+        }
+        lat.push_back(std::chrono::duration<double, std::milli>(dt).count());
+    }
+    const auto& st = client.hedge_stats();
+    printf("%-10s %8.3f %8.3f %8.3f %8.3f %7ld %7ld %7ld\n", name.c_str(),
+           quantile(lat, 0.5), quantile(lat, 0.9), quantile(lat, 0.99),
+           quantile(lat, 1.0), st.hedged, st.won, st.refused);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nrequests = 2000;
+    int stall_ms = 50;
+    double stall_fraction = 0.05;
+    size_t nworkers = 3;
+    if (argc > 1) { nrequests = atol(argv[1]); }
+    if (argc > 2) { stall_ms = atoi(argv[2]); }
+    if (argc > 3) { stall_fraction = atof(argv[3]); }
+    if (argc > 4) { nworkers = atol(argv[4]); }
+
+    zmq::context_t ctx;
+    std::string address = "tcp://127.0.0.1:5558";
+
+    std::vector<zmq::actor_t*> actors;
+    actors.push_back(new zmq::actor_t(ctx, broker_actor, address, ZMQ_SERVER));
+    for (size_t ind=0; ind<nworkers; ++ind) {
+        actors.push_back(new zmq::actor_t(ctx, echo_worker, address, ZMQ_CLIENT));
+    }
+    actors.push_back(new zmq::actor_t(ctx, stalling_echo, address, ZMQ_CLIENT,
+                                      stall_ms, stall_fraction));
+    sleep_ms(time_unit_t{500}); // let workers say READY
+
+    printf("%ld requests, %ld echo workers and one stalling %d ms on %.1f%%\n",
+           nrequests, nworkers, stall_ms, 100*stall_fraction);
+    printf("%-10s %8s %8s %8s %8s %7s %7s %7s\n", "hedging",
+           "p50_ms", "p90_ms", "p99_ms", "max_ms", "hedged", "won", "refused");
+
+    hedging_t fixed;
+    fixed.delay = time_unit_t{5};
+    fixed.budget = 0.1;
+    hedging_t p95;
+    p95.percentile = 0.95;
+    p95.budget = 0.1;
+
+    run(ctx, address, "off", hedging_t{}, nrequests);
+    run(ctx, address, "fixed5ms", fixed, nrequests);
+    run(ctx, address, "p95", p95, nrequests);
+
+    for (auto it = actors.rbegin(); it != actors.rend(); ++it) {
+        (*it)->pipe().send(zmq::message_t{}, zmq::send_flags::none);
+        delete *it;
+    }
+    return 0;
+}
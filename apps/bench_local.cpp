@@ -0,0 +1,145 @@
+/*! Benchmark in-process handlers
+
+  Run a broker in an actor serving three echo services: "remote" by
+  a worker over the socket, "inline" by a handler the broker thread
+  calls and "pool" by a handler on one local thread.  A client makes
+  requests in turn and the latency of each service is reported.
+
+  $ ./build/bench_local [nrequests [address]]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/worker.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+using namespace generaldomo;
+
+static
+zmq::multipart_t echo_handler(zmq::multipart_t& request)
+{
+    return std::move(request);
+}
+
+static
+void local_broker(zmq::socket_t& pipe, std::string address)
+{
+    console_log log;
+    log.level = console_log::log_level::error;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind(address);
+    Broker broker(sock, log);
+    broker.add_handler("inline", echo_handler);
+    broker.add_handler("pool", echo_handler, 1);
+    pipe.send(zmq::message_t{}, zmq::send_flags::none);
+
+    while (true) {
+        auto items = broker.pollitems();
+        items.push_back(zmq::pollitem_t{pipe.handle(), 0, ZMQ_POLLIN, 0});
+        zmq::poll(items, broker.next_timeout());
+        if (items.back().revents & ZMQ_POLLIN) {
+            zmq::message_t die;
+            auto res = pipe.recv(die);
+            return;
+        }
+        broker.process_ready();
+    }
+}
+
+static
+void remote_worker(zmq::socket_t& pipe, std::string address)
+{
+    console_log log;
+    log.level = console_log::log_level::error;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_CLIENT);
+    Worker worker(sock, address, "remote", log);
+    pipe.send(zmq::message_t{}, zmq::send_flags::none);
+
+    zmq::poller_t<> poller;
+    poller.add(pipe, zmq::event_flags::pollin);
+    poller.add(sock, zmq::event_flags::pollin);
+    while (true) {
+        std::vector< zmq::poller_event<> > events(2);
+        int nevents = poller.wait_all(events, time_unit_t{500});
+        for (int iev=0; iev < nevents; ++iev) {
+            if (events[iev].socket == pipe) {
+                zmq::message_t die;
+                auto res = pipe.recv(die);
+                return;
+            }
+            zmq::multipart_t request;
+            worker.recv(request);
+            if (request.size()) {
+                worker.send(request);
+            }
+        }
+    }
+}
+
+// Return the sorted latencies in microseconds.
+static
+std::vector<double> latencies(Client& client, std::string service, size_t nrequests)
+{
+    std::vector<double> ret;
+    for (size_t ind=0; ind<nrequests; ++ind) {
+        auto t0 = std::chrono::steady_clock::now();
+        zmq::multipart_t mmsg("hello");
+        client.send(service, mmsg);
+        client.recv(mmsg);
+        auto dt = std::chrono::steady_clock::now() - t0;
+        if (mmsg.empty()) {
+            break;
+        }
+        ret.push_back(std::chrono::duration<double, std::micro>(dt).count());
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nrequests = 10000;
+    std::string address = "tcp://127.0.0.1:5565";
+    if (argc > 1) { nrequests = atol(argv[1]); }
+    if (argc > 2) { address = argv[2]; }
+
+    console_log log;
+    log.level = console_log::log_level::error;
+    zmq::context_t ctx;
+    auto broker = new zmq::actor_t(ctx, local_broker, address);
+    auto worker = new zmq::actor_t(ctx, remote_worker, address);
+
+    {
+        zmq::socket_t sock(ctx, ZMQ_CLIENT);
+        Client client(sock, address, log);
+        sleep_ms(time_unit_t{500}); // let the worker say READY
+
+        printf("%ld requests to %s\n", nrequests, address.c_str());
+        printf("%-8s %10s %10s %10s\n", "service", "mean us", "p50 us", "p99 us");
+        for (std::string service : {"remote", "inline", "pool"}) {
+            auto lat = latencies(client, service, nrequests);
+            if (lat.empty()) {
+                printf("%-8s failed\n", service.c_str());
+                continue;
+            }
+            double sum = 0;
+            for (double one : lat) { sum += one; }
+            printf("%-8s %10.1f %10.1f %10.1f\n", service.c_str(),
+                   sum / lat.size(), lat[lat.size()/2], lat[lat.size()*99/100]);
+        }
+    }
+
+    for (auto* actor : {worker, broker}) {
+        actor->pipe().send(zmq::message_t{}, zmq::send_flags::none);
+        delete actor;
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*! Benchmark the cost of broker observers
+
+  A worker and a client are simulated through a frontend without a
+  socket so only the broker is measured.  Requests are made one at a
+  time through brokers built with no observer, with the counting one
+  and with the profiling one, whose breakdown of the time spent on
+  each message by phase is then printed.
+
+  $ ./build/bench_observer [nrequests [size]]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace generaldomo;
+
+template<class Observer>
+void run(BasicBroker<Observer>& broker, const std::string& name,
+         size_t nrequests, size_t size)
+{
+    // The outlet keeps only the last request the worker was given.
+    zmq::multipart_t given;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            if (peer == "w") {
+                given = std::move(mmsg);
+            }
+        });
+
+    zmq::multipart_t ready;
+    ready.addstr(mdp::worker::ident);
+    ready.addstr(mdp::worker::ready);
+    ready.addstr("echo");
+    broker.inject(fe, "w", ready);
+
+    const std::string body(size, 'x');
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t ind=0; ind<nrequests; ++ind) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::client::ident);
+        mmsg.addstr("echo");
+        mmsg.addstr(body);
+        broker.inject(fe, "c", mmsg);
+
+        // Echo the request as the reply, keeping client, properties
+        // and body.
+        given.pop();            // header
+        given.pop();            // command
+        given.pushstr(mdp::worker::reply);
+        given.pushstr(mdp::worker::ident);
+        broker.inject(fe, "w", given);
+    }
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    printf("%-10s %12.0f %10.3f\n", name.c_str(), nrequests / dt.count(),
+           1e6 * dt.count() / nrequests);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nrequests = 1000000;
+    size_t size = 64;
+    if (argc > 1) { nrequests = atol(argv[1]); }
+    if (argc > 2) { size = atol(argv[2]); }
+
+    console_log log;
+    log.level = console_log::log_level::error;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind("inproc://bench_observer");
+
+    printf("%ld requests of %ld bytes\n", nrequests, size);
+    printf("%-10s %12s %10s\n", "observer", "requests/s", "us/request");
+    {
+        BasicBroker<NullObserver> broker(sock, log);
+        run(broker, "null", nrequests, size);
+    }
+    {
+        BasicBroker<CountingObserver> broker(sock, log);
+        run(broker, "counting", nrequests, size);
+    }
+    BasicBroker<ProfilingObserver> broker(sock, log);
+    run(broker, "profiling", nrequests, size);
+
+    // Each request is two messages, its own and its reply.
+    printf("\n%-10s %12s %7s\n", "phase", "ticks/msg", "share");
+    printf("%s", broker.observer().summary().c_str());
+    return 0;
+}
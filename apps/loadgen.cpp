@@ -0,0 +1,321 @@
+/*! Open-loop load generator
+
+  Requests are sent on a schedule at a target rate whether or not
+  earlier ones have been answered, so a saturated broker shows its
+  queueing in the latencies rather than slowing the generator.  The
+  latency of each request is taken from when it was meant to be sent,
+  not when it was, so a generator which falls behind does not hide
+  the delay ("coordinated omission").
+
+  The rate is stepped through a list to find the knee where latency
+  or lost replies grow.  For each step a line of summary is printed
+  and an HdrHistogram percentile distribution, in milliseconds, is
+  written to <out>-<rate>.hgrm, and one per service if the mix has
+  several, for diffing between versions.
+
+  Settings are given as key=value arguments:
+
+  - broker :: "embedded" (default) to run a broker on address, or the
+    address of an external broker.
+  - address :: where an embedded broker binds (tcp://127.0.0.1:5566).
+  - socket :: "server" (default) or "router".
+  - schedule :: "fixed" (default) or "poisson" inter-send times.
+  - rates :: comma list of requests per second (1000,2000,4000,8000).
+  - duration :: milliseconds per rate step (5000).
+  - timeout :: milliseconds to wait for replies after a step (1000).
+  - mix :: comma list of service:weight:bytes:delay_us giving the
+    share of requests for each service, their payload size and how
+    long its workers take (loadgen:1:64:0).
+  - workers :: number of workers started per service of the mix (1).
+    Give 0 to use those of an external broker.
+  - out :: prefix of histogram files (loadgen).
+
+  $ ./build/loadgen rates=5000,10000,20000 mix=fast:9:64:0,slow:1:4096:500
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/histogram.hpp"
+#include "generaldomo/protocol.hpp"
+#include "generaldomo/worker.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+using namespace generaldomo;
+
+typedef std::chrono::steady_clock clock_type;
+
+struct mix_t {
+    std::string service;
+    double weight;
+    size_t bytes;
+    std::chrono::microseconds delay;
+};
+
+static
+std::vector<mix_t> parse_mix(const std::string& text)
+{
+    std::vector<mix_t> ret;
+    for (auto one : split_list(text)) {
+        std::vector<std::string> parts;
+        size_t beg = 0;
+        while (true) {
+            size_t end = one.find(':', beg);
+            parts.push_back(one.substr(beg, end - beg));
+            if (end == std::string::npos) {
+                break;
+            }
+            beg = end + 1;
+        }
+        if (parts.size() != 4 or parts[0].empty()) {
+            throw std::runtime_error("loadgen bad mix: " + one);
+        }
+        ret.push_back(mix_t{parts[0], std::stod(parts[1]), std::stoul(parts[2]),
+                            std::chrono::microseconds{std::stol(parts[3])}});
+    }
+    if (ret.empty()) {
+        throw std::runtime_error("loadgen empty mix");
+    }
+    return ret;
+}
+
+// An echo worker which takes delay to reply.
+static
+void delay_worker(zmq::socket_t& pipe, std::string address, int socktype,
+                  std::string service, std::chrono::microseconds delay)
+{
+    console_log log;
+    log.level = console_log::log_level::error;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, socktype);
+    Worker worker(sock, address, service, log);
+
+    zmq::poller_t<> poller;
+    poller.add(pipe, zmq::event_flags::pollin);
+    poller.add(sock, zmq::event_flags::pollin);
+
+    pipe.send(zmq::message_t{}, zmq::send_flags::none); // ready
+
+    while (!interrupted()) {
+        std::vector< zmq::poller_event<> > events(2);
+        int nevents = poller.wait_all(events, time_unit_t{500});
+        for (int iev=0; iev < nevents; ++iev) {
+            if (events[iev].socket == pipe) {
+                return;
+            }
+            zmq::multipart_t request;
+            worker.recv(request);
+            if (request.empty()) {
+                break;
+            }
+            if (delay.count()) {
+                std::this_thread::sleep_for(delay);
+            }
+            worker.send(request);
+        }
+    }
+}
+
+struct step_t {
+    size_t sent{0}, received{0}, failed{0};
+    Histogram all;
+    std::vector<Histogram> each;
+};
+
+// Run one rate step, sending for duration and then waiting up to
+// timeout for the last replies.
+static
+void run_step(zmq::socket_t& sock, const std::vector<mix_t>& mix,
+              double rate, bool poisson, time_unit_t duration,
+              time_unit_t timeout, std::mt19937_64& rng, step_t& step)
+{
+    std::vector<double> weights;
+    for (const auto& one : mix) {
+        weights.push_back(one.weight);
+    }
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    std::exponential_distribution<double> expo(rate);
+    const std::chrono::duration<double> period(1.0 / rate);
+
+    struct sent_t {
+        clock_type::time_point intended;
+        size_t which;
+    };
+    std::unordered_map<std::string, sent_t> pending;
+    static size_t next_id = 0;
+
+    const auto start = clock_type::now();
+    const auto stop = start + duration;
+    const auto give_up = stop + timeout;
+    auto next_send = start;
+
+    while (true) {
+        auto now = clock_type::now();
+
+        // Send all that are due, each keeping its intended time.
+        while (next_send <= now and next_send < stop) {
+            size_t which = pick(rng);
+            std::string id = std::to_string(++next_id);
+            properties_t props{{gdp::prop::id, id}};
+            zmq::multipart_t mmsg;
+            mmsg.addstr(gdp::client::ident);
+            mmsg.addstr(mix[which].service);
+            mmsg.add(encode_properties(props));
+            mmsg.add(zmq::message_t(std::string(mix[which].bytes, 'x')));
+            send_clientish(sock, mmsg);
+            pending[id] = sent_t{next_send, which};
+            ++step.sent;
+            if (poisson) {
+                next_send += std::chrono::duration_cast<clock_type::duration>(
+                    std::chrono::duration<double>(expo(rng)));
+            }
+            else {
+                next_send += std::chrono::duration_cast<clock_type::duration>(period);
+            }
+        }
+
+        // Take all replies which are in.
+        while (sock.getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN) {
+            zmq::multipart_t mmsg;
+            recv_clientish(sock, mmsg);
+            if (mmsg.size() < 3 or mmsg.popstr() != gdp::client::ident) {
+                continue;
+            }
+            mmsg.pop();         // service
+            properties_t props = decode_properties(mmsg.pop());
+            auto it = pending.find(props[gdp::prop::id]);
+            if (it == pending.end()) {
+                continue;       // from an earlier step
+            }
+            if (props.count(gdp::prop::error)) {
+                ++step.failed;
+            }
+            else {
+                auto took = std::chrono::duration_cast<std::chrono::microseconds>(
+                    clock_type::now() - it->second.intended);
+                step.all.record(took.count());
+                step.each[it->second.which].record(took.count());
+                ++step.received;
+            }
+            pending.erase(it);
+        }
+
+        now = clock_type::now();
+        if (now >= give_up or (next_send >= stop and pending.empty())) {
+            break;
+        }
+
+        // Wait for input until the next send.  Poll resolution is a
+        // millisecond so the last part of the wait spins.
+        auto until = next_send < stop ? next_send : give_up;
+        auto wait = std::chrono::duration_cast<time_unit_t>(until - now);
+        zmq::pollitem_t items[] = {{sock.handle(), 0, ZMQ_POLLIN, 0}};
+        zmq::poll(items, 1, wait);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    properties_t cfg{
+        {"broker", "embedded"},
+        {"address", "tcp://127.0.0.1:5566"},
+        {"socket", "server"},
+        {"schedule", "fixed"},
+        {"rates", "1000,2000,4000,8000"},
+        {"duration", "5000"},
+        {"timeout", "1000"},
+        {"mix", "loadgen:1:64:0"},
+        {"workers", "1"},
+        {"out", "loadgen"},
+    };
+    for (int ind=1; ind<argc; ++ind) {
+        std::string arg = argv[ind];
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos or !cfg.count(arg.substr(0, eq))) {
+            fprintf(stderr, "loadgen: unknown setting: %s\n", arg.c_str());
+            return 1;
+        }
+        cfg[arg.substr(0, eq)] = arg.substr(eq+1);
+    }
+
+    int serverish = ZMQ_SERVER, clientish = ZMQ_CLIENT;
+    if (cfg["socket"] == "router") {
+        serverish = ZMQ_ROUTER;
+        clientish = ZMQ_DEALER;
+    }
+    const bool embedded = cfg["broker"] == "embedded";
+    const std::string address = embedded ? cfg["address"] : cfg["broker"];
+    const bool poisson = cfg["schedule"] == "poisson";
+    const time_unit_t duration{std::stol(cfg["duration"])};
+    const time_unit_t timeout{std::stol(cfg["timeout"])};
+    const auto mix = parse_mix(cfg["mix"]);
+    const size_t nworkers = std::stoul(cfg["workers"]);
+
+    zmq::context_t ctx;
+    std::vector<zmq::actor_t*> actors;
+    if (embedded) {
+        actors.push_back(new zmq::actor_t(ctx, broker_actor, address, serverish));
+    }
+    for (const auto& one : mix) {
+        for (size_t ind=0; ind<nworkers; ++ind) {
+            actors.push_back(new zmq::actor_t(ctx, delay_worker, address, clientish,
+                                              one.service, one.delay));
+        }
+    }
+
+    {
+        zmq::socket_t sock(ctx, clientish);
+        int linger = 0;
+        sock.setsockopt(ZMQ_LINGER, linger);
+        sock.connect(address);
+        sleep_ms(time_unit_t{500}); // let workers say READY
+
+        std::mt19937_64 rng(42);
+        printf("%s %s schedule, %ld ms steps\n", address.c_str(),
+               cfg["schedule"].c_str(), (long)duration.count());
+        printf("%10s %10s %10s %8s %8s %10s %10s %10s %10s\n",
+               "rate", "achieved", "received", "failed", "lost",
+               "p50 ms", "p99 ms", "p99.9 ms", "max ms");
+        bool knee = false;
+        for (auto text : split_list(cfg["rates"])) {
+            const double rate = std::stod(text);
+            step_t step;
+            step.each.resize(mix.size());
+            run_step(sock, mix, rate, poisson, duration, timeout, rng, step);
+
+            const size_t lost = step.sent - step.received - step.failed;
+            const double achieved = step.received * 1000.0 / duration.count();
+            printf("%10.0f %10.0f %10ld %8ld %8ld %10.3f %10.3f %10.3f %10.3f",
+                   rate, achieved, step.received, step.failed, lost,
+                   step.all.percentile(50) / 1000.0,
+                   step.all.percentile(99) / 1000.0,
+                   step.all.percentile(99.9) / 1000.0,
+                   step.all.max() / 1000.0);
+            // The first step not keeping up is the knee.
+            if (!knee and (lost or step.failed or achieved < 0.95 * rate)) {
+                knee = true;
+                printf("  <- knee");
+            }
+            printf("\n");
+            fflush(stdout);
+
+            const std::string base = cfg["out"] + "-" + text;
+            step.all.write(base + ".hgrm", 1000.0);
+            for (size_t ind=0; mix.size() > 1 and ind < mix.size(); ++ind) {
+                step.each[ind].write(base + "-" + mix[ind].service + ".hgrm", 1000.0);
+            }
+        }
+    }
+
+    for (auto it = actors.rbegin(); it != actors.rend(); ++it) {
+        (*it)->pipe().send(zmq::message_t{}, zmq::send_flags::none);
+        delete *it;
+    }
+    return 0;
+}
@@ -4,9 +4,13 @@ Main module for generaldomo
 
 '''
 
+import time
+
 import zmq
 import click
 
+from . import native
+
 sock_name2type = dict(router=zmq.ROUTER,
                       dealer=zmq.DEALER,
                       server=zmq.SERVER,
@@ -14,11 +18,14 @@ sock_name2type = dict(router=zmq.ROUTER,
 
 
 @click.group("generaldomo")
+@click.option("--pure/--native", default=False,
+              help="Use pure Python even if the native module is built")
 @click.pass_context
-def cli(ctx):
+def cli(ctx, pure):
     '''
     Generaldomo command line interface
     '''
+    native.use(not pure)
 
 @cli.command()
 @click.option("--verbose/--no-verbose", default=False,
@@ -39,8 +46,8 @@ def tripping(verbose, number, frontend, backend):
     '''
     from .tripping import main
 
-    fes_type = stype[frontend.lower()]
-    bes_type = stype[backend.lower()]
+    fes_type = sock_name2type[frontend.lower()]
+    bes_type = sock_name2type[backend.lower()]
     main(fes_type, bes_type, number, verbose)
 
 
@@ -103,6 +110,7 @@ def client(verbose, socket, number, address, service, args):
 
     service = service.encode('utf-8')
     request = [one.encode('utf-8') for one in args]
+    start = time.time()
     for scount in range(number):
         try:
             if verbose:
@@ -120,7 +128,10 @@ def client(verbose, socket, number, address, service, args):
         if verbose:
             print("recv",reply)
 
+    elapsed = time.time() - start
     print(f'{scount+1} sent, {rcount+1} recv')
+    if rcount:
+        print(" %d calls/second" % ((rcount+1) / elapsed))
 
 
 
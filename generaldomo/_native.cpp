@@ -0,0 +1,568 @@
+/*! Native acceleration of the generaldomo Python API
+
+  This extension module wraps the C++ Client and Worker with the
+  calling conventions of generaldomo.client and generaldomo.worker and
+  provides the message codec of generaldomo.zhelpers.  It is built by
+  setup.py when the C++ library can be found.  See generaldomo/native.py.
+
+  Waits for the broker are made without holding the GIL.  A worker
+  waits no longer than a heartbeat at a time so that Python may take
+  signals.
+
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "generaldomo/client.hpp"
+#include "generaldomo/worker.hpp"
+
+#include <cstring>
+#include <memory>
+
+using namespace generaldomo;
+
+// Call func without holding the GIL.  If it throws, set a Python
+// exception, once the GIL is held again, and return false.
+template<typename Func>
+static
+bool without_gil(Func func)
+{
+    std::string what;
+    bool ok = true;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        func();
+    }
+    catch (const std::exception& err) {
+        ok = false;
+        what = err.what();
+    }
+    Py_END_ALLOW_THREADS
+    if (!ok) {
+        PyErr_SetString(PyExc_RuntimeError, what.c_str());
+    }
+    return ok;
+}
+
+// Get a view of a bytes-like object or of an object with a bytes
+// attribute such as a zmq.Frame.
+static
+int get_buffer(PyObject* obj, Py_buffer* view)
+{
+    if (PyObject_GetBuffer(obj, view, PyBUF_SIMPLE) == 0) {
+        return 0;
+    }
+    if (!PyObject_HasAttrString(obj, "bytes")) {
+        return -1;
+    }
+    PyErr_Clear();
+    PyObject* bytes = PyObject_GetAttrString(obj, "bytes");
+    if (!bytes) {
+        return -1;
+    }
+    // The view holds its own reference.
+    int rc = PyObject_GetBuffer(bytes, view, PyBUF_SIMPLE);
+    Py_DECREF(bytes);
+    return rc;
+}
+
+// Return the bytes of a str (as UTF-8) or of a bytes-like object.
+static
+bool to_string(PyObject* obj, std::string& str)
+{
+    if (PyUnicode_Check(obj)) {
+        Py_ssize_t size = 0;
+        const char* data = PyUnicode_AsUTF8AndSize(obj, &size);
+        if (!data) {
+            return false;
+        }
+        str.assign(data, size);
+        return true;
+    }
+    Py_buffer view;
+    if (get_buffer(obj, &view) != 0) {
+        return false;
+    }
+    str.assign(static_cast<const char*>(view.buf), view.len);
+    PyBuffer_Release(&view);
+    return true;
+}
+
+// Make a message from one bytes-like object or a list of them, as
+// given to the Python send methods.
+static
+bool to_multipart(PyObject* obj, zmq::multipart_t& mmsg)
+{
+    if (!PyList_Check(obj)) {
+        std::string one;
+        if (!to_string(obj, one)) {
+            return false;
+        }
+        mmsg.addmem(one.data(), one.size());
+        return true;
+    }
+    const Py_ssize_t nparts = PyList_GET_SIZE(obj);
+    for (Py_ssize_t ind=0; ind<nparts; ++ind) {
+        Py_buffer view;
+        if (get_buffer(PyList_GET_ITEM(obj, ind), &view) != 0) {
+            return false;
+        }
+        mmsg.addmem(view.buf, view.len);
+        PyBuffer_Release(&view);
+    }
+    return true;
+}
+
+// Return a new list of bytes, one per frame.
+static
+PyObject* from_multipart(zmq::multipart_t& mmsg)
+{
+    PyObject* list = PyList_New(mmsg.size());
+    if (!list) {
+        return nullptr;
+    }
+    for (size_t ind=0; ind<mmsg.size(); ++ind) {
+        const zmq::message_t& frame = mmsg[ind];
+        PyObject* one = PyBytes_FromStringAndSize(
+            static_cast<const char*>(frame.data()), frame.size());
+        if (!one) {
+            Py_DECREF(list);
+            return nullptr;
+        }
+        PyList_SET_ITEM(list, ind, one);
+    }
+    return list;
+}
+
+// Return true if a KeyboardInterrupt came, which is then taken as
+// the pure Python API does.  Any other exception from a signal
+// handler is left set and false is returned.
+static
+bool take_interrupt()
+{
+    if (PyErr_CheckSignals() == 0) {
+        return false;
+    }
+    if (PyErr_ExceptionMatches(PyExc_KeyboardInterrupt)) {
+        PyErr_Clear();
+        return true;
+    }
+    return false;
+}
+
+// The zmq part of a client or worker.  Each owns its context as do
+// the pure Python classes.
+struct native_t {
+    zmq::context_t ctx;
+    zmq::socket_t sock;
+    console_log log;
+    native_t(int socket_type, bool verbose)
+        : sock(ctx, socket_type)
+    {
+        log.level = verbose ? console_log::log_level::debug
+                            : console_log::log_level::error;
+    }
+};
+
+
+/*
+ * Codec
+ */
+
+static
+PyObject* encode_message(PyObject* self, PyObject* parts)
+{
+    PyObject* seq = PySequence_Fast(parts, "parts must be a sequence");
+    if (!seq) {
+        return nullptr;
+    }
+    const Py_ssize_t nparts = PySequence_Fast_GET_SIZE(seq);
+    std::vector<Py_buffer> views(nparts);
+    Py_ssize_t nviews = 0, total = 0;
+    PyObject* ret = nullptr;
+    for (; nviews<nparts; ++nviews) {
+        if (get_buffer(PySequence_Fast_GET_ITEM(seq, nviews), &views[nviews]) != 0) {
+            goto done;
+        }
+        total += (views[nviews].len < 255 ? 1 : 5) + views[nviews].len;
+    }
+    ret = PyBytes_FromStringAndSize(nullptr, total);
+    if (ret) {
+        auto out = reinterpret_cast<unsigned char*>(PyBytes_AS_STRING(ret));
+        for (const auto& view : views) {
+            const size_t size = view.len;
+            if (size < 255) {
+                *out++ = size;
+            }
+            else {
+                *out++ = 0xFF;
+                *out++ = size >> 24;
+                *out++ = size >> 16;
+                *out++ = size >> 8;
+                *out++ = size;
+            }
+            memcpy(out, view.buf, size);
+            out += size;
+        }
+    }
+  done:
+    for (Py_ssize_t ind=0; ind<nviews; ++ind) {
+        PyBuffer_Release(&views[ind]);
+    }
+    Py_DECREF(seq);
+    return ret;
+}
+
+static
+PyObject* decode_message(PyObject* self, PyObject* encoded)
+{
+    Py_buffer view;
+    if (PyObject_GetBuffer(encoded, &view, PyBUF_SIMPLE) != 0) {
+        return nullptr;
+    }
+    auto data = static_cast<const unsigned char*>(view.buf);
+    const size_t tot = view.len;
+    PyObject* list = PyList_New(0);
+    size_t beg = 0;
+    while (list and beg < tot) {
+        size_t size = data[beg++];
+        if (size == 0xFF) {
+            if (beg + 4 > tot) {
+                PyErr_SetString(PyExc_ValueError, "corrupt message part in size");
+                Py_CLEAR(list);
+                break;
+            }
+            size = (size_t(data[beg]) << 24) | (size_t(data[beg+1]) << 16)
+                | (size_t(data[beg+2]) << 8) | size_t(data[beg+3]);
+            beg += 4;
+        }
+        if (beg + size > tot) {
+            PyErr_SetString(PyExc_ValueError, "corrupt message part in data");
+            Py_CLEAR(list);
+            break;
+        }
+        PyObject* one = PyBytes_FromStringAndSize(
+            reinterpret_cast<const char*>(data + beg), size);
+        if (!one or PyList_Append(list, one) != 0) {
+            Py_XDECREF(one);
+            Py_CLEAR(list);
+            break;
+        }
+        Py_DECREF(one);
+        beg += size;
+    }
+    PyBuffer_Release(&view);
+    return list;
+}
+
+
+/*
+ * Client
+ */
+
+struct ClientObject {
+    PyObject_HEAD
+    native_t* native;
+    Client* client;
+    long timeout;
+};
+
+static
+int Client_init(ClientObject* self, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"broker", "socket_type", "verbose", nullptr};
+    PyObject* broker_obj = nullptr;
+    int socket_type = ZMQ_DEALER, verbose = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|ip", const_cast<char**>(kwlist),
+                                     &broker_obj, &socket_type, &verbose)) {
+        return -1;
+    }
+    std::string broker;
+    if (!to_string(broker_obj, broker)) {
+        return -1;
+    }
+    delete self->client;
+    delete self->native;
+    self->client = nullptr;
+    self->native = nullptr;
+    try {
+        auto native = std::make_unique<native_t>(socket_type, verbose);
+        self->client = new Client(native->sock, broker, native->log);
+        self->native = native.release();
+        self->timeout = HEARTBEAT_INTERVAL.count();
+        self->client->set_timeout(time_unit_t{self->timeout}, false);
+    }
+    catch (const std::exception& err) {
+        PyErr_SetString(PyExc_ValueError, err.what());
+        return -1;
+    }
+    return 0;
+}
+
+static
+void Client_dealloc(ClientObject* self)
+{
+    delete self->client;
+    delete self->native;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static
+PyObject* Client_send(ClientObject* self, PyObject* args)
+{
+    PyObject *service_obj = nullptr, *request_obj = nullptr;
+    if (!PyArg_ParseTuple(args, "OO", &service_obj, &request_obj)) {
+        return nullptr;
+    }
+    if (!self->client) {
+        PyErr_SetString(PyExc_RuntimeError, "client is not initialized");
+        return nullptr;
+    }
+    std::string service;
+    zmq::multipart_t request;
+    if (!to_string(service_obj, service) or !to_multipart(request_obj, request)) {
+        return nullptr;
+    }
+    if (!without_gil([&]() { self->client->send(service, request); })) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static
+PyObject* Client_recv(ClientObject* self, PyObject* unused)
+{
+    if (!self->client) {
+        PyErr_SetString(PyExc_RuntimeError, "client is not initialized");
+        return nullptr;
+    }
+    zmq::multipart_t reply;
+    if (!without_gil([&]() { self->client->recv(reply); })) {
+        return nullptr;
+    }
+    if (take_interrupt()) {
+        Py_RETURN_NONE;
+    }
+    if (PyErr_Occurred()) {
+        return nullptr;
+    }
+    if (reply.empty()) {
+        self->native->log.error("W: permanent error, abandoning request");
+        Py_RETURN_NONE;
+    }
+    return from_multipart(reply);
+}
+
+static
+PyObject* Client_get_timeout(ClientObject* self, void* closure)
+{
+    return PyLong_FromLong(self->timeout);
+}
+
+static
+int Client_set_timeout(ClientObject* self, PyObject* value, void* closure)
+{
+    long timeout = value ? PyLong_AsLong(value) : -1;
+    if (timeout < 0) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(PyExc_ValueError, "timeout must be a positive number of ms");
+        }
+        return -1;
+    }
+    if (!self->client) {
+        PyErr_SetString(PyExc_RuntimeError, "client is not initialized");
+        return -1;
+    }
+    self->timeout = timeout;
+    self->client->set_timeout(time_unit_t{timeout}, false);
+    return 0;
+}
+
+static PyMethodDef Client_methods[] = {
+    {"send", (PyCFunction)Client_send, METH_VARARGS,
+     "send(service, request)\n\nSend request, bytes or a list of bytes, to service."},
+    {"recv", (PyCFunction)Client_recv, METH_NOARGS,
+     "recv()\n\nReturn the reply as a list of bytes or None if there was no reply."},
+    {nullptr}
+};
+
+static PyGetSetDef Client_getset[] = {
+    {"timeout", (getter)Client_get_timeout, (setter)Client_set_timeout,
+     "Milliseconds recv() waits for a reply.", nullptr},
+    {nullptr}
+};
+
+static PyTypeObject ClientType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+
+/*
+ * Worker
+ */
+
+struct WorkerObject {
+    PyObject_HEAD
+    native_t* native;
+    Worker* worker;
+};
+
+static
+void Worker_destroy_native(WorkerObject* self)
+{
+    delete self->worker;
+    self->worker = nullptr;
+    delete self->native;
+    self->native = nullptr;
+}
+
+static
+int Worker_init(WorkerObject* self, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"broker", "service", "socket_type", "verbose", nullptr};
+    PyObject *broker_obj = nullptr, *service_obj = nullptr;
+    int socket_type = ZMQ_DEALER, verbose = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|ip", const_cast<char**>(kwlist),
+                                     &broker_obj, &service_obj, &socket_type, &verbose)) {
+        return -1;
+    }
+    std::string broker, service;
+    if (!to_string(broker_obj, broker) or !to_string(service_obj, service)) {
+        return -1;
+    }
+    Worker_destroy_native(self);
+    try {
+        auto native = std::make_unique<native_t>(socket_type, verbose);
+        self->worker = new Worker(native->sock, broker, service, native->log);
+        self->native = native.release();
+    }
+    catch (const std::exception& err) {
+        PyErr_SetString(PyExc_ValueError, err.what());
+        return -1;
+    }
+    return 0;
+}
+
+static
+void Worker_dealloc(WorkerObject* self)
+{
+    Worker_destroy_native(self);
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static
+PyObject* Worker_recv(WorkerObject* self, PyObject* args)
+{
+    PyObject* reply_obj = Py_None;
+    if (!PyArg_ParseTuple(args, "|O", &reply_obj)) {
+        return nullptr;
+    }
+    if (!self->worker) {
+        PyErr_SetString(PyExc_RuntimeError, "worker is destroyed");
+        return nullptr;
+    }
+    zmq::multipart_t reply;
+    if (reply_obj != Py_None and !to_multipart(reply_obj, reply)) {
+        return nullptr;
+    }
+    if (!without_gil([&]() { self->worker->send(reply); })) {
+        return nullptr;
+    }
+    while (true) {
+        zmq::multipart_t request;
+        if (!without_gil([&]() { self->worker->recv(request); })) {
+            return nullptr;
+        }
+        if (take_interrupt()) {
+            break;
+        }
+        if (PyErr_Occurred()) {
+            return nullptr;
+        }
+        if (request.size()) {
+            return from_multipart(request);
+        }
+    }
+    self->native->log.error("W: interrupt received, killing worker...");
+    Py_RETURN_NONE;
+}
+
+static
+PyObject* Worker_destroy(WorkerObject* self, PyObject* unused)
+{
+    Worker_destroy_native(self);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef Worker_methods[] = {
+    {"recv", (PyCFunction)Worker_recv, METH_VARARGS,
+     "recv(reply=None)\n\nSend reply, if any, and return the next request as a\n"
+     "list of bytes, or None if interrupted."},
+    {"destroy", (PyCFunction)Worker_destroy, METH_NOARGS,
+     "destroy()\n\nDisconnect and release the socket and context."},
+    {nullptr}
+};
+
+static PyTypeObject WorkerType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+
+/*
+ * Module
+ */
+
+static PyMethodDef module_methods[] = {
+    {"encode_message", (PyCFunction)encode_message, METH_O,
+     "encode_message(parts)\n\nEncode bytes-like parts as zmsg_encode() does."},
+    {"decode_message", (PyCFunction)decode_message, METH_O,
+     "decode_message(encoded)\n\nReturn the list of bytes encoded by encode_message()."},
+    {nullptr}
+};
+
+static struct PyModuleDef native_module = {
+    PyModuleDef_HEAD_INIT,
+    "generaldomo._native",
+    "Native acceleration of the generaldomo Python API.",
+    -1,
+    module_methods,
+};
+
+PyMODINIT_FUNC PyInit__native()
+{
+    ClientType.tp_name = "generaldomo._native.Client";
+    ClientType.tp_doc = "Generaldomo client of the C++ library.";
+    ClientType.tp_basicsize = sizeof(ClientObject);
+    ClientType.tp_flags = Py_TPFLAGS_DEFAULT;
+    ClientType.tp_new = PyType_GenericNew;
+    ClientType.tp_init = (initproc)Client_init;
+    ClientType.tp_dealloc = (destructor)Client_dealloc;
+    ClientType.tp_methods = Client_methods;
+    ClientType.tp_getset = Client_getset;
+
+    WorkerType.tp_name = "generaldomo._native.Worker";
+    WorkerType.tp_doc = "Generaldomo worker of the C++ library.";
+    WorkerType.tp_basicsize = sizeof(WorkerObject);
+    WorkerType.tp_flags = Py_TPFLAGS_DEFAULT;
+    WorkerType.tp_new = PyType_GenericNew;
+    WorkerType.tp_init = (initproc)Worker_init;
+    WorkerType.tp_dealloc = (destructor)Worker_dealloc;
+    WorkerType.tp_methods = Worker_methods;
+
+    if (PyType_Ready(&ClientType) < 0 or PyType_Ready(&WorkerType) < 0) {
+        return nullptr;
+    }
+    PyObject* mod = PyModule_Create(&native_module);
+    if (!mod) {
+        return nullptr;
+    }
+    Py_INCREF(&ClientType);
+    Py_INCREF(&WorkerType);
+    if (PyModule_AddObject(mod, "Client", reinterpret_cast<PyObject*>(&ClientType)) < 0
+        or PyModule_AddObject(mod, "Worker", reinterpret_cast<PyObject*>(&WorkerType)) < 0) {
+        Py_DECREF(mod);
+        return nullptr;
+    }
+    return mod;
+}
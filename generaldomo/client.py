@@ -14,9 +14,23 @@ import logging
 import zmq
 
 from . import MDP
+from . import native
 from .zhelpers import dump, clientish_recv, clientish_send
 
-class Client(object):
+
+def Client(broker, socket_type=zmq.ROUTER, verbose=False):
+    """Return a client of the broker.
+
+    This is the native client if it is in use and takes the socket
+    type, else a PyClient.  Both have the same API.
+    """
+    nat = native.module(socket_type)
+    if nat:
+        return nat.Client(broker, socket_type, verbose)
+    return PyClient(broker, socket_type, verbose)
+
+
+class PyClient(object):
     """Majordomo Protocol Client API, Python version.
 
       Implements the MDP/Worker spec at http:#rfc.zeromq.org/spec:7.
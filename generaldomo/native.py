@@ -0,0 +1,50 @@
+"""Optional native acceleration of the generaldomo Python API.
+
+The _native extension module wraps the C++ Client and Worker and
+provides the message codec.  setup.py builds it when the C++ library
+can be found and otherwise goes without.  The pure Python versions are
+used if it is missing, if use(False) is called or if GENERALDOMO_PURE
+is set in the environment.
+"""
+
+import os
+
+import zmq
+
+try:
+    from . import _native
+except ImportError:
+    _native = None
+
+_enabled = _native is not None and not os.environ.get("GENERALDOMO_PURE")
+
+# The C++ Client and Worker take only these sockets.
+_socket_types = (zmq.DEALER, zmq.CLIENT)
+
+
+def use(enable=True):
+    '''Enable or disable the native module.
+
+    Return True if it is then in use.
+    '''
+    global _enabled
+    _enabled = bool(enable) and _native is not None
+    return _enabled
+
+
+def enabled():
+    '''Return True if the native module is in use.'''
+    return _enabled
+
+
+def module(socket_type=None):
+    '''Return the native module if it is in use, else None.
+
+    If a socket type is given the module is only returned if its
+    Client and Worker take that type.
+    '''
+    if not _enabled:
+        return None
+    if socket_type is not None and socket_type not in _socket_types:
+        return None
+    return _native
@@ -16,8 +16,22 @@ import zmq
 from .zhelpers import dump, clientish_recv, clientish_send
 # MajorDomo protocol constants:
 from . import MDP
+from . import native
 
-class Worker(object):
+
+def Worker(broker, service, socket_type=zmq.DEALER, verbose=False):
+    """Return a worker providing the service.
+
+    This is the native worker if it is in use and takes the socket
+    type, else a PyWorker.  Both have the same API.
+    """
+    nat = native.module(socket_type)
+    if nat:
+        return nat.Worker(broker, service, socket_type, verbose)
+    return PyWorker(broker, service, socket_type, verbose)
+
+
+class PyWorker(object):
     """Generaldomo Protocol Worker API, Python version
 
     Implements the MDP/Worker spec at http:#rfc.zeromq.org/spec:7.
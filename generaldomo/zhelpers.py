@@ -12,6 +12,8 @@ from random import randint
 import struct
 import zmq
 
+from . import native
+
 def socket_set_hwm(socket, hwm=-1):
     """libzmq 2/3/4 compatible sethwm"""
     try:
@@ -83,7 +85,12 @@ def encode_message(parts):
     smaller than 255 bytes are prefixed with a 1-byte size value.
     Larger parts are prefixed by a fixed 1-byte value of 0xFF and a
     4-byte size value.
+
+    The native module does this if it is in use.
     '''
+    nat = native.module()
+    if nat:
+        return nat.encode_message(parts)
     ret = b''
     for p in parts:
         if isinstance(p, zmq.Frame):
@@ -106,19 +113,22 @@ def decode_message(encoded):
     exception that each part in the returned list is of type bytes,
     an not zmq.Frame.
     '''
+    nat = native.module()
+    if nat:
+        return nat.decode_message(encoded)
     tot = len(encoded)
     ret = list()
     beg = 0
     while beg < tot:
         end = beg + 1           # small size of 0xFF
-        if end >= tot:
+        if end > tot:
             raise ValueError("corrupt message part in size")
         size = struct.unpack('>B',encoded[beg:end])[0]
         beg = end
 
         if size == 0xFF:        # large message
             end = beg + 4
-            if end >= tot:
+            if end > tot:
                 raise ValueError("corrupt message part in size")
             size = struct.unpack('>I',encoded[beg:end])[0]
             beg = end
@@ -0,0 +1,51 @@
+/*! Generaldomo reconnect backoff
+ *
+ * When a peer loses the broker it waits before connecting again.
+ * Waits grow exponentially with "decorrelated jitter" so that a
+ * fleet of peers which lost a broker together do not all come back
+ * to it together.
+ */
+
+#ifndef GENERALDOMO_BACKOFF_HPP_SEEN
+#define GENERALDOMO_BACKOFF_HPP_SEEN
+
+#include "generaldomo/util.hpp"
+
+#include <random>
+
+namespace generaldomo {
+
+    /*! Policy for waiting to reconnect. */
+    struct backoff_t {
+        // Least wait and the scale of the first.
+        time_unit_t base{250};
+        // Most wait.
+        time_unit_t cap{30000};
+    };
+
+    /*! Give the wait before each successive reconnect.
+     *
+     * Each wait is drawn uniformly between the base and three times
+     * the last wait, and capped.
+     */
+    class Backoff {
+    public:
+        explicit Backoff(const backoff_t& policy = backoff_t{});
+
+        /// Return how long to wait before the next attempt.
+        time_unit_t next();
+
+        /// Forget past attempts, eg once the broker is heard from.
+        void reset() { m_last = time_unit_t{0}; }
+
+        const backoff_t& policy() const { return m_policy; }
+
+    private:
+        backoff_t m_policy;
+        time_unit_t m_last{0};
+        std::minstd_rand m_rng;
+    };
+
+}
+
+#endif
@@ -3,46 +3,359 @@
 
 #include "generaldomo/logging.hpp"
 #include "generaldomo/util.hpp"
+#include "generaldomo/cache.hpp"
+#include "generaldomo/dispatch.hpp"
+#include "generaldomo/spill.hpp"
+#include "generaldomo/observer.hpp"
+#include "generaldomo/pool.hpp"
 #include <zmq.hpp>
 #include <zmq_addon.hpp>
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include <deque>
 #include <list>
+#include <vector>
 #include <functional>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 
 namespace generaldomo {
 
 
-    /*! The generaldomo broker class */
+    /*! Options the broker owner may set for a service. */
+    struct service_options_t {
+        // Replies depend only on the request so may be cached.  A
+        // worker may also declare its service idempotent in READY.
+        bool idempotent{false};
+        // How long a cached reply may be used.
+        time_unit_t cache_ttl{60000};
+        // Most bytes of reply bodies and their requests to cache.
+        size_t cache_bytes{64*1024*1024};
+        // Attach a request to an identical one already queued or in
+        // flight instead of dispatching it again.
+        bool coalesce{false};
+        // A request whose worker dies is requeued.  One given to this
+        // many workers which all died is quarantined as poison.
+        size_t max_attempts{3};
+        // Most poison requests to keep for inspection.
+        size_t quarantine_size{16};
+        // Take a busy worker as dead if not heard from for this long.
+        // As a handler may work long without heartbeating, zero means
+        // never.  A worker which tells in READY that it heartbeats
+        // while busy expires as if idle instead.
+        time_unit_t busy_expiry{0};
+        // Name of the policy choosing among waiting workers.  See
+        // make_dispatch() and Broker::add_dispatch().
+        std::string dispatch{"lifo"};
+        // Most requests to queue.  More are refused with an
+        // "overload" error.  Zero for no limit.
+        size_t max_requests{0};
+        // Most requests of a batch to give one worker at a time.
+        // Zero for no limit.
+        size_t max_batch{0};
+    };
+
+    /*! Configuration of a broker.  See config.hpp to load it. */
+    struct broker_config_t {
+        // Interval between heartbeats to workers.
+        time_unit_t heartbeat{HEARTBEAT_INTERVAL};
+        // Heartbeats a worker may miss before it is taken as dead.
+        int liveness{HEARTBEAT_LIVENESS};
+        // Options of services by name.
+        std::map<std::string, service_options_t> services;
+        // Most bytes of queued request bodies, over all services, to
+        // hold in memory.  Those beyond are spilled to a file.  Zero
+        // for no limit.
+        size_t memory_budget{0};
+        // Where to make the spill file, empty for TMPDIR or /tmp.
+        std::string spill_dir{};
+        // Most bytes the spill file may hold, zero for no limit.
+        // While it is full and memory over budget, new requests are
+        // refused as overloaded.
+        size_t spill_limit{0};
+        // If nonzero, start() spins on non-blocking receives and
+        // only blocks after this long without input.
+        std::chrono::microseconds busy_poll{0};
+        // CPUs to pin the thread running start() to, none if empty.
+        std::vector<int> cpus{};
+        // CPUs to pin ZeroMQ I/O threads to.  This applies to the
+        // context made by broker_actor().
+        std::vector<int> io_cpus{};
+    };
+
+    /*! Takes a message the broker sends to a peer of a frontend
+     * without a socket, given the peer identity as it was injected. */
+    typedef std::function<void(const remote_identity_t& peer,
+                               zmq::multipart_t& mmsg)> outlet_t;
 
-    class Broker {
+    /*! The generaldomo broker class
+     *
+     * The Observer is told of events and of the phases of processing
+     * each message, see observer.hpp.  The default does nothing and
+     * compiles away.  The library has brokers for the built-in
+     * observers, include broker_impl.hpp to build one for another. */
+
+    template<class Observer = NullObserver>
+    class BasicBroker {
     public:
 
         /// Create a broker with a ROUTER or SERVER socket already
         /// bound.  Caller must keep socket, eg to mix with others in
         /// an actor's poller.
-        Broker(zmq::socket_t& sock, logbase_t& log);
-        ~Broker();
-
-        /// Begin brokering (run forever).  The guts of this method
-        /// need to be reimplemented if proc_*() are called instead.
-        void start();
-
-        /// Process one input on socket
+        BasicBroker(zmq::socket_t& sock, logbase_t& log,
+                    const broker_config_t& config = broker_config_t{});
+        ~BasicBroker();
+
+        /// Also broker a ROUTER or SERVER socket already bound.  All
+        /// sockets share services, so eg a 7/MDP client on a ROUTER
+        /// may be served by a GDP worker on a SERVER.  Caller must
+        /// keep socket.
+        void add_socket(zmq::socket_t& sock);
+
+        /// Add a frontend without a socket, eg to simulate many
+        /// peers in process.  Messages from its peers are given to
+        /// inject() and those to them are given to the outlet.
+        /// Return the frontend index for inject().
+        size_t add_outlet(outlet_t outlet);
+
+        /// Process a message from a peer of a frontend added with
+        /// add_outlet() as if it was received on a socket.  The
+        /// outlet must not call inject().
+        void inject(size_t frontend, remote_identity_t sender,
+                    zmq::multipart_t& mmsg);
+
+        /// Begin brokering until interrupted or, if extra poll items
+        /// are given, one has input.  To broker from some other event
+        /// loop, use fd(), process_ready() and next_timeout().
+        void start(const std::vector<zmq::pollitem_t>& extra = {});
+
+        /// Return the file descriptor of the socket for an event loop
+        /// (eg epoll) to watch for reading.  As for any ZeroMQ socket
+        /// it signals when input may have become ready and not again
+        /// until that is processed, so call process_ready() until it
+        /// does less than its budget.
+        int fd() const;
+
+        /// Return the file descriptors of all sockets, the first as
+        /// fd(), and that signaling in-process replies, if any.
+        /// Watch them all if sockets or handlers were added.
+        std::vector<int> fds() const;
+
+        /// Return poll items for all that fds() gives, eg to add
+        /// others and call zmq::poll().
+        std::vector<zmq::pollitem_t> pollitems() const;
+
+        /// Process at most budget messages, those which are ready,
+        /// and heartbeating if due.  This never blocks.  Return the
+        /// number of messages processed.
+        size_t process_ready(size_t budget = 100);
+
+        /// Return how long an event loop may wait before calling
+        /// process_ready() even if the socket is not readable.
+        time_unit_t next_timeout() const;
+
+        /// Process one input on a socket, waiting for one as needed.
         void proc_one();
 
         /// Do heartbeat processing given next heatbeat time. 
         void proc_heartbeat(time_unit_t heartbeat_at);
 
+        /// Set options for a service, which need not yet exist.
+        /// Throws if the dispatch policy is unknown.  Clients may do
+        /// the same with the internal service mmi.config.
+        void configure(std::string service, const service_options_t& opts);
+
+        /// Set the heartbeat interval and the number of heartbeats a
+        /// worker may miss.
+        void set_heartbeat(time_unit_t interval, int liveness);
+
+        /// Set the most bytes of queued request bodies to hold in
+        /// memory, zero for no limit.  Bodies already spilled are
+        /// read back as they reach a worker.
+        void set_memory_budget(size_t bytes) { m_memory_budget = bytes; }
+
+        /// Set the most bytes the spill file may hold, zero for no
+        /// limit.
+        void set_spill_limit(size_t bytes) { m_spill_limit = bytes; }
+
+        /// Have start() spin for up to this long without input
+        /// before it blocks, trading a core for latency.  Zero
+        /// turns spinning off.
+        void set_busy_poll(std::chrono::microseconds spin) { m_busy_poll = spin; }
+
+        /// Return the bytes of queued request bodies held in memory
+        /// and in the spill file.  Bodies in the hands of workers
+        /// are not counted.
+        size_t resident_bytes() const { return m_resident; }
+        size_t spilled_bytes() const { return m_spilled; }
+
+        /// Serve a service in process.  With nthreads zero, the
+        /// broker thread calls the handler, else that many threads of
+        /// a local pool do.  Request bodies are moved, not copied or
+        /// encoded.  Each thread, or the inline handler, is one
+        /// worker of the service, sharing its queue with remote
+        /// workers and counted by mmi.  A handler which throws gives
+        /// an empty reply with the "handler" error, which is never
+        /// cached.
+        void add_handler(std::string service, handler_t handler,
+                         size_t nthreads = 0);
+
+        /// Make a dispatch policy available by name, possibly
+        /// replacing a built-in one.  Services already using the
+        /// name keep their policy until configured again.
+        void add_dispatch(std::string name, dispatch_factory_t factory);
+
+        /// Return the observer, eg to configure it or read what it
+        /// has gathered.
+        Observer& observer() { return m_observer; }
+        const Observer& observer() const { return m_observer; }
+
     private:
 
-        std::function<remote_identity_t(zmq::socket_t& server_socket,
-                                        zmq::multipart_t& mmsg)> recv;
-        std::function<void(zmq::socket_t& server_socket,
-                           zmq::multipart_t& mmsg, remote_identity_t rid)> send;
+        // A socket the broker serves.  Each peer identity is tagged
+        // with a leading byte holding the index of its socket.
+        // Without a socket, messages are sent to the outlet.
+        struct Frontend {
+            zmq::socket_t* sock;
+            outlet_t outlet;
+            std::function<remote_identity_t(zmq::socket_t& server_socket,
+                                            zmq::multipart_t& mmsg)> recv;
+            std::function<void(zmq::socket_t& server_socket,
+                               zmq::multipart_t& mmsg, remote_identity_t rid)> send;
+        };
+        bool readable(size_t index) const;
+        void proc_frontend(size_t index);
+        void proc_message(remote_identity_t sender, zmq::multipart_t& mmsg);
+        // Read the clock once for the work which follows.
+        void tick() { m_now = mono_ms(); }
+        // Send to a tagged identity.
+        void send(zmq::multipart_t& mmsg, const remote_identity_t& rid);
 
         struct Service;
+        struct Local;
+        struct Worker;
+        struct Transfer;
+
+        // Collects the replies to the slices of a split batch.
+        struct Gather {
+            remote_identity_t client;
+            std::string service;
+            // Codec which workers may apply to reply frames.
+            std::string codec{""};
+            // One encoded reply per request of the batch.
+            std::vector<zmq::message_t> replies;
+            // One '0' or '1' per reply telling if it is coded.
+            std::string coded;
+            // Number of replies yet to arrive.
+            size_t remaining{0};
+            // Cache the whole reply under this key and request.
+            bool cacheable{false};
+            ReplyCache::key_t key{0};
+            zmq::multipart_t request{};
+            // Others wait on the reply, see Service::followers.
+            bool leader{false};
+            // The client's request identifier, if any.
+            std::string id;
+            // A slice was quarantined and the client told.
+            bool failed{false};
+            // The client's request properties if it is a pipeline.
+            properties_t pipeline;
+        };
+
+        // Collects the replies to the copies of a broadcast request.
+        struct Fanout {
+            remote_identity_t client;
+            bool extended{true};
+            std::string service;
+            // The client's request identifier, if any.
+            std::string id;
+            // Replies needed, zero if those of all copies are taken
+            // as they come.
+            size_t quorum{0};
+            // One encoded reply per copy answered, in order of
+            // arrival.
+            std::vector<zmq::message_t> replies;
+            // Number of copies yet to be answered or lost.
+            size_t remaining{0};
+            // When to reply with what has been gathered, by default a
+            // heartbeat expiry after the request came.
+            time_unit_t wait_until{0};
+            // The client has been replied to.
+            bool done{false};
+        };
+
+        // A client request waiting for a worker
+        struct Request {
+            // The identity of the client.
+            remote_identity_t client;
+            // True if the client speaks the GDP extended protocol.
+            bool extended{false};
+            // GDP properties of the request, empty for 7/MDP.
+            properties_t props;
+            // Client request body, 7/MDP Frames 3+.
+            zmq::multipart_t body;
+            // Number of requests packed in the body if a batch, else 0.
+            size_t batch{0};
+            // If this is a slice of a split batch, where its replies go.
+            std::shared_ptr<Gather> gather{};
+            size_t offset{0};
+            // If this is a copy of a broadcast, where its reply goes.
+            std::shared_ptr<Fanout> fanout{};
+            // If this is the first chunk of a transfer, the rest.
+            std::shared_ptr<Transfer> transfer{};
+            // True if a batch of one sent unpacked to a plain worker.
+            bool unpacked{false};
+            // Cache the reply under this key.
+            bool cacheable{false};
+            ReplyCache::key_t key{0};
+            // Others wait on the reply, see Service::followers.
+            bool leader{false};
+            // When the client gives up on the reply, zero for never.
+            time_unit_t deadline{0};
+            // Number of times given to a worker.
+            size_t attempts{0};
+            // If set the body is empty and is held encoded in the
+            // spill file.
+            bool spilled{false};
+            size_t spill_offset{0}, spill_size{0};
+
+            // Return true if the body frames are coded.
+            bool coded() const;
+        };
+
+        // A request sent in chunks.  The first is queued as the
+        // request and the rest go to the worker given it as they
+        // come, or are held until then.
+        struct Transfer {
+            remote_identity_t client;
+            std::string service;
+            // The client's transfer identifier and that with the
+            // client identity, the key in m_transfers.
+            std::string id, key;
+            // Most chunks the client sends before given credit.
+            size_t window{1};
+            // Number of the next chunk and if the last has come.
+            size_t next{1};
+            bool last{false};
+            // The worker given the first chunk, if yet.
+            Worker* worker{nullptr};
+            // Chunks which came before that.
+            std::deque<Request> held;
+            // The client was told of an error, drop the reply.
+            bool failed{false};
+            // Credit passed to the client.  A chunk numbered from
+            // window plus this on is refused.
+            size_t credits{0};
+            // When the worker was given the first chunk, a later one
+            // or the client credit.  A client with credit idle for
+            // the heartbeat expiry is taken as gone.
+            time_unit_t heard{0};
+        };
 
         // This is a proxy for the remote worker
         struct Worker {
@@ -53,6 +366,47 @@ namespace generaldomo {
             Service* service{nullptr};
             // Expire the worker at this time, heartbeat refreshes.
             time_unit_t expiry{0};
+
+            // True if the worker gave GDP properties in READY.
+            bool extended{false};
+            // Codecs the worker may decode.
+            std::vector<std::string> codecs;
+            // True if the worker can take a batch as one request.
+            bool batch{false};
+            // True if the worker can take a request in chunks.
+            bool transfer{false};
+
+            // True while the worker has a request in hand.
+            bool busy{false};
+            // The request in hand, kept whole to requeue if the
+            // worker dies.
+            Request inflight;
+            // When a message was last received from the worker.
+            time_unit_t heard{0};
+            // If nonzero, the worker heartbeats while busy and is
+            // dead if not heard from for this long.
+            time_unit_t busy_expiry{0};
+
+            // Set if an in-process handler, which never expires.
+            Local* local{nullptr};
+
+            // A worker offering several services has a proxy for
+            // each.  The first owns the connection, the expiry and
+            // the heartbeat and holds the others.  The others share
+            // its identity and point to it.
+            Worker* primary{nullptr};
+            std::vector<Worker*> others;
+
+            // Copies of broadcasts to give this worker once idle.
+            std::deque<Request> targeted;
+
+            // What the dispatch policy knows and when the request in
+            // hand was sent, to measure the service time.
+            worker_info_t info;
+            std::chrono::steady_clock::time_point dispatched;
+
+            // Return true if worker may take the request.
+            bool accepts(const Request& req) const;
         };
 
         // This collects workers for a given service
@@ -61,9 +415,8 @@ namespace generaldomo {
             // Service name, that is the "thing" that its workers know how to do.
             std::string name;
 
-            // List of client requests for this service.  Each holds a
-            // full 7/MDP message starting with Frame 1.
-            std::deque<zmq::multipart_t> requests;
+            // List of client requests for this service.
+            std::deque<Request> requests;
 
             // List of waiting workers.
             std::list<Worker*> waiting;
@@ -71,38 +424,206 @@ namespace generaldomo {
             // How many workers the service has
             size_t nworkers{0};
 
+            // How many of the workers accept each codec.
+            std::unordered_map<std::string, size_t> codecs;
+
+            // Codecs accepted by every worker, as GDP "accept" value.
+            std::string accept() const;
+
+            service_options_t options;
+            // Replies of an idempotent service.
+            ReplyCache cache;
+
+            // Clients waiting on the reply to an identical request,
+            // by request key.  Only requests which are queued or in
+            // flight have an entry.  It holds the request as another
+            // with the same key need not be identical.
+            struct Follower {
+                remote_identity_t client;
+                bool extended{false};
+                std::string id;
+                time_unit_t deadline{0};
+            };
+            struct Followers {
+                zmq::multipart_t request;
+                std::vector<Follower> clients;
+            };
+            std::unordered_map<ReplyCache::key_t, Followers> followers;
+
+            // Number of requests dropped as their clients gave up.
+            size_t expired{0};
+
+            // Number of requests refused as the queue was full.
+            size_t rejected{0};
+
+            // Number of requests requeued after their worker died and
+            // those quarantined, the most recent of which are kept.
+            size_t requeued{0};
+            size_t quarantined{0};
+            std::deque<Request> quarantine;
+
+            std::unique_ptr<DispatchPolicy> dispatch;
+
             ~Service ();
         };
 
+        // A reply of an in-process handler.
+        struct LocalReply {
+            Worker* worker;
+            zmq::multipart_t body;
+            // Set if the handler threw, with what it said.
+            bool failed{false};
+            std::string error;
+        };
+
+        // Runs the in-process handler of a service.
+        struct Local {
+            handler_t handler;
+            // Null if the broker thread calls the handler.
+            std::unique_ptr<WorkPool<LocalReply>> pool;
+        };
+
     private:
         void purge_workers();
+        void purge_requests();
         Service* service_require(std::string name);
         void service_dispatch(Service* srv);
-        void service_internal(remote_identity_t rid, std::string service_name,
+        typename std::deque<Request>::iterator
+        service_split(Service* srv, typename std::deque<Request>::iterator req_it,
+                      size_t nbatch, size_t nsingle);
+        void local_dispatch(Worker* wrk, zmq::multipart_t& body);
+        LocalReply local_call(Local* local, Worker* wrk, zmq::multipart_t& body);
+        void local_replies();
+
+        void service_internal(const Request& req, std::string service_name,
                               zmq::multipart_t& mmsg);
+        zmq::multipart_t config_internal(const std::string& service_name,
+                                         const properties_t& settings);
+
+        std::unique_ptr<DispatchPolicy> dispatch_make(const std::string& name);
 
         Worker* worker_require(remote_identity_t identity);
         void worker_delete(Worker*& wrk, int disconnect);
 
         void worker_process(remote_identity_t sender, zmq::multipart_t& mmsg);
+        void worker_reply(Worker* wrk, properties_t& props, zmq::multipart_t& mmsg);
+        // Give a request to a waiting worker, sending mmsg as its body.
+        void worker_give(Worker* wrk, Request& req, const properties_t& props,
+                         zmq::multipart_t& mmsg);
+        // Send a REQUEST message to a remote worker.
+        void worker_request(Worker* wrk, const remote_identity_t& client,
+                            const properties_t& props, zmq::multipart_t& mmsg);
+
+        void request_transfer(Service* srv, Request& req);
+        // Send held chunks to the worker given the first.
+        void transfer_bind(Transfer& xfer, Worker* wrk);
+        void transfer_credit(Transfer& xfer, properties_t& props);
+        // Tell the client, and any worker, that a transfer failed.
+        void transfer_fail(Transfer& xfer, const std::string& why);
+
+        void request_broadcast(Service* srv, Request& req);
+        void fanout_reply(Fanout& fan, zmq::multipart_t* mmsg);
+        void fanout_finish(Fanout& fan);
+        void fanout_expire();
         void worker_waiting(Worker* wkr);
 
-        void client_process(remote_identity_t client_id, zmq::multipart_t& mmsg);
+        void client_process(remote_identity_t client_id, zmq::multipart_t& mmsg,
+                            bool extended);
+        // Queue, answer or dispatch a request as if from its client.
+        void request_submit(const std::string& service_name, Request& req);
+        // Submit a reply as the request to the next pipeline stage.
+        void pipeline_next(remote_identity_t client_id, const properties_t& req_props,
+                           const properties_t& props, zmq::multipart_t& body);
+        void client_reply(remote_identity_t client_id, bool extended,
+                          const std::string& id, const std::string& service,
+                          properties_t& props, zmq::multipart_t& body);
+        void gather_reply(const Request& req, const properties_t& props,
+                          zmq::multipart_t& body);
+        void request_reply(Service* srv, remote_identity_t client_id,
+                           bool extended, const std::string& id,
+                           bool leader, ReplyCache::key_t key,
+                           properties_t& props, zmq::multipart_t& body);
+        bool request_cancel(Service* srv, remote_identity_t client_id,
+                            const std::string& id);
+        bool request_expired(Service* srv, const Request& req, time_unit_t now);
+        typename std::deque<Request>::iterator
+        request_drop(Service* srv, typename std::deque<Request>::iterator req_it);
+        void request_requeue(Service* srv, Request& req);
+        // Reply to the client of a request which will not be served
+        // with an error saying why.
+        void request_fail(Service* srv, Request& req, const std::string& why);
+
+        // Account for a request entering or leaving a queue.
+        void queue_add(const Request& req);
+        void queue_remove(const Request& req);
+        // Spill bodies from the back of the queue while over budget.
+        void queue_budget(Service* srv);
+        // Return false if the spill file is full.
+        bool request_spill(Request& req);
+        void request_load(Request& req);
+        // Load the body or fail the request, returning false.
+        bool request_restore(Service* srv, Request& req);
+        void spill_compact();
 
     private:
 
-        zmq::socket_t& m_sock;
+        std::vector<Frontend> m_frontends;
+        // Where process_ready() looks first, to be fair.
+        size_t m_next_frontend{0};
         logbase_t& m_log;
 
-        // fixme: make configurable
         time_unit_t m_hb_interval{HEARTBEAT_INTERVAL};
         time_unit_t m_hb_expiry{HEARTBEAT_EXPIRY};
+        int m_hb_liveness{HEARTBEAT_LIVENESS};
+        // When process_ready() next heartbeats.
+        time_unit_t m_heartbeat_at{0};
+        // The time as of the last tick().
+        time_unit_t m_now{0};
+        std::chrono::microseconds m_busy_poll{0};
+        std::vector<int> m_cpus;
 
         std::unordered_map<remote_identity_t, Service*> m_services;
         std::unordered_map<remote_identity_t, Worker*> m_workers;
         std::unordered_set<Worker*> m_waiting;
+        std::unordered_set<Worker*> m_busy;
+        std::unordered_map<std::string, dispatch_factory_t> m_dispatch;
+
+        std::vector<std::unique_ptr<Local>> m_locals;
+        // Replies of in-process handlers yet to be sent, from the
+        // broker thread and, made with the first pool, from pools.
+        std::deque<LocalReply> m_inline;
+        std::unique_ptr<WakeQueue<LocalReply>> m_done;
+
+        size_t m_memory_budget{0};
+        std::string m_spill_dir;
+        size_t m_spill_limit{0};
+        bool m_spill_full{false};
+        // Made when first needed.
+        std::unique_ptr<SpillFile> m_spill;
+        size_t m_resident{0}, m_spilled{0}, m_nspilled{0};
+
+        // Broadcasts which reply after a wait.
+        std::list<std::shared_ptr<Fanout>> m_fanouts;
+
+        // Transfers by client identity and transfer identifier.
+        std::unordered_map<std::string, std::shared_ptr<Transfer>> m_transfers;
+
+        Observer m_observer;
+        // Events are not told to a NullObserver, so their arguments
+        // cost nothing.
+        static constexpr bool observed = !std::is_same_v<Observer, NullObserver>;
     };
 
+    // Built in the library.  Include broker_impl.hpp to build a
+    // broker for another observer.
+    extern template class BasicBroker<NullObserver>;
+    extern template class BasicBroker<CountingObserver>;
+    extern template class BasicBroker<ProfilingObserver>;
+    extern template class BasicBroker<SamplingObserver>;
+
+    /*! The broker as usually used, observed by nothing. */
+    typedef BasicBroker<> Broker;
+
 
     /*! The launch and forget generaldomo broker actor function.
      *
@@ -113,6 +634,11 @@ namespace generaldomo {
      * If ROUTER, the broker will act as a 7/MDP v0.1 broker.
      * Else it will act as a GDP broker.
      *
+     * The broker is configured from GENERALDOMO_BROKER_* environment
+     * variables, see config_env().  If they do not load, the error is
+     * logged and sent as the actor's ready signal, which is otherwise
+     * empty, and the actor waits to be told to go without brokering.
+     *
      * The actor protocol supports the commands:
      * - (BIND, address) :: bind broker socket to address
      * - (START) :: enter main brokering loop
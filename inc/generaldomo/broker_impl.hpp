@@ -0,0 +1,2159 @@
+/*! Generaldomo broker template definitions
+ *
+ * Include this, rather than broker.hpp, to build a BasicBroker with
+ * an observer of your own:
+ *
+ *   #include "generaldomo/broker_impl.hpp"
+ *   template class generaldomo::BasicBroker<MyObserver>;
+ *
+ * The brokers of the built-in observers are built in the library and
+ * declared extern in broker.hpp so they are not built again.
+ */
+
+#ifndef GENERALDOMO_BROKER_IMPL_HPP_SEEN
+#define GENERALDOMO_BROKER_IMPL_HPP_SEEN
+
+// The broker code is implemented closely following the C++ example
+// for Majordomo in the Zguide (mdbroker.cpp).  However, we use cppzmq
+// and abstract away the differences between ROUTER and SERVER
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/util.hpp"
+#include "generaldomo/protocol.hpp"
+#include "generaldomo/config.hpp"
+#include <sstream>
+#include <algorithm>
+
+namespace generaldomo {
+
+    namespace detail {
+
+        // Services named like this are provided by the broker itself.
+        inline bool is_internal(const std::string& name)
+        {
+            return name.compare(0, 4, "mmi.") == 0;
+        }
+
+        // Properties of a request on which its reply may depend.
+        inline std::string reply_shape(const properties_t& props)
+        {
+            std::string shape;
+            for (const char* key : {gdp::prop::batch, gdp::prop::codec,
+                                    gdp::prop::coded, gdp::prop::accept}) {
+                auto it = props.find(key);
+                shape += key;
+                shape += "=";
+                if (it != props.end()) {
+                    shape += it->second;
+                }
+                shape += "\n";
+            }
+            return shape;
+        }
+
+        // A request as the reply cache compares it: its shape then its body.
+        // No body data is copied.
+        inline zmq::multipart_t request_frames(const properties_t& props, zmq::multipart_t& body)
+        {
+            zmq::multipart_t frames = share_frames(body);
+            frames.pushstr(reply_shape(props));
+            return frames;
+        }
+
+        // Bytes of a message body.
+        inline
+        size_t body_bytes(const zmq::multipart_t& body)
+        {
+            size_t bytes = 0;
+            for (const auto& msg : body) {
+                bytes += msg.size();
+            }
+            return bytes;
+        }
+
+        // The client's identifier of a request, if any.
+        inline std::string request_id(const properties_t& props)
+        {
+            auto it = props.find(gdp::prop::id);
+            if (it == props.end()) {
+                return "";
+            }
+            return it->second;
+        }
+
+    }
+
+    template<class Observer>
+    BasicBroker<Observer>::Service::~Service () {
+    }
+
+    template<class Observer>
+    std::string BasicBroker<Observer>::Service::accept() const
+    {
+        std::string ret;
+        for (const auto& [codec, count] : codecs) {
+            if (count < nworkers) {
+                continue;
+            }
+            if (ret.size()) {
+                ret += ",";
+            }
+            ret += codec;
+        }
+        return ret;
+    }
+
+    template<class Observer>
+    bool BasicBroker<Observer>::Request::coded() const
+    {
+        return props.find(gdp::prop::codec) != props.end();
+    }
+
+    template<class Observer>
+    bool BasicBroker<Observer>::Worker::accepts(const Request& req) const
+    {
+        if (req.transfer and !transfer) {
+            return false;
+        }
+        if (req.batch and !batch) {
+            // A plain worker gets a batch of one, unpacked.
+            if (req.batch > 1 or req.coded()) {
+                return false;
+            }
+        }
+        auto it = req.props.find(gdp::prop::codec);
+        if (it == req.props.end()) {
+            return true;
+        }
+        return std::find(codecs.begin(), codecs.end(), it->second) != codecs.end();
+    }
+
+
+    template<class Observer>
+    BasicBroker<Observer>::BasicBroker(zmq::socket_t& sock, logbase_t& log,
+                                       const broker_config_t& config)
+        : m_log(log)
+        , m_heartbeat_at(mono_ms() + config.heartbeat)
+        , m_now(mono_ms())
+        , m_busy_poll(config.busy_poll)
+        , m_cpus(config.cpus)
+        , m_memory_budget(config.memory_budget)
+        , m_spill_dir(config.spill_dir)
+        , m_spill_limit(config.spill_limit)
+    {
+        add_socket(sock);
+        set_heartbeat(config.heartbeat, config.liveness);
+        for (const auto& [name, opts] : config.services) {
+            configure(name, opts);
+        }
+    }
+
+    template<class Observer>
+    BasicBroker<Observer>::~BasicBroker()
+    {
+        // Pools give to m_done so go first.
+        m_locals.clear();
+        while (! m_services.empty()) {
+            delete m_services.begin()->second;
+            m_services.erase(m_services.begin());
+        }
+        while (! m_workers.empty()) {
+            for (auto other : m_workers.begin()->second->others) {
+                delete other;
+            }
+            delete m_workers.begin()->second;
+            m_workers.erase(m_workers.begin());
+        }
+    }
+
+
+    template<class Observer>
+    void BasicBroker<Observer>::add_socket(zmq::socket_t& sock)
+    {
+        // Tag 255 is kept for in-process workers.
+        if (m_frontends.size() >= 255) {
+            throw std::runtime_error("generaldomo::Broker has too many sockets");
+        }
+        Frontend fe{&sock};
+        int stype = sock.getsockopt<int>(ZMQ_TYPE);
+        if (ZMQ_SERVER == stype) {
+            fe.recv = recv_server;
+            fe.send = send_server;
+            m_log.info("generaldomo broker with SERVER starting");
+        }
+        else if(ZMQ_ROUTER == stype) {
+            fe.recv = recv_router;
+            fe.send = send_router;
+            m_log.info("generaldomo broker with ROUTER starting");
+        }
+        else {
+            throw std::runtime_error("generaldomo::Broker requires SERVER or ROUTER socket");
+        }
+        m_frontends.push_back(fe);
+    }
+
+    template<class Observer>
+    size_t BasicBroker<Observer>::add_outlet(outlet_t outlet)
+    {
+        if (m_frontends.size() >= 255) {
+            throw std::runtime_error("generaldomo::Broker has too many sockets");
+        }
+        m_frontends.push_back(Frontend{nullptr, outlet});
+        return m_frontends.size() - 1;
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::inject(size_t frontend, remote_identity_t sender,
+                                       zmq::multipart_t& mmsg)
+    {
+        if (frontend >= m_frontends.size() or m_frontends[frontend].sock) {
+            throw std::runtime_error("generaldomo::Broker inject needs an outlet");
+        }
+        sender.insert(sender.begin(), static_cast<char>(frontend));
+        m_observer.begin();
+        proc_message(sender, mmsg);
+        m_observer.end();
+        local_replies();
+    }
+
+    template<class Observer>
+    bool BasicBroker<Observer>::readable(size_t index) const
+    {
+        if (!m_frontends[index].sock) {
+            return false;
+        }
+        // A whole message is ready if any, so receiving won't block.
+        int events = m_frontends[index].sock->template getsockopt<int>(ZMQ_EVENTS);
+        return events & ZMQ_POLLIN;
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::send(zmq::multipart_t& mmsg, const remote_identity_t& rid)
+    {
+        m_observer.mark(phase_t::dispatch);
+        const Frontend& fe = m_frontends.at(static_cast<unsigned char>(rid[0]));
+        if (fe.sock) {
+            fe.send(*fe.sock, mmsg, rid.substr(1));
+        }
+        else {
+            fe.outlet(rid.substr(1), mmsg);
+        }
+        m_observer.mark(phase_t::send);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::proc_one()
+    {
+        while (true) {
+            for (size_t count=0; count < m_frontends.size(); ++count) {
+                size_t index = m_next_frontend;
+                m_next_frontend = (index + 1) % m_frontends.size();
+                if (readable(index)) {
+                    proc_frontend(index);
+                    local_replies();
+                    return;
+                }
+            }
+            auto items = pollitems();
+            zmq::poll(items, time_unit_t{-1});
+            if (m_done and items.back().revents & ZMQ_POLLIN) {
+                tick();
+                local_replies();
+                return;
+            }
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::proc_frontend(size_t index)
+    {
+        const Frontend& fe = m_frontends[index];
+        m_observer.begin();
+        zmq::multipart_t mmsg;
+        remote_identity_t sender = fe.recv(*fe.sock, mmsg);
+        sender.insert(sender.begin(), static_cast<char>(index));
+        proc_message(sender, mmsg);
+        m_observer.end();
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::proc_message(remote_identity_t sender, zmq::multipart_t& mmsg)
+    {
+        tick();
+        std::string header = mmsg.popstr(); // 7/MDP frame 1
+        if (header == mdp::client::ident) {
+            m_log.debug("generaldomo broker process client");
+            client_process(sender, mmsg, false);
+        }
+        else if (header == gdp::client::ident) {
+            m_log.debug("generaldomo broker process extended client");
+            client_process(sender, mmsg, true);
+        }
+        else if (header == mdp::worker::ident) {
+            m_log.debug("generaldomo broker process worker");
+            worker_process(sender, mmsg);
+        }
+        else {
+            m_log.error("generaldomo broker invalid message from " + sender);
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::proc_heartbeat(time_unit_t heartbeat_at)
+    {
+        tick();
+        auto now = m_now;
+        if (now < heartbeat_at) {
+            return;
+        }
+        purge_workers();
+        purge_requests();
+        // Requests of dead workers may wait with idle workers.
+        for (auto& [name, srv] : m_services) {
+            if (srv->requests.size() and srv->waiting.size()) {
+                service_dispatch(srv);
+            }
+        }
+        for (auto& wrk : m_waiting) {
+            if (wrk->local or wrk->primary) {
+                continue;
+            }
+            m_log.debug("generaldomo broker heartbeat to worker");
+            zmq::multipart_t mmsg;
+            mmsg.pushstr(mdp::worker::heartbeat);
+            mmsg.pushstr(mdp::worker::ident);
+            send(mmsg, wrk->identity);
+        }
+        // Busy workers which heartbeat find them waiting after a reply.
+        // One offering several services is heartbeated once, always.
+        for (auto& wrk : m_busy) {
+            if (wrk->local or wrk->primary
+                or (!wrk->busy_expiry.count() and wrk->others.empty())) {
+                continue;
+            }
+            zmq::multipart_t mmsg;
+            mmsg.pushstr(mdp::worker::heartbeat);
+            mmsg.pushstr(mdp::worker::ident);
+            send(mmsg, wrk->identity);
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::start(const std::vector<zmq::pollitem_t>& extra)
+    {
+        if (m_cpus.size()) {
+            pin_thread(m_cpus);
+        }
+        auto items = pollitems();
+        const size_t nmine = items.size();
+        items.insert(items.end(), extra.begin(), extra.end());
+        auto extra_input = [&]() {
+            for (size_t ind=nmine; ind<items.size(); ++ind) {
+                if (items[ind].revents & ZMQ_POLLIN) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        // When spinning, extra items are checked now and then as that
+        // costs a system call.
+        const size_t check_every = 1024;
+        size_t nspins = 0;
+        auto active = std::chrono::steady_clock::now();
+        while (! interrupted()) {
+            if (m_busy_poll.count()) {
+                if (extra.size() and ++nspins % check_every == 0) {
+                    zmq::poll(items.data() + nmine, extra.size(), time_unit_t{0});
+                    if (extra_input()) {
+                        return;
+                    }
+                }
+                auto now = std::chrono::steady_clock::now();
+                if (process_ready()) {
+                    active = now;
+                    continue;
+                }
+                if (now - active < m_busy_poll) {
+                    continue;
+                }
+            }
+            zmq::poll(items, next_timeout());
+            if (extra_input()) {
+                return;
+            }
+            process_ready();
+            active = std::chrono::steady_clock::now();
+        }
+    }
+
+    template<class Observer>
+    int BasicBroker<Observer>::fd() const
+    {
+        return m_frontends.front().sock->template getsockopt<int>(ZMQ_FD);
+    }
+
+    template<class Observer>
+    std::vector<int> BasicBroker<Observer>::fds() const
+    {
+        std::vector<int> ret;
+        for (const auto& fe : m_frontends) {
+            if (fe.sock) {
+                ret.push_back(fe.sock->template getsockopt<int>(ZMQ_FD));
+            }
+        }
+        if (m_done) {
+            ret.push_back(m_done->fd());
+        }
+        return ret;
+    }
+
+    template<class Observer>
+    std::vector<zmq::pollitem_t> BasicBroker<Observer>::pollitems() const
+    {
+        std::vector<zmq::pollitem_t> items;
+        for (const auto& fe : m_frontends) {
+            if (fe.sock) {
+                items.push_back(zmq::pollitem_t{fe.sock->handle(), 0, ZMQ_POLLIN, 0});
+            }
+        }
+        if (m_done) {
+            items.push_back(zmq::pollitem_t{nullptr, m_done->fd(), ZMQ_POLLIN, 0});
+        }
+        return items;
+    }
+
+    template<class Observer>
+    size_t BasicBroker<Observer>::process_ready(size_t budget)
+    {
+        // Heartbeat first as sending may hide input from the fd.
+        tick();
+        if (m_now >= m_heartbeat_at) {
+            proc_heartbeat(m_heartbeat_at);
+            m_heartbeat_at = m_now + m_hb_interval;
+        }
+        fanout_expire();
+        local_replies();
+        // Take turns over the sockets until none has input.
+        size_t nproc = 0, nidle = 0;
+        while (nproc < budget and nidle < m_frontends.size()) {
+            size_t index = m_next_frontend;
+            m_next_frontend = (index + 1) % m_frontends.size();
+            if (readable(index)) {
+                proc_frontend(index);
+                local_replies();
+                ++nproc;
+                nidle = 0;
+            }
+            else {
+                ++nidle;
+            }
+        }
+        return nproc;
+    }
+
+    template<class Observer>
+    time_unit_t BasicBroker<Observer>::next_timeout() const
+    {
+        auto now = mono_ms();
+        auto next = m_heartbeat_at;
+        for (const auto& fan : m_fanouts) {
+            next = std::min(next, fan->wait_until);
+        }
+        if (next > now) {
+            return next - now;
+        }
+        return time_unit_t{0};
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::purge_workers()
+    {
+        auto now = m_now;
+        // can't remove from the set while iterating, so make a temp
+        std::vector<Worker*> dead;
+        // Proxies for further services go with the first.
+        for (auto wrk : m_waiting) {
+            if (!wrk->local and !wrk->primary and wrk->expiry <= now) {
+                dead.push_back(wrk); 
+            }
+        }
+        for (auto wrk : m_busy) {
+            if (wrk->local or wrk->primary) {
+                continue;
+            }
+            time_unit_t limit = wrk->busy_expiry;
+            if (!limit.count()) {
+                limit = wrk->service->options.busy_expiry;
+            }
+            // A handler may work for as long as it likes.
+            if (limit.count() and wrk->heard + limit <= now) {
+                dead.push_back(wrk);
+            }
+        }
+        for (auto wrk : dead) {
+            m_log.debug("generaldomo broker deleting expired worker: " + wrk->identity);
+            if constexpr (observed) {
+                m_observer.on_expire(wrk->service ? wrk->service->name : "", wrk->identity);
+            }
+            worker_delete(wrk,0);   // operates on m_waiting set
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::purge_requests()
+    {
+        // Requests are otherwise only checked as they reach a worker.
+        auto now = m_now;
+        for (auto& [name, srv] : m_services) {
+            auto req_it = srv->requests.begin();
+            while (req_it != srv->requests.end()) {
+                if (request_expired(srv, *req_it, now)) {
+                    req_it = request_drop(srv, req_it);
+                    ++srv->expired;
+                }
+                else {
+                    ++req_it;
+                }
+            }
+        }
+        // A worker waits on the chunks of a client which went away.
+        std::vector<std::shared_ptr<Transfer>> idle;
+        for (auto& [key, xfer] : m_transfers) {
+            const bool owed = xfer->next < xfer->window + xfer->credits;
+            if (xfer->worker and owed and !xfer->last and !xfer->failed
+                and now - xfer->heard >= m_hb_expiry) {
+                idle.push_back(xfer);
+            }
+        }
+        for (auto& xfer : idle) {
+            m_log.debug("generaldomo broker transfer idle from: " + xfer->client);
+            transfer_fail(*xfer, "idle");
+        }
+    }
+
+    template<class Observer>
+    typename BasicBroker<Observer>::Service*
+    BasicBroker<Observer>::service_require(std::string name)
+    {
+        Service* srv = m_services[name];
+        if (!srv) {
+            srv = new Service{name};
+            srv->dispatch = dispatch_make(srv->options.dispatch);
+            m_services[name] = srv;
+            m_log.debug("generaldomo broker registering new service: " + name);
+        }
+        return srv;
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::configure(std::string service, const service_options_t& opts)
+    {
+        auto dispatch = dispatch_make(opts.dispatch);
+        if (!dispatch) {
+            throw std::runtime_error("generaldomo broker unknown dispatch policy: "
+                                     + opts.dispatch);
+        }
+        Service* srv = service_require(service);
+        srv->dispatch = std::move(dispatch);
+        srv->options = opts;
+        srv->cache.limit(opts.cache_ttl, opts.cache_bytes);
+        if (!opts.idempotent) {
+            srv->cache.invalidate();
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::set_heartbeat(time_unit_t interval, int liveness)
+    {
+        if (interval.count() <= 0 or liveness <= 0) {
+            throw std::runtime_error("generaldomo broker heartbeat must be positive");
+        }
+        m_hb_interval = interval;
+        m_hb_liveness = liveness;
+        m_hb_expiry = interval * liveness;
+        m_heartbeat_at = std::min(m_heartbeat_at, mono_ms() + interval);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::add_handler(std::string service, handler_t handler, size_t nthreads)
+    {
+        if (detail::is_internal(service)) {
+            throw std::runtime_error("generaldomo broker can not handle " + service);
+        }
+        if (nthreads and !m_done) {
+            m_done = std::make_unique<WakeQueue<LocalReply>>();
+        }
+        m_locals.push_back(std::make_unique<Local>());
+        Local* local = m_locals.back().get();
+        local->handler = handler;
+        if (nthreads) {
+            local->pool = std::make_unique<WorkPool<LocalReply>>(
+                nthreads, [this, local](LocalReply& job) {
+                    job = local_call(local, job.worker, job.body);
+                }, *m_done);
+        }
+
+        // The tag is past any socket so nothing is ever sent.
+        Service* srv = service_require(service);
+        const size_t nworkers = std::max<size_t>(1, nthreads);
+        for (size_t ind=0; ind<nworkers; ++ind) {
+            remote_identity_t identity = std::string(1, '\xff') + "local/"
+                + service + "/" + std::to_string(m_locals.size())
+                + "/" + std::to_string(ind);
+            Worker* wrk = worker_require(identity);
+            wrk->local = local;
+            wrk->service = srv;
+            srv->nworkers++;
+            worker_waiting(wrk);
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::local_dispatch(Worker* wrk, zmq::multipart_t& body)
+    {
+        Local* local = wrk->local;
+        if (!local->pool) {
+            // Replies are taken later so as not to recurse in dispatch.
+            m_inline.push_back(local_call(local, wrk, body));
+            return;
+        }
+        local->pool->push(LocalReply{wrk, std::move(body)});
+    }
+
+    // The failure of a handler is kept with its reply to be logged and
+    // told to the client by the broker thread, the log not being ours to
+    // use from a pool thread.
+    template<class Observer>
+    typename BasicBroker<Observer>::LocalReply
+    BasicBroker<Observer>::local_call(Local* local, Worker* wrk, zmq::multipart_t& body)
+    {
+        LocalReply done{wrk};
+        try {
+            done.body = local->handler(body);
+        }
+        catch (const std::exception& err) {
+            done.body.clear();
+            done.error = err.what();
+            done.failed = true;
+        }
+        catch (...) {
+            done.body.clear();
+            done.error = "unknown exception";
+            done.failed = true;
+        }
+        return done;
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::local_replies()
+    {
+        // Replying may dispatch to an inline handler.
+        while (true) {
+            std::deque<LocalReply> done;
+            done.swap(m_inline);
+            if (m_done) {
+                for (auto& one : m_done->take()) {
+                    done.push_back(std::move(one));
+                }
+            }
+            if (done.empty()) {
+                return;
+            }
+            for (auto& one : done) {
+                properties_t props;
+                if (one.failed) {
+                    m_log.error("generaldomo broker handler of "
+                                + one.worker->service->name + " failed: " + one.error);
+                    props[gdp::prop::error] = "handler";
+                }
+                worker_reply(one.worker, props, one.body);
+            }
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::add_dispatch(std::string name, dispatch_factory_t factory)
+    {
+        m_dispatch[name] = factory;
+    }
+
+    template<class Observer>
+    std::unique_ptr<DispatchPolicy> BasicBroker<Observer>::dispatch_make(const std::string& name)
+    {
+        auto it = m_dispatch.find(name);
+        if (it != m_dispatch.end()) {
+            return it->second();
+        }
+        return make_dispatch(name);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::service_internal(const Request& req, std::string service_name, zmq::multipart_t& mmsg)
+    {
+        zmq::multipart_t response;
+
+        if (service_name == "mmi.service") {
+            std::string sn = mmsg.popstr();
+            auto sit = m_services.find(sn);
+            if (sit != m_services.end() and sit->second->nworkers) {
+                response.addstr("200");
+            }
+            else {
+                response.addstr("404");
+            }
+        }
+        else if (service_name == "mmi.cache") {
+            // (invalidate|stats, service)
+            std::string cmd = mmsg.popstr();
+            std::string sn = mmsg.popstr();
+            auto sit = m_services.find(sn);
+            if (sit == m_services.end()) {
+                response.addstr("404");
+            }
+            else if (cmd == "invalidate") {
+                sit->second->cache.invalidate();
+                response.addstr("200");
+            }
+            else if (cmd == "stats") {
+                const ReplyCache& cache = sit->second->cache;
+                response.addstr("200");
+                response.addstr(std::to_string(cache.stats().hits));
+                response.addstr(std::to_string(cache.stats().misses));
+                response.addstr(std::to_string(cache.size()));
+                response.addstr(std::to_string(cache.bytes()));
+            }
+            else {
+                response.addstr("400");
+            }
+        }
+        else if (service_name == "mmi.stats") {
+            // (service) replies with name and value pairs
+            std::string sn = mmsg.popstr();
+            auto sit = m_services.find(sn);
+            if (sit == m_services.end()) {
+                response.addstr("404");
+            }
+            else {
+                const Service* srv = sit->second;
+                response.addstr("200");
+                for (auto [name, value] : {
+                        std::make_pair("workers", srv->nworkers),
+                        std::make_pair("waiting", srv->waiting.size()),
+                        std::make_pair("requests", srv->requests.size()),
+                        std::make_pair("expired", srv->expired),
+                        std::make_pair("rejected", srv->rejected),
+                        std::make_pair("requeued", srv->requeued),
+                        std::make_pair("quarantined", srv->quarantined),
+                        std::make_pair("resident_bytes", m_resident),
+                        std::make_pair("spilled_bytes", m_spilled)}) {
+                    response.addstr(name);
+                    response.addstr(std::to_string(value));
+                }
+            }
+        }
+        else if (service_name == "mmi.config") {
+            // (service, [name, value]...) sets service options and
+            // replies with them all as name and value pairs.  An empty
+            // service name addresses the broker itself.
+            std::string sn = mmsg.popstr();
+            properties_t settings;
+            while (mmsg.size() >= 2) {
+                std::string name = mmsg.popstr();
+                settings[name] = mmsg.popstr();
+            }
+            try {
+                response = config_internal(sn, settings);
+            }
+            catch (const std::runtime_error& err) {
+                m_log.error(err.what());
+                response.clear();
+                response.addstr("400");
+                response.addstr(err.what());
+            }
+        }
+        else if (service_name == "mmi.quarantine") {
+            // (service) replies with quarantined requests, each encoded
+            // as one frame, and forgets them
+            std::string sn = mmsg.popstr();
+            auto sit = m_services.find(sn);
+            if (sit == m_services.end()) {
+                response.addstr("404");
+            }
+            else {
+                response.addstr("200");
+                for (auto& one : sit->second->quarantine) {
+                    response.add(one.body.encode());
+                }
+                sit->second->quarantine.clear();
+            }
+        }
+        else if (service_name == "mmi.cancel") {
+            // (service, id) of a request by the same client
+            std::string sn = mmsg.popstr();
+            std::string id = mmsg.popstr();
+            auto sit = m_services.find(sn);
+            if (sit != m_services.end() and request_cancel(sit->second, req.client, id)) {
+                response.addstr("200");
+            }
+            else {
+                response.addstr("404");
+            }
+        }
+        else {
+            response.addstr("501");
+        }
+
+        properties_t props;
+        client_reply(req.client, req.extended, detail::request_id(req.props),
+                     service_name, props, response);
+    }
+
+    template<class Observer>
+    zmq::multipart_t BasicBroker<Observer>::config_internal(const std::string& service_name,
+                                                            const properties_t& settings)
+    {
+        properties_t current;
+        if (service_name.empty()) {
+            broker_config_t config;
+            config.heartbeat = m_hb_interval;
+            config.liveness = m_hb_liveness;
+            config.memory_budget = m_memory_budget;
+            load_config(config, settings);
+            set_heartbeat(config.heartbeat, config.liveness);
+            set_memory_budget(config.memory_budget);
+            current["heartbeat"] = std::to_string(m_hb_interval.count());
+            current["liveness"] = std::to_string(m_hb_liveness);
+            current["memory_budget"] = std::to_string(m_memory_budget);
+        }
+        else {
+            auto sit = m_services.find(service_name);
+            service_options_t opts;
+            if (sit != m_services.end()) {
+                opts = sit->second->options;
+            }
+            for (const auto& [name, value] : settings) {
+                if (!set_option(opts, name, value)) {
+                    throw std::runtime_error("generaldomo broker unknown option: " + name);
+                }
+            }
+            if (settings.size()) {
+                m_log.info("generaldomo broker reconfigure service: " + service_name);
+                configure(service_name, opts);
+            }
+            current = get_options(opts);
+        }
+        zmq::multipart_t response;
+        response.addstr("200");
+        for (const auto& [name, value] : current) {
+            response.addstr(name);
+            response.addstr(value);
+        }
+        return response;
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::service_dispatch(Service* srv)
+    {
+        purge_workers();
+        const time_unit_t now = m_now;
+        std::vector<typename std::list<Worker*>::iterator> candidates;
+        std::vector<const worker_info_t*> infos;
+        auto req_it = srv->requests.begin();
+        while (srv->waiting.size() and req_it != srv->requests.end()) {
+
+            // Work for a client which gave up would be wasted.
+            if (request_expired(srv, *req_it, now)) {
+                m_log.debug("generaldomo broker drop expired request for " + srv->name);
+                req_it = request_drop(srv, req_it);
+                ++srv->expired;
+                continue;
+            }
+
+            // Spread a batch over the idle workers which may take part.
+            if (req_it->batch > 1) {
+                size_t nbatch=0, nsingle=0;
+                for (auto wrk : srv->waiting) {
+                    if (wrk->batch) {
+                        nbatch += wrk->accepts(*req_it);
+                    }
+                    else if (!req_it->coded()) {
+                        ++nsingle;
+                    }
+                }
+                const size_t most = srv->options.max_batch;
+                if (nbatch + nsingle > 1 or (nsingle and !nbatch)
+                    or (most and nbatch and req_it->batch > most)) {
+                    if (!request_restore(srv, *req_it)) {
+                        req_it = request_drop(srv, req_it);
+                        continue;
+                    }
+                    req_it = service_split(srv, req_it, nbatch, nsingle);
+                }
+            }
+
+            // A request with a coded body may only go to a worker which
+            // can decode it.  The policy chooses among the rest.
+            candidates.clear();
+            infos.clear();
+            for (auto next = srv->waiting.begin(); next != srv->waiting.end(); ++next) {
+                if ((*next)->accepts(*req_it)) {
+                    candidates.push_back(next);
+                    infos.push_back(&(*next)->info);
+                }
+            }
+            if (candidates.empty()) {
+                // None of the workers left may ever decode it.
+                auto cit = req_it->props.find(gdp::prop::codec);
+                if (cit != req_it->props.end() and !srv->codecs[cit->second]) {
+                    m_log.error("generaldomo broker no worker decodes " + cit->second
+                                + " for " + srv->name);
+                    request_fail(srv, *req_it, "codec");
+                    req_it = request_drop(srv, req_it);
+                    continue;
+                }
+                ++req_it;
+                continue;
+            }
+            auto wrk_it = candidates[srv->dispatch->choose(infos)];
+
+            Worker* wrk = *wrk_it;
+            Request& req = *req_it;
+            if (!request_restore(srv, req)) {
+                req_it = request_drop(srv, req_it);
+                continue;
+            }
+            queue_remove(req);
+            // The worker may die so keep the request whole.  The kept
+            // body shares data with the one sent.
+            zmq::multipart_t kept = share_frames(req.body);
+            zmq::multipart_t mmsg = std::move(req.body);
+            properties_t props_sent;
+            const properties_t* props = &req.props;
+            if (req.batch and !wrk->batch) {
+                // Plain worker gets the lone request as its body.  We
+                // leave off "accept" as a coded reply can not be packed.
+                zmq::multipart_t one;
+                one.decode(mmsg.pop());
+                mmsg = std::move(one);
+                props_sent = req.props;
+                props_sent.erase(gdp::prop::batch);
+                props_sent.erase(gdp::prop::accept);
+                props = &props_sent;
+                req.unpacked = true;
+            }
+            req.body = std::move(kept);
+            worker_give(wrk, req, *props, mmsg);
+            req_it = srv->requests.erase(req_it);
+            srv->waiting.erase(wrk_it);
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::worker_give(Worker* wrk, Request& req, const properties_t& props,
+                                            zmq::multipart_t& mmsg)
+    {
+        wrk->dispatched = std::chrono::steady_clock::now();
+        if (wrk->local) {
+            local_dispatch(wrk, mmsg);
+        }
+        else {
+            worker_request(wrk, req.client, props, mmsg);
+        }
+        if constexpr (observed) {
+            m_observer.on_dispatch(wrk->service->name, wrk->identity);
+        }
+        ++req.attempts;
+        wrk->inflight = std::move(req);
+        wrk->busy = true;
+        m_waiting.erase(wrk);
+        m_busy.insert(wrk);
+        if (wrk->inflight.transfer) {
+            transfer_bind(*wrk->inflight.transfer, wrk);
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::worker_request(Worker* wrk, const remote_identity_t& client,
+                                               const properties_t& props,
+                                               zmq::multipart_t& mmsg)
+    {
+        if (wrk->primary or wrk->others.size()) {
+            properties_t named = props;
+            named[gdp::prop::service] = wrk->service->name;
+            mmsg.push(encode_properties(named)); // frame 4
+        }
+        else if (wrk->extended) {
+            mmsg.push(encode_properties(props)); // frame 4
+        }
+        else {
+            mmsg.pushmem(NULL,0);           // frame 4
+        }
+        mmsg.pushstr(client);               // frame 3
+        mmsg.pushstr(mdp::worker::request); // frame 2
+        mmsg.pushstr(mdp::worker::ident);   // frame 1
+        m_log.debug("generaldomo broker send work");
+        send(mmsg, wrk->identity);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::request_broadcast(Service* srv, Request& req)
+    {
+        auto fan = std::make_shared<Fanout>();
+        fan->client = req.client;
+        fan->extended = req.extended;
+        fan->service = srv->name;
+        fan->id = detail::request_id(req.props);
+        fan->quorum = std::strtoul(req.props[gdp::prop::broadcast].c_str(), nullptr, 10);
+        auto wit = req.props.find(gdp::prop::wait);
+        if (wit != req.props.end()) {
+            fan->wait_until = m_now + time_unit_t{std::strtoll(wit->second.c_str(), nullptr, 10)};
+        }
+        else if (req.deadline.count()) {
+            fan->wait_until = req.deadline;
+        }
+        else {
+            // A busy target which is stuck would otherwise hold the
+            // reply for ever.
+            fan->wait_until = m_now + m_hb_expiry;
+        }
+
+        // Idle workers first, then busy ones which get their copy once
+        // idle.  As in service_dispatch(), a worker which can not take
+        // the request, eg for its codec, is left out.
+        std::vector<Worker*> targets;
+        for (auto wrk : srv->waiting) {
+            if (wrk->accepts(req)) {
+                targets.push_back(wrk);
+            }
+        }
+        for (auto wrk : m_busy) {
+            if (wrk->service == srv and wrk->accepts(req)) {
+                targets.push_back(wrk);
+            }
+        }
+        if (fan->quorum and fan->quorum < targets.size()) {
+            targets.resize(fan->quorum);
+        }
+        fan->remaining = targets.size();
+        if (targets.empty()) {
+            fanout_finish(*fan);
+            return;
+        }
+        m_fanouts.push_back(fan);
+        m_log.debug("generaldomo broker broadcast to " + std::to_string(targets.size())
+                    + " of " + srv->name);
+
+        // Copies share the body data.  A reply in a batch can not be
+        // told apart if coded so none is offered.
+        properties_t props = req.props;
+        props.erase(gdp::prop::broadcast);
+        props.erase(gdp::prop::wait);
+        props.erase(gdp::prop::accept);
+        for (auto wrk : targets) {
+            Request copy{req.client, req.extended, props};
+            copy.body = share_frames(req.body);
+            copy.fanout = fan;
+            if (wrk->busy) {
+                wrk->targeted.emplace_back(std::move(copy));
+                continue;
+            }
+            srv->waiting.remove(wrk);
+            zmq::multipart_t mmsg = share_frames(copy.body);
+            worker_give(wrk, copy, props, mmsg);
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::fanout_reply(Fanout& fan, zmq::multipart_t* mmsg)
+    {
+        if (fan.done) {
+            return;
+        }
+        if (mmsg) {
+            fan.replies.push_back(mmsg->encode());
+        }
+        if (--fan.remaining == 0) {
+            fanout_finish(fan);
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::fanout_finish(Fanout& fan)
+    {
+        fan.done = true;
+        properties_t props;
+        props[gdp::prop::broadcast] = std::to_string(fan.replies.size());
+        zmq::multipart_t body;
+        if (fan.quorum and fan.replies.size() < fan.quorum) {
+            props[gdp::prop::error] = "quorum";
+        }
+        else {
+            for (auto& one : fan.replies) {
+                body.add(std::move(one));
+            }
+        }
+        fan.replies.clear();
+        client_reply(fan.client, fan.extended, fan.id, fan.service, props, body);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::fanout_expire()
+    {
+        auto it = m_fanouts.begin();
+        while (it != m_fanouts.end()) {
+            Fanout& fan = **it;
+            if (!fan.done and fan.wait_until <= m_now) {
+                m_log.debug("generaldomo broker broadcast wait over for " + fan.service);
+                fanout_finish(fan);
+            }
+            if (fan.done) {
+                it = m_fanouts.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::request_transfer(Service* srv, Request& req)
+    {
+        const std::string id = req.props[gdp::prop::transfer];
+        const std::string key = req.client + '\0' + id;
+        const size_t chunk = std::strtoul(req.props[gdp::prop::chunk].c_str(), nullptr, 10);
+        const bool last = req.props.count(gdp::prop::last) > 0;
+
+        auto tit = m_transfers.find(key);
+        if (tit == m_transfers.end()) {
+            if (chunk != 0) {
+                // Eg the rest of a transfer which failed.
+                m_log.debug("generaldomo broker drop chunk of unknown transfer from: " + req.client);
+                return;
+            }
+            if (srv->options.max_requests
+                and srv->requests.size() >= srv->options.max_requests) {
+                ++srv->rejected;
+                if constexpr (observed) {
+                    m_observer.on_reject(srv->name, "overload");
+                }
+                properties_t props;
+                props[gdp::prop::error] = "overload";
+                props[gdp::prop::transfer] = id;
+                zmq::multipart_t none;
+                client_reply(req.client, req.extended, detail::request_id(req.props),
+                             srv->name, props, none);
+                return;
+            }
+            // The first chunk is dispatched as any request.
+            auto xfer = std::make_shared<Transfer>();
+            xfer->client = req.client;
+            xfer->service = srv->name;
+            xfer->id = id;
+            xfer->key = key;
+            auto wit = req.props.find(gdp::prop::window);
+            if (wit != req.props.end()) {
+                xfer->window = std::max<size_t>(1, std::strtoul(wit->second.c_str(), nullptr, 10));
+            }
+            xfer->last = last;
+            m_transfers[key] = xfer;
+            req.transfer = xfer;
+            queue_add(req);
+            srv->requests.emplace_back(std::move(req));
+            if constexpr (observed) {
+                m_observer.on_enqueue(srv->name, srv->requests.size());
+            }
+            service_dispatch(srv);
+            queue_budget(srv);
+            return;
+        }
+
+        Transfer& xfer = *tit->second;
+        if (xfer.failed) {
+            return;
+        }
+        if (chunk != xfer.next or xfer.last) {
+            m_log.error("generaldomo broker protocol error (bad chunk) from: " + req.client);
+            transfer_fail(xfer, "transfer");
+            return;
+        }
+        // No more than the window plus the credit the worker gave,
+        // whether held with the queued first chunk or in flight.
+        if (chunk >= xfer.window + xfer.credits) {
+            m_log.error("generaldomo broker protocol error (window) from: " + req.client);
+            transfer_fail(xfer, "window");
+            return;
+        }
+        ++xfer.next;
+        xfer.last = last;
+        xfer.heard = m_now;
+        if (xfer.worker) {
+            worker_request(xfer.worker, xfer.client, req.props, req.body);
+            return;
+        }
+        xfer.held.emplace_back(std::move(req));
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::transfer_bind(Transfer& xfer, Worker* wrk)
+    {
+        xfer.worker = wrk;
+        xfer.heard = m_now;
+        for (auto& chunk : xfer.held) {
+            worker_request(wrk, xfer.client, chunk.props, chunk.body);
+        }
+        xfer.held.clear();
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::transfer_credit(Transfer& xfer, properties_t& props)
+    {
+        if (xfer.failed) {
+            return;
+        }
+        xfer.heard = m_now;
+        xfer.credits += std::strtoul(props[gdp::prop::credit].c_str(), nullptr, 10);
+        properties_t credit;
+        credit[gdp::prop::transfer] = xfer.id;
+        credit[gdp::prop::credit] = props[gdp::prop::credit];
+        zmq::multipart_t none;
+        client_reply(xfer.client, true, "", xfer.service, credit, none);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::transfer_fail(Transfer& xfer, const std::string& why)
+    {
+        if (!xfer.failed) {
+            xfer.failed = true;
+            properties_t props;
+            props[gdp::prop::error] = why;
+            props[gdp::prop::transfer] = xfer.id;
+            zmq::multipart_t none;
+            client_reply(xfer.client, true, "", xfer.service, props, none);
+        }
+        if (xfer.worker) {
+            // End the worker's stream.  The transfer is kept until its
+            // reply, which is dropped.
+            properties_t props;
+            props[gdp::prop::transfer] = xfer.id;
+            props[gdp::prop::chunk] = std::to_string(xfer.next);
+            props[gdp::prop::last] = "1";
+            props[gdp::prop::error] = why;
+            zmq::multipart_t none;
+            worker_request(xfer.worker, xfer.client, props, none);
+            return;
+        }
+        // The first chunk may yet be queued.
+        const std::string key = xfer.key;
+        auto sit = m_services.find(xfer.service);
+        if (sit != m_services.end() and sit->second) {
+            Service* srv = sit->second;
+            for (auto it = srv->requests.begin(); it != srv->requests.end(); ++it) {
+                if (it->transfer.get() == &xfer) {
+                    request_drop(srv, it);
+                    break;
+                }
+            }
+        }
+        m_transfers.erase(key);
+    }
+
+    template<class Observer>
+    typename std::deque<typename BasicBroker<Observer>::Request>::iterator
+    BasicBroker<Observer>::service_split(Service* srv,
+                                         typename std::deque<Request>::iterator req_it,
+                                         size_t nbatch, size_t nsingle)
+    {
+        request_load(*req_it);
+        queue_remove(*req_it);
+        Request req = std::move(*req_it);
+        req_it = srv->requests.erase(req_it);
+
+        // Plan the slice sizes.  Batch workers share, up to max_batch
+        // each, what single ones do not take.  The rest waits as one
+        // slice.
+        const size_t nreqs = req.batch;
+        const size_t most = srv->options.max_batch;
+        nsingle = std::min(nsingle, nreqs);
+        std::vector<size_t> sizes;
+        size_t rest = nreqs - nsingle;
+        if (nbatch) {
+            nbatch = std::min(nbatch, rest);
+            size_t given = 0;
+            for (size_t ind=0; ind<nbatch; ++ind) {
+                size_t size = rest/nbatch + (ind < rest%nbatch ? 1 : 0);
+                if (most) {
+                    size = std::min(size, most);
+                }
+                sizes.push_back(size);
+                given += size;
+            }
+            rest -= given;
+        }
+        sizes.insert(sizes.end(), nsingle, 1);
+        if (rest) {
+            sizes.push_back(rest);
+        }
+
+        if (!req.gather) {
+            req.gather = std::make_shared<Gather>();
+            req.gather->client = req.client;
+            req.gather->service = srv->name;
+            req.gather->replies.resize(nreqs);
+            req.gather->coded.assign(nreqs, '0');
+            req.gather->remaining = nreqs;
+            req.gather->cacheable = req.cacheable;
+            req.gather->key = req.key;
+            if (req.cacheable) {
+                req.gather->request = detail::request_frames(req.props, req.body);
+            }
+            req.gather->leader = req.leader;
+            req.gather->id = detail::request_id(req.props);
+            if (req.props.count(gdp::prop::pipeline)) {
+                req.gather->pipeline = req.props;
+            }
+            // All slices must offer workers the same reply codec.
+            auto accept = split_list(req.props[gdp::prop::accept]);
+            if (accept.size()) {
+                req.gather->codec = accept.front();
+            }
+        }
+        const std::string coded = req.props[gdp::prop::coded];
+
+        std::vector<Request> slices;
+        size_t offset = 0;
+        for (size_t size : sizes) {
+            Request slice{req.client, req.extended, req.props};
+            slice.deadline = req.deadline;
+            slice.batch = size;
+            slice.gather = req.gather;
+            slice.offset = req.offset + offset;
+            slice.props[gdp::prop::batch] = std::to_string(size);
+            if (req.gather->codec.empty()) {
+                slice.props.erase(gdp::prop::accept);
+            }
+            else {
+                slice.props[gdp::prop::accept] = req.gather->codec;
+            }
+            std::string slice_coded = coded.substr(std::min(offset, coded.size()), size);
+            if (slice_coded.find('1') == std::string::npos) {
+                slice.props.erase(gdp::prop::codec);
+                slice.props.erase(gdp::prop::coded);
+            }
+            else {
+                slice.props[gdp::prop::coded] = slice_coded;
+            }
+            for (size_t ind=0; ind<size; ++ind) {
+                slice.body.add(req.body.pop());
+            }
+            offset += size;
+            queue_add(slice);
+            slices.emplace_back(std::move(slice));
+        }
+        m_log.debug("generaldomo broker split batch of " + std::to_string(nreqs)
+                    + " into " + std::to_string(slices.size()));
+
+        size_t pos = req_it - srv->requests.begin();
+        srv->requests.insert(req_it, std::make_move_iterator(slices.begin()),
+                             std::make_move_iterator(slices.end()));
+        return srv->requests.begin() + pos;
+    }
+
+
+    template<class Observer>
+    typename BasicBroker<Observer>::Worker*
+    BasicBroker<Observer>::worker_require(remote_identity_t identity)
+    {
+        Worker* wrk = m_workers[identity];
+        if (!wrk) {
+            wrk = new Worker{identity};
+            m_workers[identity] = wrk;
+            m_log.debug("generaldomo broker registering new worker");
+        }
+        return wrk;
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::worker_delete(Worker*& wrk, int disconnect)
+    {
+        for (auto other : wrk->others) {
+            worker_delete(other, 0);
+        }
+        if (disconnect) {
+            zmq::multipart_t mmsg;
+            mmsg.pushstr(mdp::worker::disconnect);
+            mmsg.pushstr(mdp::worker::ident);
+            m_log.debug("generaldomo broker disconnect worker");
+            send(mmsg, wrk->identity);
+        }
+        if (wrk->service) {
+            for (typename std::list<Worker*>::iterator it = wrk->service->waiting.begin();
+                     it != wrk->service->waiting.end();) {
+                if (*it == wrk) {
+                    it = wrk->service->waiting.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+            --wrk->service->nworkers;
+            for (const auto& codec : wrk->codecs) {
+                --wrk->service->codecs[codec];
+            }
+            if (wrk->busy and wrk->inflight.fanout) {
+                fanout_reply(*wrk->inflight.fanout, nullptr);
+            }
+            else if (wrk->busy and wrk->inflight.transfer) {
+                // The chunks given are gone so it can not be requeued.
+                auto xfer = wrk->inflight.transfer;
+                xfer->worker = nullptr;
+                transfer_fail(*xfer, "transfer");
+            }
+            else if (wrk->busy) {
+                request_requeue(wrk->service, wrk->inflight);
+            }
+            for (auto& one : wrk->targeted) {
+                fanout_reply(*one.fanout, nullptr);
+            }
+        }
+        m_waiting.erase(wrk);
+        m_busy.erase(wrk);
+        if (!wrk->primary) {
+            m_workers.erase(wrk->identity);
+        }
+        delete wrk;
+        wrk=0;
+    }
+    // mmsg holds starting with 7/MDP Frame 2.
+    template<class Observer>
+    void BasicBroker<Observer>::worker_process(remote_identity_t sender, zmq::multipart_t& mmsg)
+    {
+        assert(mmsg.size() >= 1);
+        const std::string command = mmsg.popstr(); // 0x01, 0x02, ....
+        m_observer.mark(phase_t::decode);
+        bool worker_ready = (m_workers.find(sender) != m_workers.end());
+        Worker* wrk = worker_require(sender);
+        wrk->heard = m_now;
+        m_observer.mark(phase_t::lookup);
+
+        if (mdp::worker::ready == command) {
+            if (worker_ready) {     // protocol error
+                m_log.error("generaldomo broker protocol error (double ready) from: " + sender);
+                worker_delete(wrk, 1);
+                return;
+            }
+            // Attach worker to service and mark as idle
+            std::string service_name = mmsg.popstr();
+            if (detail::is_internal(service_name)) {
+                m_log.error("generaldomo broker protocol error (worker mmi) from: " + sender);
+                worker_delete(wrk, 1);
+                return;
+            }
+            std::vector<std::string> others;
+            if (mmsg.size()) {      // GDP extended worker
+                properties_t props = decode_properties(mmsg.pop());
+                others = split_list(props[gdp::prop::services]);
+                wrk->extended = true;
+                wrk->codecs = split_list(props[gdp::prop::accept]);
+                wrk->batch = props.count(gdp::prop::batch) > 0;
+                wrk->transfer = props.count(gdp::prop::transfer) > 0;
+                if (props.count(gdp::prop::idempotent)) {
+                    service_require(service_name)->options.idempotent = true;
+                }
+                auto hit = props.find(gdp::prop::heartbeat);
+                if (hit != props.end()) {
+                    auto interval = std::strtoll(hit->second.c_str(), nullptr, 10);
+                    wrk->busy_expiry = time_unit_t{interval} * m_hb_liveness;
+                }
+            }
+            wrk->service = service_require(service_name);
+            wrk->service->nworkers++;
+            for (const auto& codec : wrk->codecs) {
+                ++wrk->service->codecs[codec];
+            }
+            // Further services get a proxy each, sharing the identity.
+            // Replies are routed by service so one is made per name.
+            std::unordered_set<std::string> named{service_name};
+            for (const auto& name : others) {
+                if (detail::is_internal(name) or !named.insert(name).second) {
+                    continue;
+                }
+                Worker* other = new Worker{sender};
+                other->primary = wrk;
+                other->extended = true;
+                other->codecs = wrk->codecs;
+                other->batch = wrk->batch;
+                other->transfer = wrk->transfer;
+                other->busy_expiry = wrk->busy_expiry;
+                other->heard = m_now;
+                other->service = service_require(name);
+                other->service->nworkers++;
+                for (const auto& codec : other->codecs) {
+                    ++other->service->codecs[codec];
+                }
+                wrk->others.push_back(other);
+            }
+            if constexpr (observed) {
+                m_observer.on_ready(service_name, sender);
+                for (auto other : wrk->others) {
+                    m_observer.on_ready(other->service->name, sender);
+                }
+            }
+            worker_waiting(wrk);
+            for (auto other : wrk->others) {
+                worker_waiting(other);
+            }
+            return;
+        }
+        if (mdp::worker::reply == command) {
+            if (!worker_ready) {
+                worker_delete(wrk, 1);
+                return;
+            }
+            mmsg.pop();             // client address, we know it
+            properties_t props = decode_properties(mmsg.pop());
+            auto sit = props.find(gdp::prop::service);
+            if (sit != props.end()) {
+                for (auto other : wrk->others) {
+                    if (other->service->name == sit->second) {
+                        wrk = other;
+                        break;
+                    }
+                }
+                props.erase(sit);
+            }
+            if (!wrk->busy) {
+                m_log.error("generaldomo broker protocol error (reply when idle) from: " + sender);
+                return;
+            }
+            if (wrk->inflight.transfer and props.count(gdp::prop::credit)) {
+                transfer_credit(*wrk->inflight.transfer, props);
+                return;
+            }
+            worker_reply(wrk, props, mmsg);
+            return;
+        }
+        if (mdp::worker::heartbeat == command) {
+            if (!worker_ready) {
+                worker_delete(wrk, 1);
+                return;
+            }
+            wrk->expiry = m_now + m_hb_expiry;
+            return;
+        }
+        if (mdp::worker::disconnect == command) {
+            Service* srv = wrk->service;
+            worker_delete(wrk, 0);
+            if (srv) {
+                service_dispatch(srv);
+            }
+            return;
+        }
+        m_log.error("generaldomo broker invalid input message " + command);
+    }
+
+
+    template<class Observer>
+    void BasicBroker<Observer>::worker_reply(Worker* wrk, properties_t& props, zmq::multipart_t& mmsg)
+    {
+        Request& req = wrk->inflight;
+        if constexpr (observed) {
+            m_observer.on_reply(wrk->service->name, detail::body_bytes(mmsg));
+        }
+        std::chrono::duration<double> took =
+            std::chrono::steady_clock::now() - wrk->dispatched;
+        wrk->info.learn(took.count() / std::max<size_t>(1, req.batch));
+        if (req.unpacked) {
+            // Pack reply from plain worker as a batch of one.
+            zmq::multipart_t packed;
+            packed.add(mmsg.encode());
+            mmsg = std::move(packed);
+            props[gdp::prop::batch] = "1";
+        }
+        if (req.transfer) {
+            m_transfers.erase(req.transfer->key);
+            props[gdp::prop::transfer] = req.transfer->id;
+        }
+        if (req.fanout) {
+            fanout_reply(*req.fanout, &mmsg);
+        }
+        else if (req.gather) {
+            gather_reply(req, props, mmsg);
+        }
+        else if (req.transfer and req.transfer->failed) {
+            m_log.debug("generaldomo broker drop reply to failed transfer");
+        }
+        else {
+            if (req.cacheable and !props.count(gdp::prop::error)) {
+                zmq::multipart_t request = detail::request_frames(req.props, req.body);
+                wrk->service->cache.put(req.key, request, m_now, props, mmsg);
+            }
+            if (req.props.count(gdp::prop::pipeline)
+                and !props.count(gdp::prop::error)) {
+                pipeline_next(req.client, req.props, props, mmsg);
+            }
+            else {
+                request_reply(wrk->service, req.client, req.extended,
+                              detail::request_id(req.props), req.leader, req.key,
+                              props, mmsg);
+            }
+        }
+        wrk->inflight = Request{};
+        wrk->busy = false;
+        m_busy.erase(wrk);
+        worker_waiting(wrk);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::worker_waiting(Worker* wrk)
+    {
+        wrk->expiry = m_now + m_hb_expiry;
+        // Broadcast copies for this worker go first.
+        while (wrk->targeted.size()) {
+            Request req = std::move(wrk->targeted.front());
+            wrk->targeted.pop_front();
+            if (req.fanout->done) {
+                continue;
+            }
+            zmq::multipart_t mmsg = share_frames(req.body);
+            worker_give(wrk, req, req.props, mmsg);
+            return;
+        }
+        m_waiting.insert(wrk);
+        wrk->service->waiting.push_back(wrk);
+        service_dispatch(wrk->service);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::client_process(remote_identity_t client_id, zmq::multipart_t& mmsg,
+                                               bool extended)
+    {
+        std::string service_name = mmsg.popstr(); // Client REQUEST Frame 2 
+        Request req{client_id, extended};
+        if (extended) {
+            req.props = decode_properties(mmsg.pop()); // GDP frame 3
+        }
+        req.body = std::move(mmsg);
+        m_observer.mark(phase_t::decode);
+        if constexpr (observed) {
+            m_observer.on_accept(service_name, detail::body_bytes(req.body));
+        }
+        request_submit(service_name, req);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::request_submit(const std::string& service_name, Request& req)
+    {
+        const remote_identity_t& client_id = req.client;
+        if (detail::is_internal(service_name)) {
+            service_internal(req, service_name, req.body);
+            return;
+        }
+        Service* srv = service_require(service_name);
+        m_observer.mark(phase_t::lookup);
+        auto dit = req.props.find(gdp::prop::deadline);
+        if (dit != req.props.end()) {
+            req.deadline = time_unit_t{std::strtoll(dit->second.c_str(), nullptr, 10)};
+        }
+        if (req.props.count(gdp::prop::broadcast)) {
+            request_broadcast(srv, req);
+            return;
+        }
+        if (req.props.count(gdp::prop::transfer)) {
+            request_transfer(srv, req);
+            return;
+        }
+        auto pit = req.props.find(gdp::prop::pipeline);
+        if (pit != req.props.end() and split_list(pit->second).empty()) {
+            req.props.erase(pit);
+        }
+        const bool pipelined = req.props.count(gdp::prop::pipeline);
+        auto bit = req.props.find(gdp::prop::batch);
+        if (bit != req.props.end()) {
+            req.batch = std::strtoul(bit->second.c_str(), nullptr, 10);
+            if (req.batch == 0 or req.batch != req.body.size()) {
+                m_log.error("generaldomo broker protocol error (bad batch) from: " + client_id);
+                if constexpr (observed) {
+                    m_observer.on_reject(srv->name, "batch");
+                }
+                properties_t props;
+                props[gdp::prop::error] = "batch";
+                zmq::multipart_t none;
+                client_reply(req.client, req.extended, detail::request_id(req.props),
+                             srv->name, props, none);
+                return;
+            }
+        }
+        zmq::multipart_t request;
+        if (srv->options.idempotent or srv->options.coalesce) {
+            request = detail::request_frames(req.props, req.body);
+            req.key = hash_frames(request);
+        }
+        if (srv->options.idempotent) {
+            properties_t props;
+            zmq::multipart_t reply;
+            if (srv->cache.get(req.key, request, m_now, props, reply)) {
+                m_log.debug("generaldomo broker reply from cache");
+                if (pipelined) {
+                    pipeline_next(req.client, req.props, props, reply);
+                    return;
+                }
+                client_reply(req.client, req.extended, detail::request_id(req.props),
+                             srv->name, props, reply);
+                return;
+            }
+            req.cacheable = true;
+        }
+        // The reply of a pipeline stage is not that for the client so
+        // it is not shared.
+        const bool coalesce = srv->options.coalesce and !pipelined;
+        if (coalesce) {
+            auto fit = srv->followers.find(req.key);
+            if (fit != srv->followers.end() and same_frames(fit->second.request, request)) {
+                m_log.debug("generaldomo broker coalesce request from: " + client_id);
+                fit->second.clients.push_back(typename Service::Follower{
+                        client_id, req.extended, detail::request_id(req.props), req.deadline});
+                return;
+            }
+        }
+        const bool full = srv->options.max_requests
+            and srv->requests.size() >= srv->options.max_requests;
+        if (full or (m_spill_full and m_resident > m_memory_budget)) {
+            m_log.debug("generaldomo broker queue full for " + srv->name);
+            ++srv->rejected;
+            if constexpr (observed) {
+                m_observer.on_reject(srv->name, "overload");
+            }
+            properties_t props;
+            props[gdp::prop::error] = "overload";
+            zmq::multipart_t none;
+            client_reply(req.client, req.extended, detail::request_id(req.props),
+                         srv->name, props, none);
+            return;
+        }
+        // A request whose key is taken by a different one goes alone.
+        if (coalesce and !srv->followers.count(req.key)) {
+            srv->followers[req.key].request = std::move(request);
+            req.leader = true;
+        }
+        queue_add(req);
+        srv->requests.emplace_back(std::move(req));
+        if constexpr (observed) {
+            m_observer.on_enqueue(srv->name, srv->requests.size());
+        }
+        service_dispatch(srv);
+        queue_budget(srv);
+    }
+
+
+    template<class Observer>
+    void BasicBroker<Observer>::client_reply(remote_identity_t client_id, bool extended,
+                                             const std::string& id, const std::string& service,
+                                             properties_t& props, zmq::multipart_t& body)
+    {
+        if (extended) {
+            if (id.size()) {
+                props[gdp::prop::id] = id;
+            }
+            auto sit = m_services.find(service);
+            if (sit != m_services.end() and sit->second) {
+                std::string accept = sit->second->accept();
+                if (accept.size()) {
+                    props[gdp::prop::accept] = accept;
+                }
+            }
+            body.push(encode_properties(props));
+            body.pushstr(service);
+            body.pushstr(gdp::client::ident);
+        }
+        else {
+            body.pushstr(service);
+            body.pushstr(mdp::client::ident);
+        }
+        m_log.debug("generaldomo broker reply to client");
+        send(body, client_id);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::gather_reply(const Request& req, const properties_t& props,
+                                             zmq::multipart_t& body)
+    {
+        Gather& gat = *req.gather;
+        if (gat.failed) {
+            return;
+        }
+        if (props.count(gdp::prop::error)) {
+            gat.cacheable = false;
+        }
+        std::string coded;
+        auto cit = props.find(gdp::prop::codec);
+        if (cit != props.end() and cit->second == gat.codec) {
+            coded = props.at(gdp::prop::coded);
+        }
+        for (size_t ind = 0; ind < req.batch and body.size(); ++ind) {
+            gat.replies[req.offset + ind] = body.pop();
+            if (ind < coded.size()) {
+                gat.coded[req.offset + ind] = coded[ind];
+            }
+        }
+        gat.remaining -= std::min(gat.remaining, req.batch);
+        if (gat.remaining) {
+            return;
+        }
+
+        properties_t rprops;
+        rprops[gdp::prop::batch] = std::to_string(gat.replies.size());
+        if (gat.coded.find('1') != std::string::npos) {
+            rprops[gdp::prop::codec] = gat.codec;
+            rprops[gdp::prop::coded] = gat.coded;
+        }
+        zmq::multipart_t rbody;
+        for (auto& one : gat.replies) {
+            rbody.add(std::move(one));
+        }
+        auto sit = m_services.find(gat.service);
+        if (sit == m_services.end()) {
+            client_reply(gat.client, true, gat.id, gat.service, rprops, rbody);
+            return;
+        }
+        if (gat.cacheable) {
+            sit->second->cache.put(gat.key, gat.request, m_now, rprops, rbody);
+        }
+        if (gat.pipeline.size()) {
+            pipeline_next(gat.client, gat.pipeline, rprops, rbody);
+            return;
+        }
+        request_reply(sit->second, gat.client, true, gat.id, gat.leader, gat.key,
+                      rprops, rbody);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::request_reply(Service* srv, remote_identity_t client_id,
+                                              bool extended, const std::string& id,
+                                              bool leader, ReplyCache::key_t key,
+                                              properties_t& props, zmq::multipart_t& body)
+    {
+        if (leader) {
+            // Fan out to clients which coalesced onto this request.  The
+            // entry goes now as nothing is kept once the reply is sent.
+            auto fit = srv->followers.find(key);
+            if (fit != srv->followers.end()) {
+                std::vector<typename Service::Follower> followers = std::move(fit->second.clients);
+                srv->followers.erase(fit);
+                for (const auto& one : followers) {
+                    properties_t fprops = props;
+                    zmq::multipart_t fbody = share_frames(body);
+                    client_reply(one.client, one.extended, one.id, srv->name,
+                                 fprops, fbody);
+                }
+            }
+        }
+        client_reply(client_id, extended, id, srv->name, props, body);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::pipeline_next(remote_identity_t client_id, const properties_t& req_props,
+                                              const properties_t& props, zmq::multipart_t& body)
+    {
+        // The reply becomes the request for the next stage, coded or
+        // packed as it is.  Other client properties carry over.
+        auto stages = split_list(req_props.at(gdp::prop::pipeline));
+        Request req{client_id, true, req_props};
+        for (const char* key : {gdp::prop::codec, gdp::prop::coded, gdp::prop::batch}) {
+            auto it = props.find(key);
+            if (it == props.end()) {
+                req.props.erase(key);
+            }
+            else {
+                req.props[key] = it->second;
+            }
+        }
+        std::string service = stages.front();
+        stages.erase(stages.begin());
+        if (stages.empty()) {
+            req.props.erase(gdp::prop::pipeline);
+        }
+        else {
+            req.props[gdp::prop::pipeline] = join_list(stages);
+        }
+        req.body = std::move(body);
+        m_log.debug("generaldomo broker pipeline to " + service);
+        request_submit(service, req);
+    }
+
+    template<class Observer>
+    bool BasicBroker<Observer>::request_cancel(Service* srv, remote_identity_t client_id,
+                                               const std::string& id)
+    {
+        if (id.empty()) {
+            return false;
+        }
+        bool found = false;
+        // A follower simply stops waiting.
+        for (auto& [key, waiting] : srv->followers) {
+            auto& followers = waiting.clients;
+            for (auto it = followers.begin(); it != followers.end();) {
+                if (it->client == client_id and it->id == id) {
+                    it = followers.erase(it);
+                    found = true;
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+        // A queued request goes unless others wait on its reply.  Slices
+        // of a batch go while those with workers finish in vain.
+        for (auto it = srv->requests.begin(); it != srv->requests.end();) {
+            if (it->client != client_id or detail::request_id(it->props) != id) {
+                ++it;
+                continue;
+            }
+            bool leader = it->leader or (it->gather and it->gather->leader);
+            ReplyCache::key_t key = it->gather ? it->gather->key : it->key;
+            if (leader) {
+                auto fit = srv->followers.find(key);
+                if (fit != srv->followers.end() and fit->second.clients.size()) {
+                    ++it;
+                    continue;
+                }
+            }
+            it = request_drop(srv, it);
+            found = true;
+        }
+        if (found) {
+            m_log.debug("generaldomo broker cancel request from: " + client_id);
+        }
+        return found;
+    }
+
+    template<class Observer>
+    bool BasicBroker<Observer>::request_expired(Service* srv, const Request& req, time_unit_t now)
+    {
+        if (req.deadline.count() == 0 or now < req.deadline) {
+            return false;
+        }
+        // The reply is still wanted if any coalesced client waits on.
+        if (req.leader or (req.gather and req.gather->leader)) {
+            ReplyCache::key_t key = req.gather ? req.gather->key : req.key;
+            auto fit = srv->followers.find(key);
+            if (fit != srv->followers.end()) {
+                for (const auto& one : fit->second.clients) {
+                    if (one.deadline.count() == 0 or now < one.deadline) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::request_requeue(Service* srv, Request& req)
+    {
+        req.unpacked = false;
+        if (req.attempts < srv->options.max_attempts) {
+            m_log.debug("generaldomo broker requeue request for " + srv->name);
+            ++srv->requeued;
+            queue_add(req);
+            srv->requests.push_front(std::move(req));
+            return;
+        }
+
+        // Each worker given the request died, it may be what kills them.
+        m_log.error("generaldomo broker quarantine request for " + srv->name);
+        ++srv->quarantined;
+        request_fail(srv, req, "poison");
+        srv->quarantine.push_back(std::move(req));
+        while (srv->quarantine.size() > srv->options.quarantine_size) {
+            srv->quarantine.pop_front();
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::request_fail(Service* srv, Request& req, const std::string& why)
+    {
+        properties_t props;
+        props[gdp::prop::error] = why;
+        zmq::multipart_t empty;
+        if (req.transfer) {
+            // Still queued, the rest of it is dropped as it comes.
+            Transfer& xfer = *req.transfer;
+            if (!xfer.failed) {
+                xfer.failed = true;
+                props[gdp::prop::transfer] = xfer.id;
+                client_reply(xfer.client, true, "", xfer.service, props, empty);
+            }
+            return;
+        }
+        if (req.gather) {
+            Gather& gat = *req.gather;
+            if (!gat.failed) {
+                gat.failed = true;
+                request_reply(srv, gat.client, true, gat.id, gat.leader, gat.key,
+                              props, empty);
+            }
+            return;
+        }
+        request_reply(srv, req.client, req.extended, detail::request_id(req.props),
+                      req.leader, req.key, props, empty);
+    }
+
+    template<class Observer>
+    typename std::deque<typename BasicBroker<Observer>::Request>::iterator
+    BasicBroker<Observer>::request_drop(Service* srv,
+                                        typename std::deque<Request>::iterator req_it)
+    {
+        if (req_it->transfer) {
+            m_transfers.erase(req_it->transfer->key);
+        }
+        if (req_it->gather and req_it->gather->leader) {
+            srv->followers.erase(req_it->gather->key);
+            req_it->gather->leader = false;
+        }
+        else if (req_it->leader) {
+            srv->followers.erase(req_it->key);
+        }
+        queue_remove(*req_it);
+        return srv->requests.erase(req_it);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::queue_add(const Request& req)
+    {
+        if (req.spilled) {
+            m_spilled += req.spill_size;
+            ++m_nspilled;
+        }
+        else {
+            m_resident += detail::body_bytes(req.body);
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::queue_remove(const Request& req)
+    {
+        if (!req.spilled) {
+            m_resident -= detail::body_bytes(req.body);
+            return;
+        }
+        m_spilled -= req.spill_size;
+        m_spill_full = false;
+        if (--m_nspilled == 0) {
+            m_spill->clear();
+        }
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::queue_budget(Service* srv)
+    {
+        if (!m_memory_budget or m_resident <= m_memory_budget) {
+            return;
+        }
+        // The front is next to go to a worker so spill from the back.
+        for (auto it = srv->requests.rbegin(); it != srv->requests.rend(); ++it) {
+            if (m_resident <= m_memory_budget) {
+                return;
+            }
+            if (it->spilled) {
+                continue;
+            }
+            // What can not be spilled is kept in memory, but no more
+            // is taken until there is room.
+            try {
+                if (!request_spill(*it)) {
+                    m_log.debug("generaldomo broker spill file full");
+                    m_spill_full = true;
+                    return;
+                }
+            }
+            catch (const std::runtime_error& err) {
+                m_log.error(err.what());
+                m_spill_full = true;
+                return;
+            }
+        }
+    }
+
+    template<class Observer>
+    bool BasicBroker<Observer>::request_spill(Request& req)
+    {
+        if (!m_spill) {
+            m_spill = std::make_unique<SpillFile>(m_spill_dir);
+        }
+        zmq::message_t msg = req.body.encode();
+        // Bodies are read back from the front while more are spilled at
+        // the back, so a backlog that never drains leaves ever more of
+        // the file dead.
+        const size_t dead = m_spill->size() - m_spilled;
+        const bool over = m_spill_limit and m_spill->size() + msg.size() > m_spill_limit;
+        if (dead and (over or dead > std::max(m_spilled, m_memory_budget))) {
+            spill_compact();
+        }
+        if (m_spill_limit and m_spill->size() + msg.size() > m_spill_limit) {
+            return false;
+        }
+        req.spill_offset = m_spill->write(msg);
+        req.spill_size = msg.size();
+        queue_remove(req);
+        req.body.clear();
+        req.spilled = true;
+        queue_add(req);
+        return true;
+    }
+
+    // Copy the bodies still wanted to a new file.  Offsets change only
+    // once all are copied so a failure leaves the old file in use.
+    template<class Observer>
+    void BasicBroker<Observer>::spill_compact()
+    {
+        auto spill = std::make_unique<SpillFile>(m_spill_dir);
+        std::vector<std::pair<Request*, size_t>> moved;
+        for (auto& [name, srv] : m_services) {
+            for (auto& req : srv->requests) {
+                if (req.spilled) {
+                    size_t offset = spill->write(m_spill->read(req.spill_offset, req.spill_size));
+                    moved.emplace_back(&req, offset);
+                }
+            }
+        }
+        for (auto [req, offset] : moved) {
+            req->spill_offset = offset;
+        }
+        m_log.debug("generaldomo broker spill file compacted from "
+                    + std::to_string(m_spill->size()) + " to "
+                    + std::to_string(spill->size()) + " bytes");
+        m_spill = std::move(spill);
+    }
+
+    template<class Observer>
+    void BasicBroker<Observer>::request_load(Request& req)
+    {
+        if (!req.spilled) {
+            return;
+        }
+        zmq::multipart_t body;
+        body.decode(m_spill->read(req.spill_offset, req.spill_size));
+        queue_remove(req);
+        req.body = std::move(body);
+        req.spilled = false;
+        queue_add(req);
+    }
+
+    template<class Observer>
+    bool BasicBroker<Observer>::request_restore(Service* srv, Request& req)
+    {
+        try {
+            request_load(req);
+        }
+        catch (const std::runtime_error& err) {
+            m_log.error(std::string(err.what()) + " for " + srv->name);
+            request_fail(srv, req, "spill");
+            return false;
+        }
+        return true;
+    }
+
+}
+
+#endif
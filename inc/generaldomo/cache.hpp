@@ -0,0 +1,95 @@
+/*! Generaldomo reply cache
+ *
+ * A byte-bounded, least-recently-used cache of replies with a time to
+ * live.  The broker keeps one per idempotent service, keyed by a hash
+ * of the request.  Each reply is kept with its request so a request
+ * whose hash collides with that of another is not answered with the
+ * other's reply.
+ */
+
+#ifndef GENERALDOMO_CACHE_HPP_SEEN
+#define GENERALDOMO_CACHE_HPP_SEEN
+
+#include "generaldomo/util.hpp"
+
+#include <list>
+#include <unordered_map>
+
+namespace generaldomo {
+
+    /*! Hash the frames of a message, continuing from seed.
+     *
+     * This is a 64 bit FNV-1a over the size and data of each frame.
+     */
+    uint64_t hash_frames(const zmq::multipart_t& mmsg,
+                         uint64_t seed = 14695981039346656037ULL);
+
+    /*! Hash a string, continuing from seed. */
+    uint64_t hash_string(const std::string& str,
+                         uint64_t seed = 14695981039346656037ULL);
+
+    /*! Return true if two messages have the same frames. */
+    bool same_frames(const zmq::multipart_t& one, const zmq::multipart_t& two);
+
+
+    class ReplyCache {
+    public:
+        typedef uint64_t key_t;
+
+        /// Create a cache holding replies for at most ttl and at most
+        /// max_bytes of reply bodies and their requests.
+        ReplyCache(time_unit_t ttl = time_unit_t{60000},
+                   size_t max_bytes = 64*1024*1024);
+
+        /// Change the limits, evicting as needed.
+        void limit(time_unit_t ttl, size_t max_bytes);
+
+        /// Fill props and body with the reply to request, if one is
+        /// held and has not expired at time now, and return true.
+        /// The key is hash_frames() of the request.
+        bool get(key_t key, const zmq::multipart_t& request, time_unit_t now,
+                 properties_t& props, zmq::multipart_t& body);
+
+        /// Hold a reply to request, taken at time now, replacing any
+        /// under the same key.  The request and body are left intact
+        /// and share their data with the cache.
+        void put(key_t key, zmq::multipart_t& request, time_unit_t now,
+                 const properties_t& props, zmq::multipart_t& body);
+
+        /// Drop one or all replies.
+        void invalidate(key_t key);
+        void invalidate();
+
+        struct stats_t {
+            size_t hits{0}, misses{0}, evictions{0}, expired{0};
+        };
+        const stats_t& stats() const { return m_stats; }
+        size_t size() const { return m_index.size(); }
+        size_t bytes() const { return m_bytes; }
+
+    private:
+
+        struct Entry {
+            key_t key;
+            time_unit_t expiry;
+            size_t bytes;
+            properties_t props;
+            zmq::multipart_t body;
+            zmq::multipart_t request;
+        };
+        typedef std::list<Entry> lru_t;
+
+        time_unit_t m_ttl;
+        size_t m_max_bytes;
+        size_t m_bytes{0};
+        stats_t m_stats;
+        // Most recently used at front.
+        lru_t m_lru;
+        std::unordered_map<key_t, lru_t::iterator> m_index;
+
+        void erase(lru_t::iterator it);
+        void evict();
+    };
+}
+
+#endif
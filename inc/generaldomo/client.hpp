@@ -3,9 +3,57 @@
 
 #include "generaldomo/util.hpp"
 #include "generaldomo/logging.hpp"
+#include "generaldomo/compress.hpp"
+#include "generaldomo/backoff.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <deque>
 
 namespace generaldomo {
 
+    /*! Policy for hedged requests.
+     *
+     * A hedge is a duplicate of a request sent when its reply is
+     * slow in coming.  The first reply is taken and the broker is
+     * asked to cancel any copy it has not yet given to a worker.
+     */
+    struct hedging_t {
+        // Hedge after this long without a reply.  Zero disables
+        // hedging unless a percentile is given.
+        time_unit_t delay{0};
+        // If above zero, hedge after this quantile (eg 0.95) of
+        // recent latencies once enough are known.  Until then, delay
+        // is used.
+        double percentile{0};
+        // Number of recent latencies to keep.
+        size_t window{1000};
+        // Hedges per request allowed on average.  Each request earns
+        // this much credit and a hedge spends one.
+        double budget{0.05};
+        // Most credit which may be saved up.
+        double burst{10};
+
+        bool enabled() const { return delay.count() > 0 or percentile > 0; }
+    };
+
+    /*! Configuration of a client.  See config.hpp to load it. */
+    struct client_config_t {
+        // How long recv() waits for a reply.
+        time_unit_t timeout{HEARTBEAT_INTERVAL};
+        // Tell the broker when requests are given up.
+        bool deadline{false};
+        // Replies which may time out in a row before the broker is
+        // taken as lost.
+        int liveness{HEARTBEAT_LIVENESS};
+        backoff_t backoff{};
+        compression_t compression{};
+        hedging_t hedging{};
+        // Most chunks of a transfer sent before credit is granted.
+        size_t window{8};
+    };
+
     /*! The generaldomo client API class
      *
      * Applications may use a Client to simplify participating in the
@@ -17,6 +65,25 @@ namespace generaldomo {
      * differences related to the socket type are subsequently erased
      * by this class.
      *
+     * If a compression policy is given, the client speaks the GDP
+     * extended client protocol, tells the broker which codecs it
+     * accepts for replies and codes request bodies once a reply for
+     * the service shows its workers accept a common codec.
+     *
+     * If a hedging policy is given, the client also speaks the GDP
+     * extended protocol and may send a request more than once.  This
+     * requires a GDP broker and that requests are idempotent.
+     *
+     * If asked with set_timeout(), each request carries the time at
+     * which the client gives up on it, which also requires a GDP
+     * broker.
+     *
+     * When a number of replies in a row time out the client takes
+     * the broker as lost, disconnects and reconnects after a backoff.
+     * A request sent meanwhile is held until then, recv() waiting for
+     * that as part of its timeout.  A reply which comes after its
+     * timeout is dropped if the request had an id (eg when hedging)
+     * and is otherwise taken for that of the next request.
      */
 
     class Client {
@@ -24,7 +91,11 @@ namespace generaldomo {
         /// Create a client requesting service.  Caller keeps socket
         /// eg so to poll it along with others.
         Client(zmq::socket_t& sock, std::string broker_address,
-               logbase_t& log);
+               logbase_t& log,
+               const compression_t& compression = compression_t{},
+               const hedging_t& hedging = hedging_t{});
+        Client(zmq::socket_t& sock, std::string broker_address,
+               logbase_t& log, const client_config_t& config);
         ~Client();
 
         // API methods
@@ -39,19 +110,150 @@ namespace generaldomo {
         /// 7/MDP.  If an error occurs the reply is empty.
         void recv(zmq::multipart_t& reply);
 
+        /// Send many requests for a service as one batch message.
+        /// Each request is as given to send() and is left empty.
+        /// The broker may spread the batch over idle workers.  This
+        /// requires a GDP broker.  Throws if requests is empty.
+        void send_batch(std::string service,
+                        std::vector<zmq::multipart_t>& requests);
+
+        /// Receive the replies to the last batch, one per request and
+        /// in the same order.  If an error occurs replies is empty.
+        void recv_batch(std::vector<zmq::multipart_t>& replies);
+
+        /// Send a copy of a request to each worker of a service, or
+        /// to at most quorum of them if not zero.  The broker gathers
+        /// the replies until all come or, if wait is not zero, for
+        /// that long, else until the request deadline or for as long
+        /// as a silent worker is taken as alive.  The request is as
+        /// given to send() and is left empty.  This requires a GDP
+        /// broker.
+        void send_broadcast(std::string service, zmq::multipart_t& request,
+                            size_t quorum = 0, time_unit_t wait = time_unit_t{0});
+
+        /// Receive the replies to the last broadcast, one per worker
+        /// which answered in time, in order of arrival.  If a quorum
+        /// was asked for and not met or an error occurs, replies is
+        /// empty.
+        void recv_broadcast(std::vector<zmq::multipart_t>& replies);
+
+        /// Send a request through a pipeline of services.  The broker
+        /// gives the request to the first and each reply as the
+        /// request to the next.  Receive with recv() the reply of the
+        /// last service, or of the first to fail.  The request is as
+        /// given to send() and is left empty.  This requires a GDP
+        /// broker.
+        void send_pipeline(const std::vector<std::string>& services,
+                           zmq::multipart_t& request);
+
+        /// Send a chunk of a request too large to hold whole.  The
+        /// first chunk begins a transfer to a worker of the service
+        /// and the last ends it, after which recv() gives the reply.
+        /// No more than the window of chunks are sent before the
+        /// worker grants credit for more, which this waits for as
+        /// needed, up to the timeout.  Return false if the transfer
+        /// failed or the worker replied early, in which case recv()
+        /// gives any reply.  The chunk is as given to send() and is
+        /// left empty.  This requires a GDP broker.
+        bool send_chunk(std::string service, zmq::multipart_t& chunk,
+                        bool last = false);
+
+        /// Set the most chunks of a transfer sent before credit is
+        /// granted.  This applies from the next transfer.
+        void set_window(size_t window) { m_window = std::max<size_t>(1, window); }
+
+        /// Set how long recv() waits for a reply.  If deadline is
+        /// true, each request carries the time at which it will be
+        /// given up so that the broker drops it, rather than give it
+        /// to a worker, once late.  This requires a GDP broker.
+        void set_timeout(time_unit_t timeout, bool deadline = false);
+
+        /// Set how long to wait before reconnecting after a timeout.
+        void set_backoff(const backoff_t& backoff) { m_backoff = Backoff(backoff); }
+
+        /// Set how many replies in a row may time out before the
+        /// client reconnects.
+        void set_liveness(int liveness) { m_liveness = std::max(1, liveness); }
+
+        /// Return true unless waiting to reconnect to the broker.
+        bool connected() const { return m_connected; }
+
+        struct hedge_stats_t {
+            // Requests sent, hedges sent and replies won by a hedge.
+            size_t requests{0}, hedged{0}, won{0};
+            // Hedges which were due but refused by the budget.
+            size_t refused{0};
+        };
+        const hedge_stats_t& hedge_stats() const { return m_hedge_stats; }
+
     private:
         zmq::socket_t& m_sock;
         std::string m_address;
         logbase_t& m_log;
         time_unit_t m_timeout{HEARTBEAT_INTERVAL};
-        
+        bool m_deadline{false};
+        Compressor m_compressor;
+        // Codecs accepted by the workers of a service as last told by
+        // the broker.
+        std::unordered_map<std::string, std::string> m_accept;
+
+        hedging_t m_hedging;
+        hedge_stats_t m_hedge_stats;
+        double m_hedge_credit{0};
+        // Recent latencies, newest at back.
+        std::deque<time_unit_t> m_latency;
+        // The request awaiting a reply, kept to send as a hedge.
+        std::string m_service;
+        zmq::multipart_t m_request;
+        properties_t m_request_props;
+        time_unit_t m_sent_at{0};
+        // Identifiers of the copies sent, the original first.
+        std::vector<std::string> m_ids;
+        size_t m_next_id{0};
+
+        // False while waiting until m_reconnect_at to reconnect, when
+        // messages to send are held.
+        bool m_connected{false};
+        time_unit_t m_reconnect_at{0};
+        Backoff m_backoff;
+        std::vector<zmq::multipart_t> m_held;
+        // Replies timed out in a row and how many make the broker lost.
+        int m_timeouts{0};
+        int m_liveness{HEARTBEAT_LIVENESS};
+
+        // The transfer being sent, or last sent, the number of its
+        // next chunk and the credit left to send more.
+        std::string m_transfer{""};
+        bool m_sending{false};
+        size_t m_chunk{0}, m_credit{0};
+        size_t m_window{8};
+        // Take credit from recv_extended() rather than drop it.
+        bool m_want_credit{false};
+        // A reply which came while waiting for credit, for recv().
+        bool m_early{false};
+        zmq::multipart_t m_early_reply;
+        properties_t m_early_props;
+
     private:
         std::function<void(zmq::socket_t& server_socket,
                            zmq::multipart_t& mmsg)> really_recv;
         std::function<void(zmq::socket_t& server_socket,
                            zmq::multipart_t& mmsg)> really_send;
 
-        void connect_to_broker(bool reconnect = true);
+        void connect_to_broker();
+        void disconnect_from_broker();
+        void send_message(zmq::multipart_t& mmsg);
+
+        void send_extended(const std::string& service,
+                           zmq::multipart_t& request, properties_t& props);
+        void send_copy(const std::string& service,
+                       zmq::multipart_t& request, properties_t& props);
+        void recv_extended(zmq::multipart_t& reply, properties_t& props);
+
+        std::string next_id();
+        time_unit_t hedge_delay() const;
+        void send_hedge();
+        void cancel_except(const std::string& winner);
     };
 }
 
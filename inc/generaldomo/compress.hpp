@@ -0,0 +1,120 @@
+/*! Generaldomo body compression
+ *
+ * Optional compression of message body frames.  Protocol frames are
+ * never touched and the broker passes coded bodies through as-is.
+ * Use of a codec is negotiated with GDP properties: each end tells
+ * what it can decode ("accept") and a sender only codes a body for a
+ * peer that accepts the codec.
+ */
+
+#ifndef GENERALDOMO_COMPRESS_HPP_SEEN
+#define GENERALDOMO_COMPRESS_HPP_SEEN
+
+#include "generaldomo/util.hpp"
+
+#include <string>
+#include <vector>
+
+namespace generaldomo {
+
+    /*! Names of the codecs compiled into this library, eg "zlib".
+     *
+     * This may be empty if the library was configured without any
+     * external codec library.
+     */
+    std::vector<std::string> codecs_available();
+
+    /*! Compress one frame with the named codec.
+     *
+     * Return false and leave out untouched if the codec is unknown or
+     * fails.
+     */
+    bool compress_frame(const std::string& codec, int level,
+                        const zmq::message_t& in, zmq::message_t& out);
+
+    /*! Decompress one frame made by compress_frame().
+     *
+     * Throws std::runtime_error if the codec is unknown, the data is
+     * corrupt or it claims to decode to more than max_size bytes or
+     * to more than the codec can make of its size.
+     */
+    void decompress_frame(const std::string& codec,
+                          const zmq::message_t& in, zmq::message_t& out,
+                          size_t max_size = 256*1024*1024);
+
+
+    /*! Policy for compressing body frames. */
+    struct compression_t {
+        // Codecs in order of preference.  Those not compiled in are
+        // ignored.  Empty means compression is off.
+        std::vector<std::string> codecs{};
+        // Level handed to the codec.  Low levels are fast.
+        int level{1};
+        // Frames smaller than this are never coded.
+        size_t min_size{512};
+        // A coded frame is kept only if it is at most this fraction
+        // of the original size.
+        double max_ratio{0.9};
+        // If true, back off from trying to code after frames turn
+        // out to be incompressible and retry every so often.
+        bool adaptive{true};
+        // Largest number of frames to skip between retries.
+        size_t max_backoff{64};
+        // Largest frame to decode.  A peer sending a coded frame
+        // which claims to be larger is refused.
+        size_t max_size{256*1024*1024};
+    };
+
+
+    /*! Apply a compression policy to message bodies.
+     *
+     * One Compressor serves one end of a connection.  It is not
+     * thread safe.
+     */
+    class Compressor {
+    public:
+        Compressor(const compression_t& policy = compression_t{});
+
+        /// True if at least one usable codec is configured.
+        bool enabled() const { return !m_codecs.empty(); }
+
+        /// The "accept" property value telling what we can decode.
+        std::string accept() const;
+
+        /// Return the first of our codecs in the peer's "accept"
+        /// list, or empty string if there is none.
+        std::string choose(const std::string& peer_accept) const;
+
+        /// Code body frames in place with codec, setting properties
+        /// to describe what was done.  Frames which are small or
+        /// incompressible are left as-is.
+        void compress(zmq::multipart_t& body, properties_t& props,
+                      const std::string& codec);
+
+        /// Undo compress() according to properties.  A body without
+        /// codec properties is left as-is.
+        void decompress(zmq::multipart_t& body, const properties_t& props);
+
+        /// Number of frames coded and passed through, and bytes
+        /// before and after coding, for monitoring.
+        struct stats_t {
+            size_t coded{0}, skipped{0}, bytes_in{0}, bytes_out{0};
+        };
+        const stats_t& stats() const { return m_stats; }
+
+    private:
+        compression_t m_policy;
+        std::vector<std::string> m_codecs;
+        stats_t m_stats;
+        // Adaptive state: frames to skip before trying again and the
+        // current length of that skip.
+        size_t m_countdown{0};
+        size_t m_backoff{0};
+
+        bool worth_trying(size_t size);
+        void learn(bool gained);
+    };
+
+}
+
+#endif
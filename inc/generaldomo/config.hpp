@@ -0,0 +1,65 @@
+/*! Generaldomo configuration
+ *
+ * The broker, client and worker each take a typed configuration
+ * struct.  These may be filled from text settings read from a file
+ * or from the environment.
+ *
+ * A file holds "key = value" lines.  Blank lines and those starting
+ * with "#" are ignored.  An environment variable named with a prefix
+ * and the key in upper case, a dot written as "__", gives the same.
+ * Eg the broker setting
+ *
+ *     service.echo.dispatch = ewma
+ *
+ * may also be given as GENERALDOMO_BROKER_SERVICE__ECHO__DISPATCH=ewma
+ * though service names are then lower case.
+ *
+ * Times are integer milliseconds and flags are 1/0, true/false,
+ * yes/no or on/off.  The keys are:
+ *
+ * - broker :: heartbeat, liveness, memory_budget (bytes), spill_dir,
+ *   spill_limit (bytes), busy_poll (microseconds), cpus and io_cpus (comma lists) and
+ *   service.<name>.<option> for each field of service_options_t.
+ *
+ * - client :: timeout, deadline, liveness, window, backoff.base,
+ *   backoff.cap, compression.<field> and hedging.<field>.
+ *
+ * - worker :: heartbeat, liveness, busy_heartbeat, transfer,
+ *   backoff.base, backoff.cap and compression.<field>.
+ *
+ * Loading throws std::runtime_error on an unknown key or a bad value.
+ */
+
+#ifndef GENERALDOMO_CONFIG_HPP_SEEN
+#define GENERALDOMO_CONFIG_HPP_SEEN
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/worker.hpp"
+
+namespace generaldomo {
+
+    /// Read settings from a file.
+    properties_t config_file(const std::string& path);
+
+    /// Read settings from environment variables starting with the
+    /// prefix, eg "GENERALDOMO_BROKER_".
+    properties_t config_env(const std::string& prefix);
+
+    /// Apply settings to a configuration.  Keys not given keep
+    /// their values.
+    void load_config(broker_config_t& config, const properties_t& settings);
+    void load_config(client_config_t& config, const properties_t& settings);
+    void load_config(worker_config_t& config, const properties_t& settings);
+
+    /// Set one service option by its field name.  Return false if
+    /// the name is unknown.  Throw if the value is bad.
+    bool set_option(service_options_t& opts, const std::string& key,
+                    const std::string& value);
+
+    /// Return service options as field name and value.
+    properties_t get_options(const service_options_t& opts);
+
+}
+
+#endif
@@ -0,0 +1,299 @@
+/*! Generaldomo coroutine API
+ *
+ * This requires C++20 and is only built if waf is configured with
+ * --with-coroutines.
+ *
+ * A Scheduler runs coroutines on one thread, resuming them as their
+ * sockets become readable or their timers fire.  An AsyncClient lets
+ * many coroutines each await a request over one socket, the GDP
+ * request "id" property telling whose reply is which.  An AsyncWorker
+ * lets a coroutine await the next request and send its reply.
+ *
+ *     Task<void> ask(AsyncClient& client) {
+ *         zmq::multipart_t reply = co_await client.request("echo", msg);
+ *     }
+ *     Task<void> serve(AsyncWorker& worker) {
+ *         while (true) {
+ *             zmq::multipart_t req = co_await worker.next();
+ *             co_await worker.reply(std::move(req));
+ *         }
+ *     }
+ *     Scheduler sched;
+ *     AsyncClient client(sched, sock, address, log);
+ *     sched.spawn(ask(client));
+ *     sched.run();
+ */
+
+#ifndef GENERALDOMO_CORO_HPP_SEEN
+#define GENERALDOMO_CORO_HPP_SEEN
+
+#include "generaldomo/util.hpp"
+#include "generaldomo/logging.hpp"
+#include "generaldomo/backoff.hpp"
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace generaldomo {
+
+    namespace detail {
+        // Holds what a Task returns.
+        template<typename T>
+        struct task_value {
+            std::optional<T> value;
+            void return_value(T val) { value = std::move(val); }
+            T take() { return std::move(*value); }
+        };
+        template<>
+        struct task_value<void> {
+            void return_void() {}
+            void take() {}
+        };
+    }
+
+    /*! A lazily started coroutine returning a T.
+     *
+     * It starts when awaited, or when given to Scheduler::spawn(),
+     * and resumes its awaiter when done.
+     */
+    template<typename T = void>
+    class Task {
+    public:
+        struct promise_type : detail::task_value<T> {
+            std::coroutine_handle<> continuation{};
+            std::exception_ptr error{};
+
+            Task get_return_object() {
+                return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            struct final_awaiter {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<>
+                await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    auto cont = h.promise().continuation;
+                    return cont ? cont : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            final_awaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+        typedef std::coroutine_handle<promise_type> handle_t;
+
+        Task() = default;
+        explicit Task(handle_t handle) : m_handle(handle) {}
+        Task(Task&& other) : m_handle(std::exchange(other.m_handle, {})) {}
+        Task& operator=(Task&& other) {
+            if (this != &other) {
+                if (m_handle) { m_handle.destroy(); }
+                m_handle = std::exchange(other.m_handle, {});
+            }
+            return *this;
+        }
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        ~Task() { if (m_handle) { m_handle.destroy(); } }
+
+        bool done() const { return !m_handle or m_handle.done(); }
+        handle_t handle() const { return m_handle; }
+
+        bool await_ready() const { return done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) {
+            m_handle.promise().continuation = awaiter;
+            return m_handle;
+        }
+        T await_resume() {
+            if (m_handle.promise().error) {
+                std::rethrow_exception(m_handle.promise().error);
+            }
+            return m_handle.promise().take();
+        }
+
+    private:
+        handle_t m_handle{};
+    };
+
+
+    /*! A single threaded scheduler of coroutines driven by a zmq
+     * poller. */
+    class Scheduler {
+    public:
+        Scheduler() = default;
+        Scheduler(const Scheduler&) = delete;
+
+        /// Call on_input when the socket is readable.  The callback
+        /// should read all that is ready.
+        void watch(zmq::socket_t& sock, std::function<void()> on_input);
+        void unwatch(zmq::socket_t& sock);
+
+        /// Resume a coroutine on the next round.
+        void post(std::coroutine_handle<> handle);
+
+        /// Call a function at a time, as of now_ms().
+        void call_at(time_unit_t when, std::function<void()> func);
+
+        /// Start a task and keep it until it finishes.  An exception
+        /// it throws is rethrown by run_once().
+        void spawn(Task<void> task);
+
+        /// Return the number of spawned tasks yet to finish.
+        size_t tasks() const { return m_tasks.size(); }
+
+        /// Run until all spawned tasks finish or interrupted().
+        void run();
+
+        /// Resume what is ready then wait at most timeout for input
+        /// or a timer and handle those.
+        void run_once(time_unit_t timeout);
+
+    private:
+        struct Watch {
+            zmq::socket_t* sock;
+            std::function<void()> on_input;
+        };
+        std::list<Watch> m_watches;
+        zmq::poller_t<Watch> m_poller;
+
+        std::deque<std::coroutine_handle<>> m_ready;
+
+        struct Timer {
+            time_unit_t when;
+            size_t seq;
+            std::function<void()> func;
+            bool operator>(const Timer& other) const {
+                return when != other.when ? when > other.when : seq > other.seq;
+            }
+        };
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> m_timers;
+        size_t m_seq{0};
+
+        std::list<Task<void>> m_tasks;
+
+        void fire_timers();
+        void reap();
+    };
+
+
+    /*! A client which may have many requests outstanding.
+     *
+     * It speaks the GDP extended client protocol and so requires a
+     * GDP broker.  The socket must not be used otherwise.
+     */
+    class AsyncClient {
+    public:
+        AsyncClient(Scheduler& sched, zmq::socket_t& sock,
+                    std::string broker_address, logbase_t& log);
+        ~AsyncClient();
+
+        /// Send a request to a service and await its reply.  The
+        /// reply is empty on timeout, which also sets the request
+        /// deadline, or error.
+        Task<zmq::multipart_t> request(std::string service,
+                                       zmq::multipart_t request,
+                                       time_unit_t timeout = HEARTBEAT_INTERVAL);
+
+        /// Return the number of requests awaiting replies.
+        size_t outstanding() const { return m_pending.size(); }
+
+    private:
+        // A request awaiting its reply.
+        struct Pending {
+            std::coroutine_handle<> handle{};
+            bool done{false};
+            zmq::multipart_t reply;
+        };
+        struct ReplyAwaiter {
+            Pending& pending;
+            bool await_ready() const { return pending.done; }
+            void await_suspend(std::coroutine_handle<> h) { pending.handle = h; }
+            void await_resume() {}
+        };
+
+        Scheduler& m_sched;
+        zmq::socket_t& m_sock;
+        std::string m_address;
+        logbase_t& m_log;
+        std::unordered_map<std::string, Pending*> m_pending;
+        size_t m_next_id{0};
+        // Released when destroyed so pending timers do nothing.
+        std::shared_ptr<bool> m_alive;
+
+        std::function<void(zmq::socket_t& server_socket,
+                           zmq::multipart_t& mmsg)> really_recv;
+        std::function<void(zmq::socket_t& server_socket,
+                           zmq::multipart_t& mmsg)> really_send;
+
+        void on_input();
+        bool resolve(const std::string& id, zmq::multipart_t& reply);
+    };
+
+
+    /*! A worker whose requests are awaited.
+     *
+     * This is a plain 7/MDP worker which heartbeats and reconnects,
+     * after a backoff, from the scheduler.  Replies must be given in
+     * order, one per request.
+     */
+    class AsyncWorker {
+    public:
+        AsyncWorker(Scheduler& sched, zmq::socket_t& sock,
+                    std::string broker_address, std::string service,
+                    logbase_t& log);
+        ~AsyncWorker();
+
+        /// Await the next request.
+        Task<zmq::multipart_t> next();
+
+        /// Send the reply to the request in hand.
+        Task<void> reply(zmq::multipart_t reply);
+
+    private:
+        struct RequestAwaiter {
+            AsyncWorker& worker;
+            bool await_ready() const { return !worker.m_requests.empty(); }
+            void await_suspend(std::coroutine_handle<> h) { worker.m_waiter = h; }
+            void await_resume() {}
+        };
+
+        Scheduler& m_sched;
+        zmq::socket_t& m_sock;
+        std::string m_address;
+        std::string m_service;
+        logbase_t& m_log;
+        int m_liveness{HEARTBEAT_LIVENESS};
+        time_unit_t m_heartbeat{HEARTBEAT_INTERVAL};
+        // False while waiting to reconnect.
+        bool m_connected{false};
+        Backoff m_backoff;
+        // Requests yet to be given, as (reply to, body).
+        std::deque<std::pair<std::string, zmq::multipart_t>> m_requests;
+        std::coroutine_handle<> m_waiter{};
+        // Addresses of requests given and yet to be replied.
+        std::deque<std::string> m_reply_to;
+        // Released when destroyed so pending timers do nothing.
+        std::shared_ptr<bool> m_alive;
+
+        std::function<void(zmq::socket_t& server_socket,
+                           zmq::multipart_t& mmsg)> really_recv;
+        std::function<void(zmq::socket_t& server_socket,
+                           zmq::multipart_t& mmsg)> really_send;
+
+        void connect_to_broker();
+        void disconnect_from_broker();
+        void on_input();
+        void on_heartbeat();
+    };
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*! Generaldomo dispatch policies
+ *
+ * When a request may go to any of several waiting workers, the
+ * broker asks the dispatch policy of the service to choose one.
+ */
+
+#ifndef GENERALDOMO_DISPATCH_HPP_SEEN
+#define GENERALDOMO_DISPATCH_HPP_SEEN
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace generaldomo {
+
+    /*! What a policy knows of a worker. */
+    struct worker_info_t {
+        // Exponentially weighted moving average of the time, in
+        // seconds, the worker takes per request.  Zero if unknown.
+        double ewma{0};
+        // Number of replies the worker has given.
+        size_t served{0};
+
+        // Weight of a new measurement in the average.
+        static constexpr double weight = 0.25;
+
+        // Learn the time taken for one request.
+        void learn(double seconds);
+    };
+
+    /*! Base for a dispatch policy. */
+    class DispatchPolicy {
+    public:
+        virtual ~DispatchPolicy() {}
+
+        /// Return the index of the worker to take a request.  All
+        /// candidates may take it and are in the order they became
+        /// ready, oldest first.  There is at least one.
+        virtual size_t choose(const std::vector<const worker_info_t*>& candidates) = 0;
+    };
+
+    typedef std::function<std::unique_ptr<DispatchPolicy>()> dispatch_factory_t;
+
+    /*! Make a built-in policy by name:
+     *
+     * - fifo :: the worker waiting longest
+     * - lifo :: the worker most recently ready, whose caches are warm
+     * - ewma :: the worker with the lowest average time per request
+     * - p2c :: the faster of two workers picked at random
+     *
+     * Return nullptr if the name is unknown.
+     */
+    std::unique_ptr<DispatchPolicy> make_dispatch(const std::string& name);
+
+}
+
+#endif
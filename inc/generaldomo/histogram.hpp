@@ -0,0 +1,70 @@
+/*! Generaldomo latency histogram
+ *
+ * A histogram of integer values, eg microseconds, recorded with a
+ * fixed relative precision in the manner of HdrHistogram.  Values
+ * below 2048 are counted exactly and larger ones in buckets no wider
+ * than 1/1024 of their value, so about three significant digits are
+ * kept over the whole range at a fixed cost per record.
+ *
+ * The percentile distribution is printed in the text format of
+ * HdrHistogram so files from different runs may be diffed or given
+ * to its plotting tools.
+ */
+
+#ifndef GENERALDOMO_HISTOGRAM_HPP_SEEN
+#define GENERALDOMO_HISTOGRAM_HPP_SEEN
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace generaldomo {
+
+    class Histogram {
+    public:
+        /// Values above highest are counted as highest.
+        explicit Histogram(uint64_t highest = 3600000000);
+
+        void record(uint64_t value, uint64_t count = 1);
+
+        /// Add the counts of another histogram.
+        void add(const Histogram& other);
+
+        void reset();
+
+        uint64_t count() const { return m_count; }
+        uint64_t min() const;
+        uint64_t max() const { return m_max; }
+        double mean() const;
+        double stddev() const;
+
+        /// Return the value at or below which the percent, from 0
+        /// to 100, of recorded values lie.  It is the largest value
+        /// equivalent to that recorded.
+        uint64_t percentile(double percent) const;
+
+        /// Print the percentile distribution with values divided by
+        /// scale, eg 1000.0 to give milliseconds from microseconds.
+        /// Percentiles are reported ticks times for each halving of
+        /// the distance to 100.
+        void print(std::ostream& out, double scale = 1.0, int ticks = 5) const;
+
+        /// Print to a file, throwing if it can not be written.
+        void write(const std::string& path, double scale = 1.0, int ticks = 5) const;
+
+    private:
+        size_t index(uint64_t value) const;
+        uint64_t lowest_at(size_t index) const;
+        uint64_t highest_at(size_t index) const;
+
+        uint64_t m_highest;
+        std::vector<uint64_t> m_counts;
+        uint64_t m_count{0};
+        uint64_t m_min{UINT64_MAX};
+        uint64_t m_max{0};
+    };
+
+}
+
+#endif
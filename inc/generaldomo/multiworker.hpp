@@ -0,0 +1,109 @@
+/*! Generaldomo multi-service worker
+ *
+ * A MultiWorker offers several services over one connection to the
+ * broker.  Its READY names the first service and gives the rest in a
+ * "services" property.  The broker then keeps a proxy for each
+ * service, all sharing the one identity and heartbeat, and may give
+ * the worker one request of each service at once.  Each request and
+ * reply tells which service it is for.
+ *
+ * Handlers run on a local pool of threads, or in the thread calling
+ * poll() if there are none.  Only that thread uses the socket, so a
+ * DEALER will do.  As the socket is never left while handlers run,
+ * the worker heartbeats throughout and tells the broker so.
+ */
+
+#ifndef GENERALDOMO_MULTIWORKER_HPP_SEEN
+#define GENERALDOMO_MULTIWORKER_HPP_SEEN
+
+#include "generaldomo/worker.hpp"
+#include "generaldomo/pool.hpp"
+
+#include <map>
+
+namespace generaldomo {
+
+    class MultiWorker {
+    public:
+        /// Create a worker offering a service per handler, run by
+        /// nthreads threads.  The busy_heartbeat of config is
+        /// ignored.
+        MultiWorker(zmq::socket_t& sock, std::string broker_address,
+                    const std::map<std::string, handler_t>& handlers,
+                    logbase_t& log,
+                    const worker_config_t& config = worker_config_t{},
+                    size_t nthreads = 0);
+        ~MultiWorker();
+
+        MultiWorker(const MultiWorker&) = delete;
+        MultiWorker& operator=(const MultiWorker&) = delete;
+
+        /// Wait up to timeout, and no longer than a heartbeat, for
+        /// requests or finished replies.  Start handling the former,
+        /// send the latter and keep the connection alive.
+        void poll(time_unit_t timeout);
+
+        /// Call poll() until interrupted.
+        void run();
+
+        /// Return true unless waiting to reconnect to the broker.
+        bool connected() const { return m_connected; }
+
+        /// Return the number of requests in hand.
+        size_t busy() const { return m_busy; }
+
+    private:
+
+        struct Job {
+            std::string service;
+            std::string client;
+            // Codec to apply to the reply, if any.
+            std::string codec;
+            zmq::multipart_t body;
+            // Connection the request came on, see m_generation.
+            size_t generation{0};
+            // Why the request failed, "codec" if it could not be
+            // decoded or "handler" if the handler threw.
+            std::string error;
+        };
+
+        zmq::socket_t& m_sock;
+        std::string m_address;
+        std::map<std::string, handler_t> m_handlers;
+        logbase_t& m_log;
+        time_unit_t m_heartbeat;
+        time_unit_t m_expiry;
+        time_unit_t m_heartbeat_at{0};
+        // When the broker was last heard from.
+        time_unit_t m_heard_at{0};
+        bool m_connected{false};
+        time_unit_t m_reconnect_at{0};
+        Backoff m_backoff;
+        Compressor m_compressor;
+        // Counts connections so replies to requests from a broker
+        // given up on are dropped.
+        size_t m_generation{0};
+        size_t m_busy{0};
+
+        // The pool, if any, and its finished replies which wake
+        // poll().
+        std::unique_ptr<WakeQueue<Job>> m_done;
+        std::unique_ptr<WorkPool<Job>> m_pool;
+
+        std::function<void(zmq::socket_t& server_socket,
+                           zmq::multipart_t& mmsg)> really_recv;
+        std::function<void(zmq::socket_t& server_socket,
+                           zmq::multipart_t& mmsg)> really_send;
+
+        void connect_to_broker();
+        void disconnect_from_broker();
+        void send_heartbeat();
+        void proc_broker();
+        void handle(Job& job);
+        void send_reply(Job& job);
+        void send_replies();
+    };
+
+}
+
+#endif
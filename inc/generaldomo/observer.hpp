@@ -0,0 +1,200 @@
+/*! Generaldomo broker observers
+ *
+ * An observer is given to BasicBroker as a template parameter and is
+ * told of what the broker does: a client request accepted, queued,
+ * dispatched to a worker and replied to, a worker ready or expired
+ * and a request rejected.  It is also told of the phases of handling
+ * each message, by begin(), then mark() as each phase ends and end().
+ *
+ * Methods are called directly, not through virtual functions, and a
+ * broker with a NullObserver does not even work out their arguments.
+ * An observer may derive from NullObserver and define only those it
+ * needs.  Methods are called from the thread brokering.
+ */
+
+#ifndef GENERALDOMO_OBSERVER_HPP_SEEN
+#define GENERALDOMO_OBSERVER_HPP_SEEN
+
+#include "generaldomo/util.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace generaldomo {
+
+    /// Phases of handling a message.  Decode receives the message
+    /// and unpacks its frames, lookup finds its service or worker,
+    /// dispatch is the work of brokering it and send hands messages
+    /// to sockets.
+    enum class phase_t { decode, lookup, dispatch, send };
+    const size_t nphases = 4;
+    const char* phase_name(phase_t phase);
+
+    /*! Observes nothing. */
+    struct NullObserver {
+        /// A client request of bytes of body for a service.
+        void on_accept(const std::string& service, size_t bytes) {}
+        /// A request queued, leaving depth requests queued.
+        void on_enqueue(const std::string& service, size_t depth) {}
+        /// A request given to a worker.
+        void on_dispatch(const std::string& service,
+                         const remote_identity_t& worker) {}
+        /// A reply of bytes of body from a worker.
+        void on_reply(const std::string& service, size_t bytes) {}
+        /// A worker ready to serve.
+        void on_ready(const std::string& service,
+                      const remote_identity_t& worker) {}
+        /// A worker taken as dead as it was not heard from.
+        void on_expire(const std::string& service,
+                       const remote_identity_t& worker) {}
+        /// A request refused, eg "overload".
+        void on_reject(const std::string& service, const std::string& why) {}
+
+        /// Handling of a message begins.
+        void begin() {}
+        /// A phase of handling the message ends.
+        void mark(phase_t phase) {}
+        /// Handling of the message ends.
+        void end() {}
+    };
+
+    /*! Counts events. */
+    struct CountingObserver : public NullObserver {
+        size_t accepted{0}, enqueued{0}, dispatched{0}, replied{0};
+        size_t ready{0}, expired{0}, rejected{0};
+        // Bytes of request and reply bodies.
+        size_t bytes_in{0}, bytes_out{0};
+        // Most requests seen queued for any one service.
+        size_t max_depth{0};
+
+        void on_accept(const std::string&, size_t bytes) {
+            ++accepted;
+            bytes_in += bytes;
+        }
+        void on_enqueue(const std::string&, size_t depth) {
+            ++enqueued;
+            max_depth = std::max(max_depth, depth);
+        }
+        void on_dispatch(const std::string&, const remote_identity_t&) {
+            ++dispatched;
+        }
+        void on_reply(const std::string&, size_t bytes) {
+            ++replied;
+            bytes_out += bytes;
+        }
+        void on_ready(const std::string&, const remote_identity_t&) {
+            ++ready;
+        }
+        void on_expire(const std::string&, const remote_identity_t&) {
+            ++expired;
+        }
+        void on_reject(const std::string&, const std::string&) {
+            ++rejected;
+        }
+
+        /// Return the counts as "name=value" lines.
+        std::string summary() const;
+    };
+
+    /*! Measures the time spent in each phase of handling messages, in
+     * CPU cycles where the time stamp counter may be read, else in
+     * nanoseconds.  Time between a mark and the next goes to the
+     * phase marked and that after the last mark to dispatch. */
+    struct ProfilingObserver : public NullObserver {
+        // Messages handled.
+        size_t messages{0};
+        // Ticks spent in each phase.
+        uint64_t ticks[nphases]{0};
+
+        static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        void begin() {
+            ++messages;
+            m_last = now();
+            m_active = true;
+        }
+        void mark(phase_t phase) {
+            if (!m_active) {
+                return;         // eg a heartbeat sent
+            }
+            uint64_t t = now();
+            ticks[static_cast<size_t>(phase)] += t - m_last;
+            m_last = t;
+        }
+        void end() {
+            mark(phase_t::dispatch);
+            m_active = false;
+        }
+
+        /// Forget what was measured.
+        void reset();
+
+        /// Return a line per phase with its ticks per message and
+        /// share of the total.
+        std::string summary() const;
+
+    private:
+        uint64_t m_last{0};
+        bool m_active{false};
+    };
+
+    /*! Writes one event of every so many as a line of text giving the
+     * time in ms, the event, the service and a detail, eg a worker
+     * identity in hex. */
+    struct SamplingObserver : public NullObserver {
+        // Write one event of this many.
+        size_t every{1000};
+        // Where to write, none if null.
+        std::ostream* out{&std::clog};
+
+        void on_accept(const std::string& service, size_t bytes) {
+            if (due()) { write("accept", service, std::to_string(bytes)); }
+        }
+        void on_enqueue(const std::string& service, size_t depth) {
+            if (due()) { write("enqueue", service, std::to_string(depth)); }
+        }
+        void on_dispatch(const std::string& service,
+                         const remote_identity_t& worker) {
+            if (due()) { write("dispatch", service, worker, true); }
+        }
+        void on_reply(const std::string& service, size_t bytes) {
+            if (due()) { write("reply", service, std::to_string(bytes)); }
+        }
+        void on_ready(const std::string& service,
+                      const remote_identity_t& worker) {
+            if (due()) { write("ready", service, worker, true); }
+        }
+        void on_expire(const std::string& service,
+                       const remote_identity_t& worker) {
+            if (due()) { write("expire", service, worker, true); }
+        }
+        void on_reject(const std::string& service, const std::string& why) {
+            if (due()) { write("reject", service, why); }
+        }
+
+    private:
+        size_t m_seen{0};
+
+        bool due() { return out and every and m_seen++ % every == 0; }
+        // An identity detail is written in hex.
+        void write(const char* event, const std::string& service,
+                   const std::string& detail, bool identity = false);
+    };
+
+}
+
+#endif
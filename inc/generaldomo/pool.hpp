@@ -0,0 +1,144 @@
+/*! Generaldomo thread pool woken through a pipe
+ *
+ * The broker and the multiworker each run handlers on a pool of
+ * threads while one thread polls sockets.  A finished job is handed
+ * back through a queue which, when it goes from empty, writes to a
+ * pipe.  The read end is polled along with the sockets.
+ */
+
+#ifndef GENERALDOMO_POOL_HPP_SEEN
+#define GENERALDOMO_POOL_HPP_SEEN
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace generaldomo {
+
+    /*! A pipe written by one thread to wake another polling it. */
+    class WakePipe {
+    public:
+        /// Throws std::runtime_error if the pipe can not be made.
+        WakePipe();
+        ~WakePipe();
+
+        WakePipe(const WakePipe&) = delete;
+        WakePipe& operator=(const WakePipe&) = delete;
+
+        /// Return the end to poll.
+        int fd() const { return m_fds[0]; }
+
+        /// Make fd() readable.  This never blocks.
+        void wake();
+
+        /// Read all that was written.
+        void drain();
+
+    private:
+        int m_fds[2]{-1, -1};
+    };
+
+    /*! Items given by any thread to the one polling fd(). */
+    template<class Item>
+    class WakeQueue {
+    public:
+        int fd() const { return m_pipe.fd(); }
+
+        /// Add an item, waking the poller if there were none.
+        void push(Item item) {
+            bool wake = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                wake = m_items.empty();
+                m_items.push_back(std::move(item));
+            }
+            if (wake) {
+                m_pipe.wake();
+            }
+        }
+
+        /// Take all the items.
+        std::deque<Item> take() {
+            m_pipe.drain();
+            std::deque<Item> items;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            items.swap(m_items);
+            return items;
+        }
+
+    private:
+        WakePipe m_pipe;
+        std::mutex m_mutex;
+        std::deque<Item> m_items;
+    };
+
+    /*! Threads which do the work of each job given and then push it
+     * to a queue of those done.  Jobs not started when destroyed are
+     * dropped. */
+    template<class Job>
+    class WorkPool {
+    public:
+        typedef std::function<void(Job& job)> work_t;
+
+        WorkPool(size_t nthreads, work_t work, WakeQueue<Job>& done)
+            : m_work(work), m_done(done) {
+            for (size_t ind=0; ind<nthreads; ++ind) {
+                m_threads.emplace_back(&WorkPool::run, this);
+            }
+        }
+        ~WorkPool() {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_cv.notify_all();
+            for (auto& thread : m_threads) {
+                thread.join();
+            }
+        }
+
+        WorkPool(const WorkPool&) = delete;
+        WorkPool& operator=(const WorkPool&) = delete;
+
+        /// Give a job to the next free thread.
+        void push(Job job) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_jobs.push_back(std::move(job));
+            }
+            m_cv.notify_one();
+        }
+
+    private:
+        work_t m_work;
+        WakeQueue<Job>& m_done;
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::deque<Job> m_jobs;
+        bool m_stop{false};
+
+        void run() {
+            while (true) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cv.wait(lock, [this]() { return m_stop or m_jobs.size(); });
+                    if (m_stop) {
+                        return;
+                    }
+                    job = std::move(m_jobs.front());
+                    m_jobs.pop_front();
+                }
+                m_work(job);
+                m_done.push(std::move(job));
+            }
+        }
+    };
+
+}
+
+#endif
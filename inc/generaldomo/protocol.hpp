@@ -1,6 +1,6 @@
 /*! Generaldomo protocol 
  *
- * This header holds 7/MDP constants.
+ * This header holds 7/MDP constants and those of the GDP extensions.
  */
 
 #ifndef GENERALDOMO_PROTOCOL_HPP_SEEN
@@ -26,6 +26,84 @@ namespace generaldomo {
             inline const char* disconnect = "\005";
         }
     }
+
+    // GDP extensions to 7/MDP.  An extended peer carries a frame of
+    // encoded properties (see util.hpp).  For the worker this frame
+    // is "Frame 4" of REQUEST and REPLY (empty in 7/MDP) and an
+    // optional "Frame 4" of READY.  The broker only sends a non-empty
+    // Frame 4 to a worker which gave properties in its READY.  For
+    // the client, a different header is used and the properties ride
+    // in Frame 3 of both request and reply, before the body.
+    namespace gdp {
+        namespace client {
+            // Identify the extended client sub-protocol.
+            inline const char* ident = "GDPC01";
+        }
+        namespace prop {
+            // Comma separated list of codecs the sender can decode.
+            inline const char* accept = "accept";
+            // Codec applied to body frames.
+            inline const char* codec = "codec";
+            // One '0' or '1' per body frame telling if it is coded.
+            inline const char* coded = "coded";
+            // Number of requests or replies packed in a batch body,
+            // one per frame as an encoded multipart.  In a worker
+            // READY, any value tells the worker takes batches.
+            inline const char* batch = "batch";
+            // In a worker READY, any value tells that replies depend
+            // only on the request so the broker may cache them.
+            inline const char* idempotent = "idempotent";
+            // Opaque request identifier chosen by a client.  The
+            // broker gives it back in the reply.
+            inline const char* id = "id";
+            // Time, as milliseconds since the Unix epoch, after which
+            // the client no longer wants the reply.  Peers must have
+            // reasonably synchronized clocks.
+            inline const char* deadline = "deadline";
+            // Why the broker replies with no body instead of a reply
+            // from a worker, eg "poison".
+            inline const char* error = "error";
+            // In a worker READY, the worker's heartbeat interval in
+            // milliseconds, telling it also heartbeats while busy.
+            inline const char* heartbeat = "heartbeat";
+            // In a request, the number of workers of the service to
+            // give a copy to, "0" for all of them.  The broker
+            // replies with one encoded reply per frame, as a batch,
+            // and the number of them in the same property.
+            inline const char* broadcast = "broadcast";
+            // With broadcast, milliseconds to gather replies before
+            // replying with those which came.
+            inline const char* wait = "wait";
+            // In a request, comma separated names of services to
+            // which the broker gives each reply in turn as their
+            // request.  The client gets the reply of the last, or
+            // the first with an error.
+            inline const char* pipeline = "pipeline";
+            // In a worker READY, comma separated names of services
+            // the worker offers beyond that named in the READY.
+            inline const char* services = "services";
+            // In a REQUEST to and REPLY from a worker offering
+            // several services, the service it is for.
+            inline const char* service = "service";
+            // In a request, an identifier chosen by the client for a
+            // request sent as a sequence of chunks.  The first chunk
+            // is dispatched as a request and each further one goes
+            // to the same worker as it comes.  In a worker READY,
+            // any value tells the worker takes such transfers.
+            inline const char* transfer = "transfer";
+            // With transfer, the number of the chunk from zero.
+            inline const char* chunk = "chunk";
+            // With transfer, any value marks the last chunk.
+            inline const char* last = "last";
+            // With the first chunk, the most chunks the client sends
+            // before it is granted credit for more.
+            inline const char* window = "window";
+            // In a REPLY to a chunk, passed on to the client, the
+            // number of further chunks the worker grants.  The
+            // worker keeps the request until its real REPLY.
+            inline const char* credit = "credit";
+        }
+    }
 }
 
 #endif
@@ -0,0 +1,47 @@
+/*! Generaldomo spill file
+ *
+ * When queued request bodies exceed the broker memory budget, those
+ * at the back of a queue are written to a spill file and read back
+ * as they reach the front.  The file is an append-only segment which
+ * is emptied once nothing in it is wanted.  It is unlinked when made
+ * so nothing is left behind.
+ */
+
+#ifndef GENERALDOMO_SPILL_HPP_SEEN
+#define GENERALDOMO_SPILL_HPP_SEEN
+
+#include "generaldomo/util.hpp"
+
+namespace generaldomo {
+
+    class SpillFile {
+    public:
+        /// Make the file in the directory, or if empty in TMPDIR or
+        /// /tmp.  Throws if it can not be made.
+        explicit SpillFile(const std::string& dir = "");
+        ~SpillFile();
+
+        SpillFile(const SpillFile&) = delete;
+        SpillFile& operator=(const SpillFile&) = delete;
+
+        /// Append the message and return its offset.  Throws if it
+        /// can not be written.
+        size_t write(const zmq::message_t& msg);
+
+        /// Read back a message of size at offset.
+        zmq::message_t read(size_t offset, size_t size) const;
+
+        /// Forget all that was written.
+        void clear();
+
+        /// Return the bytes written since made or cleared.
+        size_t size() const { return m_end; }
+
+    private:
+        int m_fd{-1};
+        size_t m_end{0};
+    };
+
+}
+
+#endif
@@ -3,7 +3,9 @@
 
 #include <zmq_addon.hpp>
 
+#include <functional>
 #include <string>
+#include <map>
 
 namespace generaldomo {
 
@@ -24,6 +26,36 @@ namespace generaldomo {
     typedef std::string remote_identity_t;
 
 
+    // A handler of a service, in the broker or in a worker.  It is
+    // given a request body, 7/MDP Frames 3+, and returns the reply
+    // body.
+    typedef std::function<zmq::multipart_t(zmq::multipart_t& request)> handler_t;
+
+
+    // GDP extension properties.  These ride in one frame of an
+    // extended message as an encoded multipart of alternating key
+    // and value frames.  See protocol.hpp for the known keys.
+    typedef std::map<std::string, std::string> properties_t;
+
+    // Encode properties to a single frame.  Empty properties give an
+    // empty frame so that an extended peer is indistinguishable from
+    // a 7/MDP one when it has nothing to say.
+    zmq::message_t encode_properties(const properties_t& props);
+
+    // Decode a frame made by encode_properties().
+    properties_t decode_properties(const zmq::message_t& frame);
+
+    // Split a comma separated list, eg of codec names.
+    std::vector<std::string> split_list(const std::string& list);
+
+    // Make a comma separated list, the inverse of split_list().
+    std::string join_list(const std::vector<std::string>& items);
+
+    // Return a message holding frames which share data with those of
+    // mmsg.  No data is copied.
+    zmq::multipart_t share_frames(zmq::multipart_t& mmsg);
+
+
     // Receive on a ROUTER or SERVER
     remote_identity_t recv_serverish(zmq::socket_t& socket,
                                      zmq::multipart_t& mmsg);
@@ -82,6 +114,15 @@ namespace generaldomo {
     /*! Current system time in milliseconds. */
     std::chrono::milliseconds now_ms();
 
+    /*! Milliseconds since the Unix epoch as from now_ms() but read
+     * from a monotonic clock, which is set against the system clock
+     * once.  It does not jump if the system clock is set. */
+    std::chrono::milliseconds mono_ms();
+
+    /*! Pin the calling thread to the given CPUs.  Throws if it can
+     * not be done. */
+    void pin_thread(const std::vector<int>& cpus);
+
     /*! Sleep a while */
     void sleep_ms(std::chrono::milliseconds zzz);
 
@@ -3,9 +3,32 @@
 
 #include "generaldomo/util.hpp"
 #include "generaldomo/logging.hpp"
+#include "generaldomo/compress.hpp"
+#include "generaldomo/backoff.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace generaldomo {
 
+    /*! Configuration of a worker.  See config.hpp to load it. */
+    struct worker_config_t {
+        // Interval between heartbeats to the broker.
+        time_unit_t heartbeat{HEARTBEAT_INTERVAL};
+        // Heartbeats from the broker which may be missed before the
+        // worker reconnects.
+        int liveness{HEARTBEAT_LIVENESS};
+        backoff_t backoff{};
+        compression_t compression{};
+        // Heartbeat from a background thread while busy.
+        bool busy_heartbeat{false};
+        // Take requests sent in chunks, see recv_chunk().
+        bool transfer{false};
+    };
+
     /*! The generaldomo worker API
      *
      * Applications may use a Worker to simplify participating in the
@@ -16,6 +39,28 @@ namespace generaldomo {
      * corresponding to what is in use by the broker but otherwise,
      * differences related to the socket type are subsequently erased
      * by this class.
+     *
+     * If a compression policy is given, the worker tells the broker
+     * in its READY which codecs it accepts, decodes request bodies
+     * and codes reply bodies for clients which accept a codec.
+     *
+     * If busy_heartbeat is true, a background thread heartbeats
+     * while the application holds a request, so a long handler does
+     * not leave the broker thinking the worker is dead, and the
+     * worker tells the broker in its READY that it does so.  This
+     * requires a thread-safe CLIENT socket.
+     *
+     * If transfer is true, a request too large to hold whole may
+     * come in chunks.  The first is given by recv() and, while
+     * streaming() is true, the rest by recv_chunk(), which grants
+     * the client credit to send one more as each is taken.  At most
+     * the client's window of chunks are thus queued between it and
+     * the worker.
+     *
+     * When the broker goes quiet for a number of heartbeats,
+     * or tells the worker to disconnect, the worker disconnects and
+     * reconnects after a backoff.  Nothing sleeps: recv() simply
+     * waits no longer than until the reconnect is due.
      */
 
     class Worker {
@@ -23,7 +68,12 @@ namespace generaldomo {
         /// Create a worker providing service.  Caller keeps socket eg
         /// so to poll it along with others.
         Worker(zmq::socket_t& sock, std::string broker_address,
-               std::string service, logbase_t& log);
+               std::string service, logbase_t& log,
+               const compression_t& compression = compression_t{},
+               bool busy_heartbeat = false);
+        Worker(zmq::socket_t& sock, std::string broker_address,
+               std::string service, logbase_t& log,
+               const worker_config_t& config);
         ~Worker();
 
         // API methods
@@ -42,24 +92,105 @@ namespace generaldomo {
         /// request empty.  If the request is not empty a subsequent
         /// send() shall be made.        
         void recv(zmq::multipart_t& request);
+
+        /// Set how long to wait before reconnecting to the broker.
+        void set_backoff(const backoff_t& backoff) { m_backoff = Backoff(backoff); }
+
+        /// Return true unless waiting to reconnect to the broker.
+        bool connected() const { return m_connected; }
         /// Send a reply.  A reply must only be sent in response to a
         /// request.  Note, unlike using work() it is not required,
         /// but still allowed, to send an initial empty reply.
         /// Empties will simply be ignored.
         void send(zmq::multipart_t& reply);
 
+        /// Return true if requests of a batch remain, in which case
+        /// recv() returns one without waiting.  When a batch arrives
+        /// recv() and send() pass its requests one at a time and the
+        /// replies are sent back together after the last send().
+        bool pending() const { return !m_batch_in.empty(); }
+
+        /// As work() but handle a whole batch at a time.  Replies
+        /// must be given in order, one per request.  A request which
+        /// was not sent in a batch is given as a batch of one.
+        std::vector<zmq::multipart_t>
+        work_batch(std::vector<zmq::multipart_t>& replies);
+
+        /// Receive a batch of requests.  As recv(), this may return
+        /// leaving requests empty.
+        void recv_batch(std::vector<zmq::multipart_t>& requests);
+
+        /// Send the replies to the last batch of requests.
+        void send_batch(std::vector<zmq::multipart_t>& replies);
+
+        /// Return true if the request in hand is a chunk of a
+        /// transfer and more are to come.
+        bool streaming() const { return m_transfer.size() and !m_transfer_last; }
+
+        /// Receive the next chunk of the request in hand, first
+        /// granting credit for the one given before.  This waits for
+        /// the chunk unless the broker is lost.  Return false,
+        /// leaving chunk empty, if no more are to come or the
+        /// transfer failed, in which case the reply sent is dropped.
+        /// Another request coming instead is kept for the next recv().
+        bool recv_chunk(zmq::multipart_t& chunk);
+
+        /// Return the time left before the client gives up on the
+        /// request (or batch) in hand, zero if it already has.  If
+        /// the client gave no deadline, return time_unit_t::max().  A
+        /// handler may use this to bail out early.
+        time_unit_t remaining() const;
+
 
     private:
         zmq::socket_t& m_sock;
         std::string m_address;
         std::string m_service;
         logbase_t& m_log;
+        int m_liveness_max{HEARTBEAT_LIVENESS};
         int m_liveness{HEARTBEAT_LIVENESS};
         time_unit_t m_heartbeat{HEARTBEAT_INTERVAL};
-        time_unit_t m_reconnect{HEARTBEAT_INTERVAL};
         time_unit_t m_heartbeat_at{0};
+        // False while waiting until m_reconnect_at to reconnect.
+        bool m_connected{false};
+        time_unit_t m_reconnect_at{0};
+        Backoff m_backoff;
         bool m_expect_reply{false};
         std::string m_reply_to{""};
+        Compressor m_compressor;
+        // Codec to apply to the reply to the current request, if any.
+        std::string m_reply_codec{""};
+        // Size of current batch, 0 if not a batch, the number of its
+        // requests given to the application, those yet to be and
+        // encoded replies collected so far.
+        size_t m_batch_size{0};
+        size_t m_batch_given{0};
+        std::deque<zmq::multipart_t> m_batch_in;
+        zmq::multipart_t m_batch_out;
+        // Deadline of the current request, zero if none.
+        time_unit_t m_deadline{0};
+        // Transfer of the request in hand, empty if not in chunks,
+        // and if its last chunk was given or it failed.
+        std::string m_transfer{""};
+        bool m_transfer_last{true};
+        bool m_transfer_failed{false};
+        // A request which came in the middle of a transfer, as
+        // received from frame 3 on, for the next recv().
+        zmq::multipart_t m_held;
+        // The request in hand could not be decoded and its client
+        // was told, the reply to it is dropped.
+        bool m_answered{false};
+
+        // Tell the broker we take transfers.
+        bool m_take_transfer{false};
+
+        // The background heartbeat agent, if any, runs while busy.
+        bool m_busy_heartbeat{false};
+        std::thread m_agent;
+        std::mutex m_agent_mutex;
+        std::condition_variable m_agent_cv;
+        bool m_agent_busy{false};
+        bool m_agent_stop{false};
 
     private:
 
@@ -68,7 +199,16 @@ namespace generaldomo {
         std::function<void(zmq::socket_t& server_socket,
                            zmq::multipart_t& mmsg)> really_send;
 
-        void connect_to_broker(bool reconnect = true);
+        void connect_to_broker();
+        void disconnect_from_broker();
+        bool recv_request(zmq::multipart_t& request);
+        bool wait_request(zmq::multipart_t& request);
+        bool take_request(zmq::multipart_t& mmsg, zmq::multipart_t& request);
+        void send_reply(zmq::multipart_t& reply, properties_t& props);
+        void send_heartbeat();
+        void send_credit();
+        void set_busy(bool busy);
+        void heartbeat_agent();
 
     };
 
@@ -1,4 +1,55 @@
+import os
+import shlex
+import subprocess
+
 import setuptools
+from setuptools.command.build_ext import build_ext
+
+
+def native_extension():
+    '''
+    Return the extension wrapping the C++ library or None.
+
+    Compiler and linker flags come from pkg-config for an installed
+    libgeneraldomo, which may be found under GENERALDOMO_PREFIX.  Set
+    GENERALDOMO_PURE to not try.
+    '''
+    if os.environ.get("GENERALDOMO_PURE"):
+        return None
+    env = dict(os.environ)
+    prefix = os.environ.get("GENERALDOMO_PREFIX")
+    if prefix:
+        pcpath = os.path.join(prefix, "lib", "pkgconfig")
+        env["PKG_CONFIG_PATH"] = ":".join(filter(None, [pcpath, env.get("PKG_CONFIG_PATH")]))
+    try:
+        flags = subprocess.run(["pkg-config", "--cflags", "--libs", "libgeneraldomo"],
+                               env=env, capture_output=True, check=True, text=True)
+    except (OSError, subprocess.CalledProcessError):
+        print("generaldomo: libgeneraldomo not found, native module not built")
+        return None
+    flags = shlex.split(flags.stdout)
+    return setuptools.Extension(
+        "generaldomo._native",
+        sources=["generaldomo/_native.cpp"],
+        language="c++",
+        extra_compile_args=["-std=c++17", "-O2", "-DZMQ_BUILD_DRAFT_API"]
+        + [f for f in flags if not f.startswith("-l") and not f.startswith("-L")],
+        extra_link_args=[f for f in flags if f.startswith("-l") or f.startswith("-L")]
+        + ["-Wl,-rpath," + f[2:] for f in flags if f.startswith("-L")])
+
+
+class optional_build_ext(build_ext):
+    '''
+    Build the native module if possible, else go without it.
+    '''
+    def build_extension(self, ext):
+        try:
+            super().build_extension(ext)
+        except Exception as err:
+            print(f"generaldomo: native module not built: {err}")
+
+
+ext = native_extension()
 
 setuptools.setup(
     name="generaldomo",
@@ -13,6 +64,8 @@ setuptools.setup(
         "click",
         "pyzmq",
      ],
+    ext_modules = [ext] if ext else [],
+    cmdclass = dict(build_ext=optional_build_ext),
     entry_points = dict(
         console_scripts = [
             'generaldomo = generaldomo.__main__:main',
@@ -0,0 +1,20 @@
+#include "generaldomo/backoff.hpp"
+
+#include <algorithm>
+
+using namespace generaldomo;
+
+Backoff::Backoff(const backoff_t& policy)
+    : m_policy(policy)
+    , m_rng(std::random_device{}())
+{
+}
+
+time_unit_t Backoff::next()
+{
+    const auto lo = m_policy.base.count();
+    const auto hi = std::max(lo, 3 * std::max(m_last.count(), lo));
+    std::uniform_int_distribution<time_unit_t::rep> uni(lo, hi);
+    m_last = std::min(m_policy.cap, time_unit_t{uni(m_rng)});
+    return m_last;
+}
@@ -0,0 +1,141 @@
+#include "generaldomo/cache.hpp"
+
+#include <cstring>
+
+using namespace generaldomo;
+
+static const uint64_t fnv_prime = 1099511628211ULL;
+
+static uint64_t fnv1a(const void* data, size_t size, uint64_t hash)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t ind=0; ind<size; ++ind) {
+        hash ^= bytes[ind];
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+uint64_t generaldomo::hash_frames(const zmq::multipart_t& mmsg, uint64_t seed)
+{
+    uint64_t hash = seed;
+    for (const auto& msg : mmsg) {
+        uint64_t size = msg.size();
+        hash = fnv1a(&size, sizeof(size), hash);
+        hash = fnv1a(msg.data(), msg.size(), hash);
+    }
+    return hash;
+}
+
+uint64_t generaldomo::hash_string(const std::string& str, uint64_t seed)
+{
+    uint64_t size = str.size();
+    uint64_t hash = fnv1a(&size, sizeof(size), seed);
+    return fnv1a(str.data(), str.size(), hash);
+}
+
+bool generaldomo::same_frames(const zmq::multipart_t& one, const zmq::multipart_t& two)
+{
+    if (one.size() != two.size()) {
+        return false;
+    }
+    auto it = two.begin();
+    for (const auto& msg : one) {
+        if (msg.size() != it->size()
+            or memcmp(msg.data(), it->data(), msg.size()) != 0) {
+            return false;
+        }
+        ++it;
+    }
+    return true;
+}
+
+static size_t frames_bytes(const zmq::multipart_t& mmsg)
+{
+    size_t bytes = 0;
+    for (const auto& msg : mmsg) {
+        bytes += msg.size();
+    }
+    return bytes;
+}
+
+
+ReplyCache::ReplyCache(time_unit_t ttl, size_t max_bytes)
+    : m_ttl(ttl)
+    , m_max_bytes(max_bytes)
+{
+}
+
+void ReplyCache::limit(time_unit_t ttl, size_t max_bytes)
+{
+    m_ttl = ttl;
+    m_max_bytes = max_bytes;
+    evict();
+}
+
+bool ReplyCache::get(key_t key, const zmq::multipart_t& request, time_unit_t now,
+                     properties_t& props, zmq::multipart_t& body)
+{
+    auto it = m_index.find(key);
+    if (it == m_index.end() or !same_frames(it->second->request, request)) {
+        ++m_stats.misses;
+        return false;
+    }
+    if (it->second->expiry <= now) {
+        ++m_stats.expired;
+        ++m_stats.misses;
+        erase(it->second);
+        return false;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    Entry& ent = m_lru.front();
+    props = ent.props;
+    body = share_frames(ent.body);
+    ++m_stats.hits;
+    return true;
+}
+
+void ReplyCache::put(key_t key, zmq::multipart_t& request, time_unit_t now,
+                     const properties_t& props, zmq::multipart_t& body)
+{
+    invalidate(key);
+    size_t bytes = frames_bytes(body) + frames_bytes(request);
+    if (bytes > m_max_bytes) {
+        return;
+    }
+    m_lru.push_front(Entry{key, now + m_ttl, bytes, props, share_frames(body),
+                           share_frames(request)});
+    m_index[key] = m_lru.begin();
+    m_bytes += bytes;
+    evict();
+}
+
+void ReplyCache::invalidate(key_t key)
+{
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        erase(it->second);
+    }
+}
+
+void ReplyCache::invalidate()
+{
+    m_lru.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+void ReplyCache::erase(lru_t::iterator it)
+{
+    m_bytes -= it->bytes;
+    m_index.erase(it->key);
+    m_lru.erase(it);
+}
+
+void ReplyCache::evict()
+{
+    while (m_bytes > m_max_bytes and !m_lru.empty()) {
+        ++m_stats.evictions;
+        erase(std::prev(m_lru.end()));
+    }
+}
@@ -1,13 +1,18 @@
 #include "generaldomo/client.hpp"
 #include "generaldomo/protocol.hpp"
 
+#include <algorithm>
+
 using namespace generaldomo;
 
 Client::Client(zmq::socket_t& sock, std::string broker_address,
-               logbase_t& log)
+               logbase_t& log, const compression_t& compression,
+               const hedging_t& hedging)
     : m_sock(sock)
     , m_address(broker_address)
     , m_log(log)
+    , m_compressor(compression)
+    , m_hedging(hedging)
 {
     int stype = m_sock.getsockopt<int>(ZMQ_TYPE);
     if (ZMQ_CLIENT == stype) {
@@ -22,53 +27,378 @@ Client::Client(zmq::socket_t& sock, std::string broker_address,
         throw std::runtime_error("client must be given DEALER or CLIENT socket");
     }
 
-    connect_to_broker(false);
+    int linger=0;
+    m_sock.setsockopt(ZMQ_LINGER, linger);
+    connect_to_broker();
+}
+
+Client::Client(zmq::socket_t& sock, std::string broker_address,
+               logbase_t& log, const client_config_t& config)
+    : Client(sock, broker_address, log, config.compression, config.hedging)
+{
+    set_timeout(config.timeout, config.deadline);
+    set_backoff(config.backoff);
+    set_liveness(config.liveness);
+    set_window(config.window);
 }
 
 
 Client::~Client() { } 
 
-void Client::connect_to_broker(bool reconnect)
+void Client::connect_to_broker()
 {
-    if (reconnect) {
-        m_sock.disconnect(m_address);
-    }
-
-    int linger=0;
-    m_sock.setsockopt(ZMQ_LINGER, linger);
     // set socket routing ID?
     m_sock.connect(m_address);
+    m_connected = true;
     m_log.debug("client connect to " + m_address);
+    for (auto& mmsg : m_held) {
+        really_send(m_sock, mmsg);
+    }
+    m_held.clear();
+}
+
+void Client::disconnect_from_broker()
+{
+    m_log.debug("client disconnect from " + m_address);
+    m_sock.disconnect(m_address);
+    m_connected = false;
+    m_reconnect_at = now_ms() + m_backoff.next();
+}
+
+void Client::send_message(zmq::multipart_t& mmsg)
+{
+    if (!m_connected and now_ms() >= m_reconnect_at) {
+        connect_to_broker();
+    }
+    if (m_connected) {
+        really_send(m_sock, mmsg);
+    }
+    else {
+        m_held.emplace_back(std::move(mmsg));
+    }
 }
 
 
 void Client::send(std::string service, zmq::multipart_t& request)
 {
+    if (m_compressor.enabled() or m_hedging.enabled() or m_deadline) {
+        properties_t props;
+        send_extended(service, request, props);
+        return;
+    }
     request.pushstr(service);            // frame 2
     request.pushstr(mdp::client::ident); // frame 1
     m_log.debug("client send request for " + service);
-    really_send(m_sock, request);
+    send_message(request);
 }
 
+void Client::send_batch(std::string service,
+                        std::vector<zmq::multipart_t>& requests)
+{
+    if (requests.empty()) {
+        throw std::runtime_error("client batch needs a request");
+    }
+    zmq::multipart_t body;
+    for (auto& one : requests) {
+        body.add(one.encode());
+        one.clear();
+    }
+    properties_t props;
+    props[gdp::prop::batch] = std::to_string(body.size());
+    send_extended(service, body, props);
+}
+
+void Client::send_broadcast(std::string service, zmq::multipart_t& request,
+                            size_t quorum, time_unit_t wait)
+{
+    properties_t props;
+    props[gdp::prop::broadcast] = std::to_string(quorum);
+    if (wait.count()) {
+        props[gdp::prop::wait] = std::to_string(wait.count());
+    }
+    zmq::multipart_t body = std::move(request);
+    send_extended(service, body, props);
+}
+
+void Client::send_pipeline(const std::vector<std::string>& services,
+                           zmq::multipart_t& request)
+{
+    if (services.empty()) {
+        throw std::runtime_error("client pipeline needs a service");
+    }
+    properties_t props;
+    std::vector<std::string> rest(services.begin() + 1, services.end());
+    if (rest.size()) {
+        props[gdp::prop::pipeline] = join_list(rest);
+    }
+    zmq::multipart_t body = std::move(request);
+    send_extended(services.front(), body, props);
+}
+
+bool Client::send_chunk(std::string service, zmq::multipart_t& chunk, bool last)
+{
+    if (!m_sending) {
+        m_transfer = std::to_string(++m_next_id);
+        m_sending = true;
+        m_chunk = 0;
+        m_credit = m_window;
+        m_early = false;
+    }
+    while (!m_credit) {
+        zmq::multipart_t reply;
+        properties_t props;
+        m_want_credit = true;
+        recv_extended(reply, props);
+        m_want_credit = false;
+        auto cit = props.find(gdp::prop::credit);
+        if (cit != props.end()) {
+            m_credit += std::strtoul(cit->second.c_str(), nullptr, 10);
+            continue;
+        }
+        // Failed, timed out or replied to before all was sent.
+        if (props.size()) {
+            m_early = true;
+            m_early_reply = std::move(reply);
+            m_early_props = std::move(props);
+        }
+        m_sending = false;
+        chunk.clear();
+        return false;
+    }
+
+    properties_t props;
+    props[gdp::prop::transfer] = m_transfer;
+    props[gdp::prop::chunk] = std::to_string(m_chunk);
+    if (m_chunk == 0) {
+        props[gdp::prop::window] = std::to_string(m_window);
+    }
+    if (last) {
+        props[gdp::prop::last] = "1";
+        m_sending = false;
+    }
+    ++m_chunk;
+    --m_credit;
+    zmq::multipart_t body = std::move(chunk);
+    send_copy(service, body, props);
+    return true;
+}
+
+void Client::set_timeout(time_unit_t timeout, bool deadline)
+{
+    m_timeout = timeout;
+    m_deadline = deadline;
+}
+
+void Client::send_extended(const std::string& service,
+                           zmq::multipart_t& request, properties_t& props)
+{
+    const time_unit_t now = now_ms();
+    if (m_deadline) {
+        props[gdp::prop::deadline] = std::to_string((now + m_timeout).count());
+    }
+    if (m_hedging.enabled()) {
+        // Keep what is needed to send the request again.
+        m_service = service;
+        m_request = share_frames(request);
+        m_request_props = props;
+        m_ids.clear();
+        m_sent_at = now;
+        m_hedge_credit = std::min(m_hedging.burst,
+                                  m_hedge_credit + m_hedging.budget);
+        ++m_hedge_stats.requests;
+        props[gdp::prop::id] = next_id();
+    }
+    send_copy(service, request, props);
+}
+
+void Client::send_copy(const std::string& service,
+                       zmq::multipart_t& request, properties_t& props)
+{
+    if (m_compressor.enabled()) {
+        props[gdp::prop::accept] = m_compressor.accept();
+        m_compressor.compress(request, props,
+                              m_compressor.choose(m_accept[service]));
+    }
+    request.push(encode_properties(props)); // frame 3
+    request.pushstr(service);               // frame 2
+    request.pushstr(gdp::client::ident);    // frame 1
+    m_log.debug("client send extended request for " + service);
+    send_message(request);
+}
 
 
 void Client::recv(zmq::multipart_t& reply)
 {
+    properties_t props;
+    recv_extended(reply, props);
+}
+
+void Client::recv_batch(std::vector<zmq::multipart_t>& replies)
+{
+    replies.clear();
+    zmq::multipart_t mmsg;
+    properties_t props;
+    recv_extended(mmsg, props);
+    if (props.find(gdp::prop::batch) == props.end()) {
+        if (mmsg.size()) {
+            m_log.error("client expected batch reply");
+        }
+        return;
+    }
+    while (!mmsg.empty()) {
+        zmq::multipart_t one;
+        one.decode(mmsg.pop());
+        replies.emplace_back(std::move(one));
+    }
+}
+
+void Client::recv_broadcast(std::vector<zmq::multipart_t>& replies)
+{
+    replies.clear();
+    zmq::multipart_t mmsg;
+    properties_t props;
+    recv_extended(mmsg, props);
+    if (props.find(gdp::prop::broadcast) == props.end()) {
+        if (mmsg.size()) {
+            m_log.error("client expected broadcast reply");
+        }
+        return;
+    }
+    while (!mmsg.empty()) {
+        zmq::multipart_t one;
+        one.decode(mmsg.pop());
+        replies.emplace_back(std::move(one));
+    }
+}
+
+void Client::recv_extended(zmq::multipart_t& reply, properties_t& props)
+{
+    if (m_early) {
+        m_early = false;
+        reply = std::move(m_early_reply);
+        props = std::move(m_early_props);
+        return;
+    }
+
     zmq::poller_t<> poller;
     poller.add(m_sock, zmq::event_flags::pollin);
-        
-    std::vector< zmq::poller_event<> > events(1);
-    int rc = poller.wait_all(events, m_timeout);
-    if (rc > 0) {           // got one
-        zmq::multipart_t mmsg;
-        really_recv(m_sock, mmsg);
-
-        std::string header = mmsg.popstr();
-        assert(header == mdp::client::ident);
-            
-        std::string service = mmsg.popstr();
-        reply = std::move(mmsg);
-        return;                 // success
+
+    const bool hedging = m_hedging.enabled() and m_ids.size();
+    const time_unit_t start = hedging ? m_sent_at : now_ms();
+    const time_unit_t give_up = start + m_timeout;
+    time_unit_t hedge_at = hedging ? start + hedge_delay() : give_up;
+
+    while (true) {
+        time_unit_t now = now_ms();
+        time_unit_t until = give_up;
+        if (m_ids.size() == 1 and hedge_at < until) {
+            until = hedge_at;
+        }
+        if (!m_connected) {
+            if (now >= m_reconnect_at) {
+                connect_to_broker();
+            }
+            else {
+                until = std::min(until, m_reconnect_at);
+            }
+        }
+        time_unit_t timeout{0};
+        if (until > now) {
+            timeout = until - now;
+        }
+
+        std::vector< zmq::poller_event<> > events(1);
+        int rc = poller.wait_all(events, timeout);
+        if (rc > 0) {           // got one
+            zmq::multipart_t mmsg;
+            really_recv(m_sock, mmsg);
+            if (!m_connected) {
+                continue;       // left from before the timeout
+            }
+            m_backoff.reset();
+            m_timeouts = 0;
+
+            std::string header = mmsg.popstr();
+            std::string service = mmsg.popstr();
+            properties_t rprops;
+            if (header == gdp::client::ident) {
+                rprops = decode_properties(mmsg.pop());
+            }
+            else {
+                assert(header == mdp::client::ident);
+            }
+            auto cit = rprops.find(gdp::prop::credit);
+            if (cit != rprops.end()) {
+                // Credit is only wanted while sending a transfer.
+                if (m_want_credit and rprops[gdp::prop::transfer] == m_transfer) {
+                    props = std::move(rprops);
+                    reply.clear();
+                    return;
+                }
+                m_log.debug("client drop credit");
+                continue;
+            }
+            if (hedging) {
+                // Only a reply to a copy of this request will do.
+                auto iit = rprops.find(gdp::prop::id);
+                auto wit = m_ids.end();
+                if (iit != rprops.end()) {
+                    wit = std::find(m_ids.begin(), m_ids.end(), iit->second);
+                }
+                if (wit == m_ids.end()) {
+                    m_log.debug("client drop stale reply");
+                    continue;
+                }
+                if (wit != m_ids.begin()) {
+                    ++m_hedge_stats.won;
+                }
+                m_latency.push_back(now_ms() - start);
+                if (m_latency.size() > m_hedging.window) {
+                    m_latency.pop_front();
+                }
+                cancel_except(*wit);
+                rprops.erase(iit);
+            }
+            auto eit = rprops.find(gdp::prop::error);
+            if (eit != rprops.end()) {
+                m_log.error("client request failed: " + eit->second);
+                mmsg.clear();
+            }
+            auto ait = rprops.find(gdp::prop::accept);
+            if (ait != rprops.end()) {
+                m_accept[service] = ait->second;
+            }
+            try {
+                m_compressor.decompress(mmsg, rprops);
+            }
+            catch (const std::exception& err) {
+                m_log.error(std::string("client can not decode reply: ") + err.what());
+                rprops[gdp::prop::error] = "codec";
+                mmsg.clear();
+            }
+            props = std::move(rprops);
+            reply = std::move(mmsg);
+            return;                 // success
+        }
+        if (interrupted()) {
+            break;
+        }
+        now = now_ms();
+        if (now >= give_up) {
+            break;
+        }
+        if (m_ids.size() == 1 and now >= hedge_at) {
+            if (m_hedge_credit >= 1) {
+                m_hedge_credit -= 1;
+                ++m_hedge_stats.hedged;
+                m_log.debug("client send hedge for " + m_service);
+                send_hedge();
+            }
+            else {
+                ++m_hedge_stats.refused;
+                hedge_at = give_up;
+            }
+        }
     }
     if ( interrupted() ) {
         m_log.error("client interupted on recv");
@@ -76,8 +406,64 @@ void Client::recv(zmq::multipart_t& reply)
     else {
         m_log.error("client timeout");
     }
+    if (hedging) {
+        cancel_except("");
+    }
+    // A slow reply is not a lost broker, unless it keeps happening.
+    if (m_connected and ++m_timeouts >= m_liveness) {
+        m_timeouts = 0;
+        disconnect_from_broker();
+    }
+    m_held.clear();
     reply.clear();
     return;
 }
 
+std::string Client::next_id()
+{
+    m_ids.push_back(std::to_string(++m_next_id));
+    return m_ids.back();
+}
+
+time_unit_t Client::hedge_delay() const
+{
+    // Want some history before trusting a quantile.
+    const size_t enough = std::min<size_t>(m_hedging.window, 20);
+    if (m_hedging.percentile <= 0 or m_latency.size() < enough) {
+        if (m_hedging.delay.count() > 0) {
+            return m_hedging.delay;
+        }
+        return m_timeout;
+    }
+    std::vector<time_unit_t> lat(m_latency.begin(), m_latency.end());
+    size_t ind = std::min(lat.size()-1, size_t(m_hedging.percentile*lat.size()));
+    std::nth_element(lat.begin(), lat.begin()+ind, lat.end());
+    return std::max(lat[ind], time_unit_t{1});
+}
 
+void Client::send_hedge()
+{
+    zmq::multipart_t request = share_frames(m_request);
+    properties_t props = m_request_props;
+    props[gdp::prop::id] = next_id();
+    send_copy(m_service, request, props);
+}
+
+void Client::cancel_except(const std::string& winner)
+{
+    // Ask the broker to drop copies it has yet to dispatch.  Replies
+    // to the cancel and to copies already with workers carry no
+    // current id and are dropped as stale.
+    for (const auto& id : m_ids) {
+        if (id == winner) {
+            continue;
+        }
+        zmq::multipart_t request;
+        request.addstr(m_service);
+        request.addstr(id);
+        properties_t props;
+        send_copy("mmi.cancel", request, props);
+    }
+    m_ids.clear();
+    m_request.clear();
+}
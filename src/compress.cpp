@@ -0,0 +1,220 @@
+#include "generaldomo/compress.hpp"
+#include "generaldomo/protocol.hpp"
+#include "config.h"
+
+#include <algorithm>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace generaldomo;
+
+// Coded frames are prefixed with the 4-byte big-endian size of the
+// original data so the decoder may allocate once.
+static const size_t prefix_size = 4;
+
+#ifdef HAVE_ZLIB
+// zlib can not expand data by much more than 1032 to 1.
+static const size_t zlib_max_ratio = 1032;
+#endif
+
+static void put_size(unsigned char* dst, uint32_t size)
+{
+    dst[0] = (size >> 24) & 0xff;
+    dst[1] = (size >> 16) & 0xff;
+    dst[2] = (size >>  8) & 0xff;
+    dst[3] = (size      ) & 0xff;
+}
+
+static uint32_t get_size(const unsigned char* src)
+{
+    return (uint32_t(src[0]) << 24) | (uint32_t(src[1]) << 16)
+        | (uint32_t(src[2]) << 8) | uint32_t(src[3]);
+}
+
+
+std::vector<std::string> generaldomo::codecs_available()
+{
+    std::vector<std::string> ret;
+#ifdef HAVE_ZLIB
+    ret.push_back("zlib");
+#endif
+    return ret;
+}
+
+bool generaldomo::compress_frame(const std::string& codec, int level,
+                                 const zmq::message_t& in, zmq::message_t& out)
+{
+#ifdef HAVE_ZLIB
+    if (codec == "zlib") {
+        uLongf csize = compressBound(in.size());
+        zmq::message_t tmp(prefix_size + csize);
+        auto dst = static_cast<unsigned char*>(tmp.data());
+        int rc = compress2(dst + prefix_size, &csize,
+                           static_cast<const Bytef*>(in.data()), in.size(),
+                           level);
+        if (rc != Z_OK) {
+            return false;
+        }
+        put_size(dst, in.size());
+        out.rebuild(tmp.data(), prefix_size + csize);
+        return true;
+    }
+#endif
+    return false;
+}
+
+void generaldomo::decompress_frame(const std::string& codec,
+                                   const zmq::message_t& in, zmq::message_t& out,
+                                   size_t max_size)
+{
+    if (in.size() < prefix_size) {
+        throw std::runtime_error("generaldomo decompress: short frame");
+    }
+    auto src = static_cast<const unsigned char*>(in.data());
+    uint32_t size = get_size(src);
+    // The size is the peer's word, check it before allocating.
+    if (size > max_size) {
+        throw std::runtime_error("generaldomo decompress: frame too large");
+    }
+#ifdef HAVE_ZLIB
+    if (codec == "zlib") {
+        if (size > zlib_max_ratio * (in.size() - prefix_size) + 64) {
+            throw std::runtime_error("generaldomo decompress: corrupt zlib frame");
+        }
+        out.rebuild(size);
+        uLongf dsize = size;
+        int rc = uncompress(static_cast<Bytef*>(out.data()), &dsize,
+                            src + prefix_size, in.size() - prefix_size);
+        if (rc != Z_OK or dsize != size) {
+            throw std::runtime_error("generaldomo decompress: corrupt zlib frame");
+        }
+        return;
+    }
+#endif
+    throw std::runtime_error("generaldomo decompress: unknown codec " + codec);
+}
+
+
+Compressor::Compressor(const compression_t& policy)
+    : m_policy(policy)
+{
+    auto have = codecs_available();
+    for (const auto& one : m_policy.codecs) {
+        if (std::find(have.begin(), have.end(), one) != have.end()) {
+            m_codecs.push_back(one);
+        }
+    }
+}
+
+std::string Compressor::accept() const
+{
+    std::string ret;
+    for (const auto& one : m_codecs) {
+        if (ret.size()) {
+            ret += ",";
+        }
+        ret += one;
+    }
+    return ret;
+}
+
+std::string Compressor::choose(const std::string& peer_accept) const
+{
+    auto theirs = split_list(peer_accept);
+    for (const auto& one : m_codecs) {
+        if (std::find(theirs.begin(), theirs.end(), one) != theirs.end()) {
+            return one;
+        }
+    }
+    return "";
+}
+
+bool Compressor::worth_trying(size_t size)
+{
+    if (size < m_policy.min_size) {
+        return false;
+    }
+    if (!m_policy.adaptive or m_countdown == 0) {
+        return true;
+    }
+    --m_countdown;
+    return false;
+}
+
+void Compressor::learn(bool gained)
+{
+    if (!m_policy.adaptive) {
+        return;
+    }
+    if (gained) {
+        m_backoff = 0;
+    }
+    else {
+        m_backoff = std::min(m_policy.max_backoff, std::max<size_t>(1, 2*m_backoff));
+    }
+    m_countdown = m_backoff;
+}
+
+void Compressor::compress(zmq::multipart_t& body, properties_t& props,
+                          const std::string& codec)
+{
+    if (codec.empty()) {
+        return;
+    }
+    std::string coded;
+    zmq::multipart_t out;
+    while (!body.empty()) {
+        zmq::message_t msg = body.pop();
+        const size_t size = msg.size();
+        bool gained = false;
+        if (worth_trying(size)) {
+            zmq::message_t cmsg;
+            if (compress_frame(codec, m_policy.level, msg, cmsg)) {
+                gained = cmsg.size() <= m_policy.max_ratio * size;
+                learn(gained);
+                if (gained) {
+                    msg = std::move(cmsg);
+                }
+            }
+        }
+        if (gained) {
+            ++m_stats.coded;
+        }
+        else {
+            ++m_stats.skipped;
+        }
+        m_stats.bytes_in += size;
+        m_stats.bytes_out += msg.size();
+        coded.push_back(gained ? '1' : '0');
+        out.add(std::move(msg));
+    }
+    body = std::move(out);
+    if (coded.find('1') != std::string::npos) {
+        props[gdp::prop::codec] = codec;
+        props[gdp::prop::coded] = coded;
+    }
+}
+
+void Compressor::decompress(zmq::multipart_t& body, const properties_t& props)
+{
+    auto cit = props.find(gdp::prop::codec);
+    auto fit = props.find(gdp::prop::coded);
+    if (cit == props.end() or fit == props.end()) {
+        return;
+    }
+    const std::string& codec = cit->second;
+    const std::string& coded = fit->second;
+    zmq::multipart_t out;
+    for (size_t ind=0; !body.empty(); ++ind) {
+        zmq::message_t msg = body.pop();
+        if (ind < coded.size() and coded[ind] == '1') {
+            zmq::message_t dmsg;
+            decompress_frame(codec, msg, dmsg, m_policy.max_size);
+            msg = std::move(dmsg);
+        }
+        out.add(std::move(msg));
+    }
+    body = std::move(out);
+}
@@ -0,0 +1,347 @@
+#include "generaldomo/config.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+
+#include <unistd.h>
+
+extern char** environ;
+
+using namespace generaldomo;
+
+static
+std::string trim(const std::string& text)
+{
+    const char* space = " \t\r\n";
+    size_t beg = text.find_first_not_of(space);
+    if (beg == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(space);
+    return text.substr(beg, end - beg + 1);
+}
+
+static
+std::runtime_error bad_value(const std::string& key, const std::string& value)
+{
+    return std::runtime_error("generaldomo config bad value for "
+                              + key + ": " + value);
+}
+
+static
+long long to_integer(const std::string& key, const std::string& value)
+{
+    char* end = nullptr;
+    errno = 0;
+    long long num = std::strtoll(value.c_str(), &end, 10);
+    if (value.empty() or *end or errno) {
+        throw bad_value(key, value);
+    }
+    return num;
+}
+
+static
+size_t to_size(const std::string& key, const std::string& value)
+{
+    long long num = to_integer(key, value);
+    if (num < 0) {
+        throw bad_value(key, value);
+    }
+    return num;
+}
+
+static
+time_unit_t to_time(const std::string& key, const std::string& value)
+{
+    return time_unit_t{to_size(key, value)};
+}
+
+// A heartbeat interval or liveness must be positive.
+static
+long long to_positive(const std::string& key, const std::string& value)
+{
+    long long num = to_integer(key, value);
+    if (num <= 0) {
+        throw bad_value(key, value);
+    }
+    return num;
+}
+
+static
+double to_double(const std::string& key, const std::string& value)
+{
+    char* end = nullptr;
+    double num = std::strtod(value.c_str(), &end);
+    if (value.empty() or *end) {
+        throw bad_value(key, value);
+    }
+    return num;
+}
+
+static
+bool to_bool(const std::string& key, const std::string& value)
+{
+    if (value == "1" or value == "true" or value == "yes" or value == "on") {
+        return true;
+    }
+    if (value == "0" or value == "false" or value == "no" or value == "off") {
+        return false;
+    }
+    throw bad_value(key, value);
+}
+
+static
+std::vector<int> to_cpus(const std::string& key, const std::string& value)
+{
+    std::vector<int> cpus;
+    for (const auto& one : split_list(value)) {
+        cpus.push_back(to_size(key, one));
+    }
+    return cpus;
+}
+
+static
+std::runtime_error unknown_key(const std::string& key)
+{
+    return std::runtime_error("generaldomo config unknown key: " + key);
+}
+
+// Return true and set rest if key begins with prefix.
+static
+bool has_prefix(const std::string& key, const std::string& prefix, std::string& rest)
+{
+    if (key.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    rest = key.substr(prefix.size());
+    return true;
+}
+
+static
+bool set_field(backoff_t& opts, const std::string& key, const std::string& value)
+{
+    if (key == "base") { opts.base = to_time(key, value); return true; }
+    if (key == "cap") { opts.cap = to_time(key, value); return true; }
+    return false;
+}
+
+static
+bool set_field(compression_t& opts, const std::string& key, const std::string& value)
+{
+    if (key == "codecs") { opts.codecs = split_list(value); return true; }
+    if (key == "level") { opts.level = to_integer(key, value); return true; }
+    if (key == "min_size") { opts.min_size = to_size(key, value); return true; }
+    if (key == "max_ratio") { opts.max_ratio = to_double(key, value); return true; }
+    if (key == "adaptive") { opts.adaptive = to_bool(key, value); return true; }
+    if (key == "max_backoff") { opts.max_backoff = to_size(key, value); return true; }
+    if (key == "max_size") { opts.max_size = to_size(key, value); return true; }
+    return false;
+}
+
+static
+bool set_field(hedging_t& opts, const std::string& key, const std::string& value)
+{
+    if (key == "delay") { opts.delay = to_time(key, value); return true; }
+    if (key == "percentile") { opts.percentile = to_double(key, value); return true; }
+    if (key == "window") { opts.window = to_size(key, value); return true; }
+    if (key == "budget") { opts.budget = to_double(key, value); return true; }
+    if (key == "burst") { opts.burst = to_double(key, value); return true; }
+    return false;
+}
+
+bool generaldomo::set_option(service_options_t& opts, const std::string& key,
+                             const std::string& value)
+{
+    if (key == "idempotent") { opts.idempotent = to_bool(key, value); return true; }
+    if (key == "cache_ttl") { opts.cache_ttl = to_time(key, value); return true; }
+    if (key == "cache_bytes") { opts.cache_bytes = to_size(key, value); return true; }
+    if (key == "coalesce") { opts.coalesce = to_bool(key, value); return true; }
+    if (key == "max_attempts") { opts.max_attempts = to_size(key, value); return true; }
+    if (key == "quarantine_size") { opts.quarantine_size = to_size(key, value); return true; }
+    if (key == "busy_expiry") { opts.busy_expiry = to_time(key, value); return true; }
+    if (key == "dispatch") { opts.dispatch = value; return true; }
+    if (key == "max_requests") { opts.max_requests = to_size(key, value); return true; }
+    if (key == "max_batch") { opts.max_batch = to_size(key, value); return true; }
+    return false;
+}
+
+properties_t generaldomo::get_options(const service_options_t& opts)
+{
+    return properties_t{
+        {"idempotent", std::to_string(opts.idempotent)},
+        {"cache_ttl", std::to_string(opts.cache_ttl.count())},
+        {"cache_bytes", std::to_string(opts.cache_bytes)},
+        {"coalesce", std::to_string(opts.coalesce)},
+        {"max_attempts", std::to_string(opts.max_attempts)},
+        {"quarantine_size", std::to_string(opts.quarantine_size)},
+        {"busy_expiry", std::to_string(opts.busy_expiry.count())},
+        {"dispatch", opts.dispatch},
+        {"max_requests", std::to_string(opts.max_requests)},
+        {"max_batch", std::to_string(opts.max_batch)},
+    };
+}
+
+properties_t generaldomo::config_file(const std::string& path)
+{
+    std::ifstream fstr(path);
+    if (!fstr) {
+        throw std::runtime_error("generaldomo config can not read " + path);
+    }
+    properties_t settings;
+    std::string line;
+    size_t lineno = 0;
+    while (std::getline(fstr, line)) {
+        ++lineno;
+        line = trim(line);
+        if (line.empty() or line[0] == '#') {
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            throw std::runtime_error("generaldomo config no '=' at "
+                                     + path + ":" + std::to_string(lineno));
+        }
+        settings[trim(line.substr(0, eq))] = trim(line.substr(eq+1));
+    }
+    return settings;
+}
+
+properties_t generaldomo::config_env(const std::string& prefix)
+{
+    properties_t settings;
+    for (char** env = environ; env and *env; ++env) {
+        std::string var(*env);
+        size_t eq = var.find('=');
+        std::string name;
+        if (eq == std::string::npos or !has_prefix(var.substr(0, eq), prefix, name)) {
+            continue;
+        }
+        std::string key;
+        for (size_t ind=0; ind < name.size(); ++ind) {
+            if (name.compare(ind, 2, "__") == 0) {
+                key += '.';
+                ++ind;
+            }
+            else {
+                key += std::tolower(name[ind]);
+            }
+        }
+        settings[key] = var.substr(eq+1);
+    }
+    return settings;
+}
+
+void generaldomo::load_config(broker_config_t& config, const properties_t& settings)
+{
+    for (const auto& [key, value] : settings) {
+        std::string rest;
+        if (key == "heartbeat") {
+            config.heartbeat = time_unit_t{to_positive(key, value)};
+        }
+        else if (key == "liveness") {
+            config.liveness = to_positive(key, value);
+        }
+        else if (key == "memory_budget") {
+            config.memory_budget = to_size(key, value);
+        }
+        else if (key == "spill_dir") {
+            config.spill_dir = value;
+        }
+        else if (key == "spill_limit") {
+            config.spill_limit = to_size(key, value);
+        }
+        else if (key == "busy_poll") {
+            config.busy_poll = std::chrono::microseconds{to_size(key, value)};
+        }
+        else if (key == "cpus") {
+            config.cpus = to_cpus(key, value);
+        }
+        else if (key == "io_cpus") {
+            config.io_cpus = to_cpus(key, value);
+        }
+        else if (has_prefix(key, "service.", rest)) {
+            // The service name may itself hold dots.
+            size_t dot = rest.rfind('.');
+            if (dot == std::string::npos or dot == 0
+                or !set_option(config.services[rest.substr(0, dot)],
+                               rest.substr(dot+1), value)) {
+                throw unknown_key(key);
+            }
+        }
+        else {
+            throw unknown_key(key);
+        }
+    }
+}
+
+void generaldomo::load_config(client_config_t& config, const properties_t& settings)
+{
+    for (const auto& [key, value] : settings) {
+        std::string rest;
+        if (key == "timeout") {
+            config.timeout = to_time(key, value);
+        }
+        else if (key == "deadline") {
+            config.deadline = to_bool(key, value);
+        }
+        else if (key == "liveness") {
+            config.liveness = to_positive(key, value);
+        }
+        else if (key == "window") {
+            config.window = to_size(key, value);
+        }
+        else if (has_prefix(key, "backoff.", rest)) {
+            if (!set_field(config.backoff, rest, value)) {
+                throw unknown_key(key);
+            }
+        }
+        else if (has_prefix(key, "compression.", rest)) {
+            if (!set_field(config.compression, rest, value)) {
+                throw unknown_key(key);
+            }
+        }
+        else if (has_prefix(key, "hedging.", rest)) {
+            if (!set_field(config.hedging, rest, value)) {
+                throw unknown_key(key);
+            }
+        }
+        else {
+            throw unknown_key(key);
+        }
+    }
+}
+
+void generaldomo::load_config(worker_config_t& config, const properties_t& settings)
+{
+    for (const auto& [key, value] : settings) {
+        std::string rest;
+        if (key == "heartbeat") {
+            config.heartbeat = time_unit_t{to_positive(key, value)};
+        }
+        else if (key == "liveness") {
+            config.liveness = to_positive(key, value);
+        }
+        else if (key == "busy_heartbeat") {
+            config.busy_heartbeat = to_bool(key, value);
+        }
+        else if (key == "transfer") {
+            config.transfer = to_bool(key, value);
+        }
+        else if (has_prefix(key, "backoff.", rest)) {
+            if (!set_field(config.backoff, rest, value)) {
+                throw unknown_key(key);
+            }
+        }
+        else if (has_prefix(key, "compression.", rest)) {
+            if (!set_field(config.compression, rest, value)) {
+                throw unknown_key(key);
+            }
+        }
+        else {
+            throw unknown_key(key);
+        }
+    }
+}
@@ -0,0 +1,367 @@
+#include "generaldomo/coro.hpp"
+#include "generaldomo/protocol.hpp"
+
+using namespace generaldomo;
+
+void Scheduler::watch(zmq::socket_t& sock, std::function<void()> on_input)
+{
+    m_watches.push_back(Watch{&sock, on_input});
+    m_poller.add(sock, zmq::event_flags::pollin, &m_watches.back());
+}
+
+void Scheduler::unwatch(zmq::socket_t& sock)
+{
+    for (auto it = m_watches.begin(); it != m_watches.end(); ++it) {
+        if (it->sock == &sock) {
+            m_poller.remove(sock);
+            m_watches.erase(it);
+            return;
+        }
+    }
+}
+
+void Scheduler::post(std::coroutine_handle<> handle)
+{
+    m_ready.push_back(handle);
+}
+
+void Scheduler::call_at(time_unit_t when, std::function<void()> func)
+{
+    m_timers.push(Timer{when, m_seq++, func});
+}
+
+void Scheduler::spawn(Task<void> task)
+{
+    m_tasks.push_back(std::move(task));
+    post(m_tasks.back().handle());
+}
+
+void Scheduler::run()
+{
+    while (!interrupted() and m_tasks.size()) {
+        run_once(HEARTBEAT_INTERVAL);
+    }
+}
+
+void Scheduler::run_once(time_unit_t timeout)
+{
+    // Resuming may post more, which wait for the next round.
+    std::deque<std::coroutine_handle<>> ready;
+    ready.swap(m_ready);
+    for (auto handle : ready) {
+        handle.resume();
+    }
+    reap();
+
+    auto now = now_ms();
+    if (m_ready.size()) {
+        timeout = time_unit_t{0};
+    }
+    if (m_timers.size()) {
+        auto when = m_timers.top().when;
+        timeout = std::min(timeout, when > now ? when - now : time_unit_t{0});
+    }
+
+    if (m_watches.empty()) {
+        sleep_ms(timeout);
+    }
+    else {
+        std::vector< zmq::poller_event<Watch> > events(m_watches.size());
+        size_t nevents = m_poller.wait_all(events, timeout);
+        for (size_t iev=0; iev < nevents; ++iev) {
+            events[iev].user_data->on_input();
+        }
+    }
+    fire_timers();
+}
+
+void Scheduler::fire_timers()
+{
+    auto now = now_ms();
+    while (m_timers.size() and m_timers.top().when <= now) {
+        std::function<void()> func = m_timers.top().func;
+        m_timers.pop();
+        func();
+    }
+}
+
+void Scheduler::reap()
+{
+    auto it = m_tasks.begin();
+    while (it != m_tasks.end()) {
+        if (!it->done()) {
+            ++it;
+            continue;
+        }
+        std::exception_ptr error = it->handle().promise().error;
+        it = m_tasks.erase(it);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+
+AsyncClient::AsyncClient(Scheduler& sched, zmq::socket_t& sock,
+                         std::string broker_address, logbase_t& log)
+    : m_sched(sched)
+    , m_sock(sock)
+    , m_address(broker_address)
+    , m_log(log)
+    , m_alive(std::make_shared<bool>(true))
+{
+    int stype = m_sock.getsockopt<int>(ZMQ_TYPE);
+    if (ZMQ_CLIENT == stype) {
+        really_recv = recv_client;
+        really_send = send_client;
+    }
+    else if (ZMQ_DEALER == stype) {
+        really_recv = recv_dealer;
+        really_send = send_dealer;
+    }
+    else {
+        throw std::runtime_error("client must be given DEALER or CLIENT socket");
+    }
+    int linger=0;
+    m_sock.setsockopt(ZMQ_LINGER, linger);
+    m_sock.connect(m_address);
+    m_sched.watch(m_sock, [this]() { on_input(); });
+}
+
+AsyncClient::~AsyncClient()
+{
+    m_sched.unwatch(m_sock);
+}
+
+Task<zmq::multipart_t> AsyncClient::request(std::string service,
+                                            zmq::multipart_t request,
+                                            time_unit_t timeout)
+{
+    const std::string id = std::to_string(++m_next_id);
+    const time_unit_t deadline = now_ms() + timeout;
+    properties_t props;
+    props[gdp::prop::id] = id;
+    props[gdp::prop::deadline] = std::to_string(deadline.count());
+    request.push(encode_properties(props)); // frame 3
+    request.pushstr(service);               // frame 2
+    request.pushstr(gdp::client::ident);    // frame 1
+    really_send(m_sock, request);
+
+    Pending pending;
+    m_pending[id] = &pending;
+    std::weak_ptr<bool> alive = m_alive;
+    m_sched.call_at(deadline, [this, alive, id]() {
+        zmq::multipart_t none;
+        if (!alive.expired() and resolve(id, none)) {
+            m_log.error("client timeout");
+        }
+    });
+    co_await ReplyAwaiter{pending};
+    co_return std::move(pending.reply);
+}
+
+bool AsyncClient::resolve(const std::string& id, zmq::multipart_t& reply)
+{
+    auto it = m_pending.find(id);
+    if (it == m_pending.end()) {
+        return false;
+    }
+    Pending* pending = it->second;
+    m_pending.erase(it);
+    pending->reply = std::move(reply);
+    pending->done = true;
+    if (pending->handle) {
+        m_sched.post(pending->handle);
+    }
+    return true;
+}
+
+void AsyncClient::on_input()
+{
+    while (m_sock.getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN) {
+        zmq::multipart_t mmsg;
+        really_recv(m_sock, mmsg);
+        std::string header = mmsg.popstr();
+        std::string service = mmsg.popstr();
+        if (header != gdp::client::ident) {
+            m_log.error("async client got reply without GDP properties");
+            continue;
+        }
+        properties_t props = decode_properties(mmsg.pop());
+        auto eit = props.find(gdp::prop::error);
+        if (eit != props.end()) {
+            m_log.error("client request failed: " + eit->second);
+            mmsg.clear();
+        }
+        auto iit = props.find(gdp::prop::id);
+        if (iit == props.end() or !resolve(iit->second, mmsg)) {
+            m_log.debug("client drop stale reply");
+        }
+    }
+}
+
+
+AsyncWorker::AsyncWorker(Scheduler& sched, zmq::socket_t& sock,
+                         std::string broker_address, std::string service,
+                         logbase_t& log)
+    : m_sched(sched)
+    , m_sock(sock)
+    , m_address(broker_address)
+    , m_service(service)
+    , m_log(log)
+    , m_alive(std::make_shared<bool>(true))
+{
+    int stype = m_sock.getsockopt<int>(ZMQ_TYPE);
+    if (ZMQ_CLIENT == stype) {
+        really_recv = recv_client;
+        really_send = send_client;
+    }
+    else if (ZMQ_DEALER == stype) {
+        really_recv = recv_dealer;
+        really_send = send_dealer;
+    }
+    else {
+        throw std::runtime_error("worker must be given DEALER or CLIENT socket");
+    }
+    int linger=0;
+    m_sock.setsockopt(ZMQ_LINGER, linger);
+    connect_to_broker();
+    m_sched.watch(m_sock, [this]() { on_input(); });
+
+    std::weak_ptr<bool> alive = m_alive;
+    m_sched.call_at(now_ms() + m_heartbeat, [this, alive]() {
+        if (!alive.expired()) {
+            on_heartbeat();
+        }
+    });
+}
+
+AsyncWorker::~AsyncWorker()
+{
+    m_sched.unwatch(m_sock);
+    if (m_connected) {
+        m_sock.disconnect(m_address);
+    }
+}
+
+void AsyncWorker::disconnect_from_broker()
+{
+    m_log.debug("worker disconnect from " + m_address);
+    m_sock.disconnect(m_address);
+    m_connected = false;
+    // The broker requeues what we held.
+    m_requests.clear();
+    m_reply_to.clear();
+
+    std::weak_ptr<bool> alive = m_alive;
+    m_sched.call_at(now_ms() + m_backoff.next(), [this, alive]() {
+        if (!alive.expired()) {
+            connect_to_broker();
+        }
+    });
+}
+
+void AsyncWorker::connect_to_broker()
+{
+    m_sock.connect(m_address);
+    m_connected = true;
+    m_log.debug("worker connect to " + m_address);
+
+    zmq::multipart_t mmsg;
+    mmsg.pushstr(m_service);          // 3
+    mmsg.pushstr(mdp::worker::ready); // 2
+    mmsg.pushstr(mdp::worker::ident); // 1
+    really_send(m_sock, mmsg);
+    m_liveness = HEARTBEAT_LIVENESS;
+}
+
+void AsyncWorker::on_heartbeat()
+{
+    if (m_connected) {
+        zmq::multipart_t mmsg;
+        mmsg.pushstr(mdp::worker::heartbeat); // 2
+        mmsg.pushstr(mdp::worker::ident);     // 1
+        really_send(m_sock, mmsg);
+
+        // The broker only heartbeats idle workers.
+        if (m_requests.empty() and m_reply_to.empty()) {
+            if (--m_liveness <= 0) {
+                m_log.debug("worker lost broker - retrying...");
+                disconnect_from_broker();
+            }
+        }
+    }
+
+    std::weak_ptr<bool> alive = m_alive;
+    m_sched.call_at(now_ms() + m_heartbeat, [this, alive]() {
+        if (!alive.expired()) {
+            on_heartbeat();
+        }
+    });
+}
+
+void AsyncWorker::on_input()
+{
+    while (m_sock.getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN) {
+        zmq::multipart_t mmsg;
+        really_recv(m_sock, mmsg);
+        if (!m_connected) {
+            continue;           // left from the broker we gave up on
+        }
+        m_liveness = HEARTBEAT_LIVENESS;
+        std::string header = mmsg.popstr();  // 1
+        if (header != mdp::worker::ident) {
+            m_log.error("worker invalid header");
+            continue;
+        }
+        std::string command = mmsg.popstr(); // 2
+        if (mdp::worker::disconnect != command) {
+            m_backoff.reset();
+        }
+        if (mdp::worker::request == command) {
+            std::string reply_to = mmsg.popstr(); // 3
+            mmsg.pop();                           // 4
+            m_requests.emplace_back(reply_to, std::move(mmsg));
+        }
+        else if (mdp::worker::heartbeat == command) {
+            // nothing
+        }
+        else if (mdp::worker::disconnect == command) {
+            disconnect_from_broker();
+            break;
+        }
+        else {
+            m_log.error("worker invalid command: " + command);
+        }
+    }
+    if (m_waiter and m_requests.size()) {
+        m_sched.post(std::exchange(m_waiter, {}));
+    }
+}
+
+Task<zmq::multipart_t> AsyncWorker::next()
+{
+    while (m_requests.empty()) {
+        co_await RequestAwaiter{*this};
+    }
+    auto one = std::move(m_requests.front());
+    m_requests.pop_front();
+    m_reply_to.push_back(one.first);
+    co_return std::move(one.second);
+}
+
+Task<void> AsyncWorker::reply(zmq::multipart_t reply)
+{
+    if (m_reply_to.empty()) {
+        m_log.error("worker reply without request");
+        co_return;
+    }
+    reply.pushmem(NULL, 0);              // 4
+    reply.pushstr(m_reply_to.front());   // 3
+    reply.pushstr(mdp::worker::reply);   // 2
+    reply.pushstr(mdp::worker::ident);   // 1
+    m_reply_to.pop_front();
+    if (m_connected) {
+        really_send(m_sock, reply);
+    }
+}
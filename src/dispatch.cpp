@@ -0,0 +1,74 @@
+#include "generaldomo/dispatch.hpp"
+
+#include <random>
+
+using namespace generaldomo;
+
+void worker_info_t::learn(double seconds)
+{
+    if (served == 0) {
+        ewma = seconds;
+    }
+    else {
+        ewma += weight * (seconds - ewma);
+    }
+    ++served;
+}
+
+namespace {
+
+    class FifoDispatch : public DispatchPolicy {
+    public:
+        size_t choose(const std::vector<const worker_info_t*>& candidates) {
+            return 0;
+        }
+    };
+
+    class LifoDispatch : public DispatchPolicy {
+    public:
+        size_t choose(const std::vector<const worker_info_t*>& candidates) {
+            return candidates.size() - 1;
+        }
+    };
+
+    // A worker yet to serve is taken as fastest so that it is tried.
+    // Ties go to the worker waiting longest.
+    class EwmaDispatch : public DispatchPolicy {
+    public:
+        size_t choose(const std::vector<const worker_info_t*>& candidates) {
+            size_t best = 0;
+            for (size_t ind=1; ind<candidates.size(); ++ind) {
+                if (candidates[ind]->ewma < candidates[best]->ewma) {
+                    best = ind;
+                }
+            }
+            return best;
+        }
+    };
+
+    class P2cDispatch : public DispatchPolicy {
+        std::minstd_rand m_rng{std::random_device{}()};
+    public:
+        size_t choose(const std::vector<const worker_info_t*>& candidates) {
+            const size_t num = candidates.size();
+            if (num == 1) {
+                return 0;
+            }
+            size_t one = m_rng() % num;
+            size_t two = m_rng() % (num - 1);
+            if (two >= one) {
+                ++two;
+            }
+            return candidates[two]->ewma < candidates[one]->ewma ? two : one;
+        }
+    };
+}
+
+std::unique_ptr<DispatchPolicy> generaldomo::make_dispatch(const std::string& name)
+{
+    if (name == "fifo") { return std::make_unique<FifoDispatch>(); }
+    if (name == "lifo") { return std::make_unique<LifoDispatch>(); }
+    if (name == "ewma") { return std::make_unique<EwmaDispatch>(); }
+    if (name == "p2c")  { return std::make_unique<P2cDispatch>(); }
+    return nullptr;
+}
@@ -0,0 +1,186 @@
+#include "generaldomo/histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+using namespace generaldomo;
+
+// Values below this are counted exactly.  Above, each power of two
+// is split into half as many buckets.
+static const uint64_t exact = 2048;
+static const uint64_t half = exact / 2;
+
+Histogram::Histogram(uint64_t highest)
+    : m_highest(std::max(highest, exact))
+{
+    m_counts.resize(index(m_highest) + 1, 0);
+}
+
+size_t Histogram::index(uint64_t value) const
+{
+    if (value < exact) {
+        return value;
+    }
+    int exp = 63 - __builtin_clzll(value);
+    int shift = exp - 10;
+    uint64_t mantissa = value >> shift;
+    return exact + (shift - 1) * half + (mantissa - half);
+}
+
+uint64_t Histogram::lowest_at(size_t index) const
+{
+    if (index < exact) {
+        return index;
+    }
+    size_t rest = index - exact;
+    int shift = rest / half + 1;
+    return (half + rest % half) << shift;
+}
+
+uint64_t Histogram::highest_at(size_t index) const
+{
+    if (index < exact) {
+        return index;
+    }
+    int shift = (index - exact) / half + 1;
+    return lowest_at(index) + (uint64_t(1) << shift) - 1;
+}
+
+void Histogram::record(uint64_t value, uint64_t count)
+{
+    value = std::min(value, m_highest);
+    m_counts[index(value)] += count;
+    m_count += count;
+    m_min = std::min(m_min, value);
+    m_max = std::max(m_max, value);
+}
+
+void Histogram::add(const Histogram& other)
+{
+    for (size_t ind=0; ind<other.m_counts.size(); ++ind) {
+        if (other.m_counts[ind]) {
+            record(other.lowest_at(ind), other.m_counts[ind]);
+        }
+    }
+    // Keep the exact extremes rather than those of the buckets.
+    if (other.m_count) {
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, std::min(other.m_max, m_highest));
+    }
+}
+
+void Histogram::reset()
+{
+    std::fill(m_counts.begin(), m_counts.end(), 0);
+    m_count = 0;
+    m_min = UINT64_MAX;
+    m_max = 0;
+}
+
+uint64_t Histogram::min() const
+{
+    return m_count ? m_min : 0;
+}
+
+double Histogram::mean() const
+{
+    if (!m_count) {
+        return 0;
+    }
+    double sum = 0;
+    for (size_t ind=0; ind<m_counts.size(); ++ind) {
+        if (m_counts[ind]) {
+            sum += m_counts[ind] * 0.5 * (lowest_at(ind) + highest_at(ind));
+        }
+    }
+    return sum / m_count;
+}
+
+double Histogram::stddev() const
+{
+    if (!m_count) {
+        return 0;
+    }
+    const double mu = mean();
+    double sum = 0;
+    for (size_t ind=0; ind<m_counts.size(); ++ind) {
+        if (m_counts[ind]) {
+            double dev = 0.5 * (lowest_at(ind) + highest_at(ind)) - mu;
+            sum += m_counts[ind] * dev * dev;
+        }
+    }
+    return std::sqrt(sum / m_count);
+}
+
+uint64_t Histogram::percentile(double percent) const
+{
+    if (!m_count) {
+        return 0;
+    }
+    percent = std::min(100.0, std::max(0.0, percent));
+    uint64_t want = std::max<uint64_t>(1, std::ceil(percent / 100.0 * m_count));
+    uint64_t have = 0;
+    for (size_t ind=0; ind<m_counts.size(); ++ind) {
+        have += m_counts[ind];
+        if (have >= want) {
+            return std::min(highest_at(ind), m_max);
+        }
+    }
+    return m_max;
+}
+
+void Histogram::print(std::ostream& out, double scale, int ticks) const
+{
+    char line[128];
+    snprintf(line, sizeof(line), "%12s %14s %10s %14s\n\n",
+             "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    out << line;
+
+    // Walk the buckets, reporting each percentile level reached.
+    double level = 0;
+    uint64_t have = 0;
+    for (size_t ind=0; m_count and ind<m_counts.size(); ++ind) {
+        if (!m_counts[ind]) {
+            continue;
+        }
+        have += m_counts[ind];
+        const double value = std::min(highest_at(ind), m_max) / scale;
+        if (have == m_count) {
+            snprintf(line, sizeof(line), "%12.3f %1.12f %10lu\n",
+                     value, 1.0, (unsigned long)have);
+            out << line;
+            break;
+        }
+        while (100.0 * have / m_count >= level) {
+            snprintf(line, sizeof(line), "%12.3f %1.12f %10lu %14.2f\n",
+                     value, level / 100.0, (unsigned long)have,
+                     1.0 / (1.0 - level / 100.0));
+            out << line;
+            double halvings = std::floor(std::log2(100.0 / (100.0 - level)));
+            level += 100.0 / (ticks * std::pow(2.0, halvings + 1));
+        }
+    }
+
+    snprintf(line, sizeof(line), "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+             mean() / scale, stddev() / scale);
+    out << line;
+    snprintf(line, sizeof(line), "#[Max     = %12.3f, Total count    = %12lu]\n",
+             m_max / scale, (unsigned long)m_count);
+    out << line;
+    snprintf(line, sizeof(line), "#[Buckets = %12lu, SubBuckets     = %12lu]\n",
+             (unsigned long)((m_counts.size() - exact) / half + 1),
+             (unsigned long)exact);
+    out << line;
+}
+
+void Histogram::write(const std::string& path, double scale, int ticks) const
+{
+    std::ofstream fstr(path);
+    if (!fstr) {
+        throw std::runtime_error("generaldomo histogram can not write " + path);
+    }
+    print(fstr, scale, ticks);
+}
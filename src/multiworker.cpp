@@ -0,0 +1,254 @@
+#include "generaldomo/multiworker.hpp"
+#include "generaldomo/protocol.hpp"
+
+using namespace generaldomo;
+
+MultiWorker::MultiWorker(zmq::socket_t& sock, std::string broker_address,
+                         const std::map<std::string, handler_t>& handlers,
+                         logbase_t& log, const worker_config_t& config,
+                         size_t nthreads)
+    : m_sock(sock)
+    , m_address(broker_address)
+    , m_handlers(handlers)
+    , m_log(log)
+    , m_heartbeat(config.heartbeat)
+    , m_expiry(config.heartbeat * config.liveness)
+    , m_backoff(config.backoff)
+    , m_compressor(config.compression)
+{
+    if (m_handlers.empty()) {
+        throw std::runtime_error("multiworker must be given a handler");
+    }
+    int stype = m_sock.getsockopt<int>(ZMQ_TYPE);
+    if (ZMQ_CLIENT == stype) {
+        really_recv = recv_client;
+        really_send = send_client;
+    }
+    else if (ZMQ_DEALER == stype) {
+        really_recv = recv_dealer;
+        really_send = send_dealer;
+    }
+    else {
+        throw std::runtime_error("multiworker must be given DEALER or CLIENT socket");
+    }
+    if (nthreads) {
+        m_done = std::make_unique<WakeQueue<Job>>();
+        m_pool = std::make_unique<WorkPool<Job>>(
+            nthreads, [this](Job& job) { handle(job); }, *m_done);
+    }
+
+    int linger=0;
+    m_sock.setsockopt(ZMQ_LINGER, linger);
+    connect_to_broker();
+}
+
+MultiWorker::~MultiWorker()
+{
+    m_pool.reset();
+    if (m_connected) {
+        m_sock.disconnect(m_address);
+    }
+}
+
+void MultiWorker::connect_to_broker()
+{
+    m_sock.connect(m_address);
+    m_connected = true;
+    ++m_generation;
+    m_busy = 0;
+    m_log.debug("multiworker connect to " + m_address);
+
+    // The first service is named as usual, the rest as a property.
+    std::vector<std::string> others;
+    for (const auto& [name, handler] : m_handlers) {
+        if (name != m_handlers.begin()->first) {
+            others.push_back(name);
+        }
+    }
+    properties_t props;
+    if (others.size()) {
+        props[gdp::prop::services] = join_list(others);
+    }
+    if (m_compressor.enabled()) {
+        props[gdp::prop::accept] = m_compressor.accept();
+    }
+    props[gdp::prop::heartbeat] = std::to_string(m_heartbeat.count());
+    zmq::multipart_t mmsg;
+    mmsg.push(encode_properties(props));
+    mmsg.pushstr(m_handlers.begin()->first);
+    mmsg.pushstr(mdp::worker::ready);
+    mmsg.pushstr(mdp::worker::ident);
+    really_send(m_sock, mmsg);
+
+    m_heard_at = now_ms();
+    m_heartbeat_at = m_heard_at + m_heartbeat;
+}
+
+void MultiWorker::disconnect_from_broker()
+{
+    m_log.debug("multiworker disconnect from " + m_address);
+    m_sock.disconnect(m_address);
+    m_connected = false;
+    m_reconnect_at = now_ms() + m_backoff.next();
+}
+
+void MultiWorker::send_heartbeat()
+{
+    zmq::multipart_t mmsg;
+    mmsg.pushstr(mdp::worker::heartbeat);
+    mmsg.pushstr(mdp::worker::ident);
+    really_send(m_sock, mmsg);
+}
+
+void MultiWorker::poll(time_unit_t timeout)
+{
+    time_unit_t now = now_ms();
+    if (!m_connected) {
+        if (now >= m_reconnect_at) {
+            connect_to_broker();
+        }
+        else {
+            timeout = std::min(timeout, m_reconnect_at - now);
+        }
+    }
+    if (m_connected) {
+        timeout = std::min(timeout, std::max(time_unit_t{0}, m_heartbeat_at - now));
+    }
+
+    std::vector<zmq::pollitem_t> items{{m_sock.handle(), 0, ZMQ_POLLIN, 0}};
+    if (m_done) {
+        items.push_back(zmq::pollitem_t{nullptr, m_done->fd(), ZMQ_POLLIN, 0});
+    }
+    zmq::poll(items, timeout);
+
+    send_replies();
+    while (m_sock.getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN) {
+        proc_broker();
+        send_replies();
+    }
+
+    now = now_ms();
+    if (!m_connected) {
+        return;
+    }
+    if (now - m_heard_at >= m_expiry) {
+        m_log.debug("multiworker lost broker - retrying...");
+        disconnect_from_broker();
+        return;
+    }
+    if (now >= m_heartbeat_at) {
+        send_heartbeat();
+        m_heartbeat_at = now + m_heartbeat;
+    }
+}
+
+void MultiWorker::run()
+{
+    while (!interrupted()) {
+        poll(m_heartbeat);
+    }
+    m_log.info("multiworker interupt received, killing worker");
+}
+
+void MultiWorker::proc_broker()
+{
+    zmq::multipart_t mmsg;
+    really_recv(m_sock, mmsg);
+    if (!m_connected) {
+        return;                 // left from the broker we gave up on
+    }
+    m_heard_at = now_ms();
+    std::string header = mmsg.popstr();
+    assert(header == mdp::worker::ident);
+    std::string command = mmsg.popstr();
+    if (mdp::worker::disconnect != command) {
+        m_backoff.reset();
+    }
+    if (mdp::worker::request == command) {
+        Job job;
+        job.client = mmsg.popstr();
+        properties_t props = decode_properties(mmsg.pop());
+        auto sit = props.find(gdp::prop::service);
+        job.service = sit == props.end() ? m_handlers.begin()->first : sit->second;
+        job.generation = m_generation;
+        ++m_busy;
+        try {
+            m_compressor.decompress(mmsg, props);
+        }
+        catch (const std::exception& err) {
+            m_log.error(std::string("multiworker can not decode request: ") + err.what());
+            job.error = "codec";
+            send_reply(job);
+            return;
+        }
+        job.codec = m_compressor.choose(props[gdp::prop::accept]);
+        job.body = std::move(mmsg);
+        if (!m_pool) {
+            handle(job);
+            send_reply(job);
+            return;
+        }
+        m_pool->push(std::move(job));
+    }
+    else if (mdp::worker::heartbeat == command) {
+        // nothing
+    }
+    else if (mdp::worker::disconnect == command) {
+        disconnect_from_broker();
+    }
+    else {
+        m_log.error("multiworker invalid command: " + command);
+    }
+}
+
+void MultiWorker::handle(Job& job)
+{
+    auto hit = m_handlers.find(job.service);
+    if (hit == m_handlers.end()) {
+        job.body.clear();
+        job.error = "handler";
+        return;
+    }
+    try {
+        job.body = hit->second(job.body);
+    }
+    catch (...) {
+        job.body.clear();
+        job.error = "handler";
+    }
+}
+
+void MultiWorker::send_reply(Job& job)
+{
+    if (!m_connected or job.generation != m_generation) {
+        return;
+    }
+    --m_busy;
+    properties_t props;
+    if (m_handlers.size() > 1) {
+        props[gdp::prop::service] = job.service;
+    }
+    if (job.error.size()) {
+        m_log.error("multiworker " + job.error + " failed for " + job.service);
+        props[gdp::prop::error] = job.error;
+    }
+    else {
+        m_compressor.compress(job.body, props, job.codec);
+    }
+    zmq::multipart_t& reply = job.body;
+    reply.push(encode_properties(props));
+    reply.pushstr(job.client);
+    reply.pushstr(mdp::worker::reply);
+    reply.pushstr(mdp::worker::ident);
+    really_send(m_sock, reply);
+}
+
+void MultiWorker::send_replies()
+{
+    if (!m_done) {
+        return;
+    }
+    for (auto& job : m_done->take()) {
+        send_reply(job);
+    }
+}
@@ -0,0 +1,75 @@
+#include "generaldomo/observer.hpp"
+
+#include <cstdio>
+#include <sstream>
+
+using namespace generaldomo;
+
+const char* generaldomo::phase_name(phase_t phase)
+{
+    switch (phase) {
+    case phase_t::decode: return "decode";
+    case phase_t::lookup: return "lookup";
+    case phase_t::dispatch: return "dispatch";
+    case phase_t::send: return "send";
+    }
+    return "unknown";
+}
+
+std::string CountingObserver::summary() const
+{
+    std::stringstream ss;
+    ss << "accepted=" << accepted << "\n"
+       << "enqueued=" << enqueued << "\n"
+       << "dispatched=" << dispatched << "\n"
+       << "replied=" << replied << "\n"
+       << "ready=" << ready << "\n"
+       << "expired=" << expired << "\n"
+       << "rejected=" << rejected << "\n"
+       << "bytes_in=" << bytes_in << "\n"
+       << "bytes_out=" << bytes_out << "\n"
+       << "max_depth=" << max_depth << "\n";
+    return ss.str();
+}
+
+void ProfilingObserver::reset()
+{
+    messages = 0;
+    std::fill(ticks, ticks + nphases, 0);
+    m_active = false;
+}
+
+std::string ProfilingObserver::summary() const
+{
+    uint64_t total = 0;
+    for (auto t : ticks) {
+        total += t;
+    }
+    std::string ret;
+    char buf[80];
+    for (size_t ind=0; ind<nphases; ++ind) {
+        snprintf(buf, sizeof(buf), "%-10s %12.1f %6.1f%%\n",
+                 phase_name(static_cast<phase_t>(ind)),
+                 messages ? double(ticks[ind]) / messages : 0.0,
+                 total ? 100.0 * ticks[ind] / total : 0.0);
+        ret += buf;
+    }
+    return ret;
+}
+
+void SamplingObserver::write(const char* event, const std::string& service,
+                             const std::string& detail, bool identity)
+{
+    *out << now_ms().count() << " " << event << " " << service << " ";
+    if (identity) {
+        char buf[3];
+        for (unsigned char c : detail) {
+            snprintf(buf, sizeof(buf), "%02x", c);
+            *out << buf;
+        }
+    }
+    else {
+        *out << detail;
+    }
+    *out << "\n";
+}
@@ -0,0 +1,41 @@
+#include "generaldomo/pool.hpp"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace generaldomo;
+
+WakePipe::WakePipe()
+{
+    if (pipe(m_fds) != 0) {
+        throw std::runtime_error("generaldomo can not make wake pipe");
+    }
+    // Neither a full pipe nor an empty one may block.
+    for (int fd : m_fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+}
+
+WakePipe::~WakePipe()
+{
+    for (int fd : m_fds) {
+        close(fd);
+    }
+}
+
+void WakePipe::wake()
+{
+    const char one = 1;
+    auto rc = write(m_fds[1], &one, 1);
+    (void)rc;
+}
+
+void WakePipe::drain()
+{
+    char buf[64];
+    while (read(m_fds[0], buf, sizeof(buf)) > 0) {
+        ;                       // drain
+    }
+}
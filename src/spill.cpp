@@ -0,0 +1,83 @@
+#include "generaldomo/spill.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+using namespace generaldomo;
+
+static
+std::runtime_error spill_error(const std::string& what)
+{
+    return std::runtime_error("generaldomo spill " + what + ": "
+                              + std::strerror(errno));
+}
+
+SpillFile::SpillFile(const std::string& dir)
+{
+    std::string path = dir;
+    if (path.empty()) {
+        const char* tmp = std::getenv("TMPDIR");
+        path = tmp ? tmp : "/tmp";
+    }
+    path += "/generaldomo-spill-XXXXXX";
+    m_fd = mkstemp(&path[0]);
+    if (m_fd < 0) {
+        throw spill_error("can not make " + path);
+    }
+    unlink(path.c_str());
+}
+
+SpillFile::~SpillFile()
+{
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+size_t SpillFile::write(const zmq::message_t& msg)
+{
+    const size_t offset = m_end;
+    auto data = static_cast<const char*>(msg.data());
+    size_t done = 0;
+    while (done < msg.size()) {
+        ssize_t got = pwrite(m_fd, data + done, msg.size() - done, offset + done);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw spill_error("write failed");
+        }
+        done += got;
+    }
+    m_end += msg.size();
+    return offset;
+}
+
+zmq::message_t SpillFile::read(size_t offset, size_t size) const
+{
+    zmq::message_t msg(size);
+    auto data = static_cast<char*>(msg.data());
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = pread(m_fd, data + done, size - done, offset + done);
+        if (got < 0 and errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            throw spill_error("read failed");
+        }
+        done += got;
+    }
+    return msg;
+}
+
+void SpillFile::clear()
+{
+    if (ftruncate(m_fd, 0) != 0) {
+        throw spill_error("truncate failed");
+    }
+    m_end = 0;
+}
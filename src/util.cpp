@@ -3,10 +3,84 @@
 #include <chrono>
 #include <thread>
 #include <signal.h>
+#include <pthread.h>
+#include <sched.h>
 
 using namespace generaldomo;
 
 
+zmq::message_t generaldomo::encode_properties(const properties_t& props)
+{
+    if (props.empty()) {
+        return zmq::message_t{};
+    }
+    zmq::multipart_t mmsg;
+    for (const auto& [key, val] : props) {
+        mmsg.addstr(key);
+        mmsg.addstr(val);
+    }
+    return mmsg.encode();
+}
+
+properties_t generaldomo::decode_properties(const zmq::message_t& frame)
+{
+    properties_t props;
+    if (frame.size() == 0) {
+        return props;
+    }
+    zmq::multipart_t mmsg;
+    mmsg.decode(frame);
+    while (mmsg.size() >= 2) {
+        std::string key = mmsg.popstr();
+        props[key] = mmsg.popstr();
+    }
+    return props;
+}
+
+std::vector<std::string> generaldomo::split_list(const std::string& list)
+{
+    std::vector<std::string> ret;
+    size_t beg = 0;
+    while (beg < list.size()) {
+        size_t end = list.find(',', beg);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        if (end > beg) {
+            ret.push_back(list.substr(beg, end-beg));
+        }
+        beg = end + 1;
+    }
+    return ret;
+}
+
+std::string generaldomo::join_list(const std::vector<std::string>& items)
+{
+    std::string ret;
+    for (const auto& one : items) {
+        if (ret.size()) {
+            ret += ",";
+        }
+        ret += one;
+    }
+    return ret;
+}
+
+zmq::multipart_t generaldomo::share_frames(zmq::multipart_t& mmsg)
+{
+    zmq::multipart_t orig, copy;
+    while (!mmsg.empty()) {
+        zmq::message_t msg = mmsg.pop();
+        zmq::message_t dup;
+        dup.copy(msg);
+        orig.add(std::move(msg));
+        copy.add(std::move(dup));
+    }
+    mmsg = std::move(orig);
+    return copy;
+}
+
+
 remote_identity_t generaldomo::recv_serverish(zmq::socket_t& sock,
                                               zmq::multipart_t& mmsg)
 {
@@ -192,6 +266,27 @@ std::chrono::milliseconds generaldomo::now_ms()
     return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
 }
 
+std::chrono::milliseconds generaldomo::mono_ms()
+{
+    static const auto offset = std::chrono::system_clock::now().time_since_epoch()
+        - std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() + offset);
+}
+
+void generaldomo::pin_thread(const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        throw std::runtime_error("generaldomo can not pin thread to CPUs");
+    }
+}
+
 void generaldomo::sleep_ms(std::chrono::milliseconds zzz)
 {
     std::this_thread::sleep_for(zzz);
@@ -1,15 +1,35 @@
 #include "generaldomo/worker.hpp"
 #include "generaldomo/protocol.hpp"
 
+#include <algorithm>
+
 
 using namespace generaldomo;
 
 Worker::Worker(zmq::socket_t& sock, std::string broker_address,
-               std::string service, logbase_t& log)
+               std::string service, logbase_t& log,
+               const compression_t& compression,
+               bool busy_heartbeat)
+    : Worker(sock, broker_address, service, log,
+             worker_config_t{HEARTBEAT_INTERVAL, HEARTBEAT_LIVENESS,
+                             backoff_t{}, compression, busy_heartbeat})
+{
+}
+
+Worker::Worker(zmq::socket_t& sock, std::string broker_address,
+               std::string service, logbase_t& log,
+               const worker_config_t& config)
     : m_sock(sock)
     , m_address(broker_address)
     , m_service(service)
     , m_log(log)
+    , m_liveness_max(config.liveness)
+    , m_liveness(config.liveness)
+    , m_heartbeat(config.heartbeat)
+    , m_backoff(config.backoff)
+    , m_compressor(config.compression)
+    , m_take_transfer(config.transfer)
+    , m_busy_heartbeat(config.busy_heartbeat)
 {
     m_log.debug("worker constructing on " + m_address);
     int stype = m_sock.getsockopt<int>(ZMQ_TYPE);
@@ -24,45 +44,160 @@ Worker::Worker(zmq::socket_t& sock, std::string broker_address,
     else {
         throw std::runtime_error("worker must be given DEALER or CLIENT socket");
     }
+    if (m_busy_heartbeat and ZMQ_CLIENT != stype) {
+        throw std::runtime_error("worker busy heartbeat requires CLIENT socket");
+    }
+
+    int linger=0;
+    m_sock.setsockopt(ZMQ_LINGER, linger);
+    connect_to_broker();
 
-    connect_to_broker(false);
+    if (m_busy_heartbeat) {
+        m_agent = std::thread(&Worker::heartbeat_agent, this);
+    }
 }
 
 Worker::~Worker()
 {
     m_log.debug("worker destructing");
-    m_sock.disconnect(m_address);
+    if (m_agent.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_agent_mutex);
+            m_agent_stop = true;
+        }
+        m_agent_cv.notify_one();
+        m_agent.join();
+    }
+    if (m_connected) {
+        m_sock.disconnect(m_address);
+    }
 }
 
-void Worker::connect_to_broker(bool reconnect)
+void Worker::heartbeat_agent()
 {
-    if (reconnect) {
-        m_log.debug("worker disconnect from " + m_address);
-        m_sock.disconnect(m_address);
+    std::unique_lock<std::mutex> lock(m_agent_mutex);
+    while (!m_agent_stop) {
+        m_agent_cv.wait(lock, [this]() { return m_agent_stop or m_agent_busy; });
+        // Heartbeat each interval until the reply is sent.
+        bool done = m_agent_cv.wait_for(lock, m_heartbeat, [this]() {
+            return m_agent_stop or !m_agent_busy;
+        });
+        if (!done) {
+            send_heartbeat();
+        }
     }
+}
 
-    int linger=0;
-    m_sock.setsockopt(ZMQ_LINGER, linger);
+void Worker::set_busy(bool busy)
+{
+    if (!m_busy_heartbeat) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_agent_mutex);
+        if (m_agent_busy == busy) {
+            return;
+        }
+        m_agent_busy = busy;
+    }
+    m_agent_cv.notify_one();
+}
+
+void Worker::send_heartbeat()
+{
+    zmq::multipart_t mmsg;
+    mmsg.pushstr(mdp::worker::heartbeat); // 2
+    mmsg.pushstr(mdp::worker::ident);     // 1
+    really_send(m_sock, mmsg);
+}
+
+void Worker::disconnect_from_broker()
+{
+    m_log.debug("worker disconnect from " + m_address);
+    m_sock.disconnect(m_address);
+    m_connected = false;
+    m_reconnect_at = now_ms() + m_backoff.next();
+    m_held.clear();             // a new broker gives it again
+}
+
+void Worker::connect_to_broker()
+{
     // set socket routing ID?
     m_sock.connect(m_address);
+    m_connected = true;
     m_log.debug("worker connect to " + m_address);
 
+    // We take batches and transfers and we may decode some codecs.
+    properties_t props;
+    props[gdp::prop::batch] = "1";
+    if (m_take_transfer) {
+        props[gdp::prop::transfer] = "1";
+    }
+    if (m_compressor.enabled()) {
+        props[gdp::prop::accept] = m_compressor.accept();
+    }
+    if (m_busy_heartbeat) {
+        props[gdp::prop::heartbeat] = std::to_string(m_heartbeat.count());
+    }
     zmq::multipart_t mmsg;
+    mmsg.push(encode_properties(props)); // 4
     mmsg.pushstr(m_service);          // 3
     mmsg.pushstr(mdp::worker::ready); // 2
     mmsg.pushstr(mdp::worker::ident); // 1
     really_send(m_sock, mmsg);
 
-    m_liveness = HEARTBEAT_LIVENESS;
+    m_liveness = m_liveness_max;
     m_heartbeat_at = now_ms() + m_heartbeat;
 }
 
 void Worker::send(zmq::multipart_t& reply)
 {
+    if (m_answered) {
+        reply.clear();
+        return;
+    }
+    if (m_batch_size) {
+        // Collect replies to a batch, empty or not, until all are in.
+        if (m_batch_out.size() < m_batch_given) {
+            m_batch_out.add(reply.encode());
+            reply.clear();
+        }
+        if (m_batch_out.size() == m_batch_size) {
+            properties_t props;
+            props[gdp::prop::batch] = std::to_string(m_batch_size);
+            send_reply(m_batch_out, props);
+            m_batch_out.clear();
+            m_batch_size = m_batch_given = 0;
+        }
+        return;
+    }
     if (reply.empty()) {
         return;
     }
-    reply.pushmem(NULL,0);             // 4
+    properties_t props;
+    send_reply(reply, props);
+}
+
+void Worker::send_batch(std::vector<zmq::multipart_t>& replies)
+{
+    if (!m_batch_size) {        // not a batch, at most one reply
+        if (replies.size()) {
+            send(replies.front());
+        }
+    }
+    else {
+        for (auto& one : replies) {
+            send(one);
+        }
+    }
+    replies.clear();
+}
+
+void Worker::send_reply(zmq::multipart_t& reply, properties_t& props)
+{
+    set_busy(false);
+    m_compressor.compress(reply, props, m_reply_codec);
+    reply.push(encode_properties(props)); // 4
     reply.pushstr(m_reply_to);         // 3
     reply.pushstr(mdp::worker::reply); // 2
     reply.pushstr(mdp::worker::ident); // 1
@@ -71,51 +206,238 @@ void Worker::send(zmq::multipart_t& reply)
 
 void Worker::recv(zmq::multipart_t& request)
 {
+    if (!m_batch_in.empty()) {
+        request = std::move(m_batch_in.front());
+        m_batch_in.pop_front();
+        return;
+    }
+
+    // Whatever the reply, if any, the request in hand is done.
+    set_busy(false);
+    zmq::multipart_t mmsg;
+    if (!recv_request(mmsg)) {
+        return;
+    }
+    if (!m_batch_size) {
+        request = std::move(mmsg);
+        return;
+    }
+    while (!mmsg.empty()) {
+        zmq::multipart_t one;
+        one.decode(mmsg.pop());
+        m_batch_in.emplace_back(std::move(one));
+    }
+    m_batch_given = m_batch_size;
+    recv(request);
+}
+
+void Worker::recv_batch(std::vector<zmq::multipart_t>& requests)
+{
+    requests.clear();
+    while (!m_batch_in.empty()) { // finish any batch begun with recv()
+        requests.emplace_back(std::move(m_batch_in.front()));
+        m_batch_in.pop_front();
+    }
+    if (requests.size()) {
+        return;
+    }
+
+    set_busy(false);
+    zmq::multipart_t mmsg;
+    if (!recv_request(mmsg)) {
+        return;
+    }
+    if (!m_batch_size) {
+        requests.emplace_back(std::move(mmsg));
+        return;
+    }
+    while (!mmsg.empty()) {
+        zmq::multipart_t one;
+        one.decode(mmsg.pop());
+        requests.emplace_back(std::move(one));
+    }
+    m_batch_given = m_batch_size;
+}
+
+bool Worker::recv_request(zmq::multipart_t& request)
+{
+    while (true) {
+        zmq::multipart_t mmsg;
+        if (m_held.size()) {
+            mmsg = std::move(m_held);
+            m_held.clear();
+        }
+        else if (!wait_request(mmsg)) {
+            return false;
+        }
+        if (take_request(mmsg, request)) {
+            return true;
+        }
+    }
+}
+
+bool Worker::take_request(zmq::multipart_t& mmsg, zmq::multipart_t& request)
+{
+    m_reply_to = mmsg.popstr(); // 3
+    properties_t props = decode_properties(mmsg.pop()); // 4
+    m_answered = false;
+    try {
+        m_compressor.decompress(mmsg, props);
+    }
+    catch (const std::exception& err) {
+        // The client gets an error, the worker goes on.
+        m_log.error(std::string("worker can not decode request: ") + err.what());
+        m_reply_codec = "";
+        properties_t error;
+        error[gdp::prop::error] = "codec";
+        zmq::multipart_t none;
+        send_reply(none, error);
+        m_answered = true;
+        return false;
+    }
+    m_reply_codec = m_compressor.choose(props[gdp::prop::accept]);
+    m_batch_size = 0;
+    auto bit = props.find(gdp::prop::batch);
+    if (bit != props.end()) {
+        m_batch_size = std::strtoul(bit->second.c_str(), nullptr, 10);
+    }
+    m_batch_out.clear();
+    m_batch_given = 0;
+    m_deadline = time_unit_t{0};
+    auto dit = props.find(gdp::prop::deadline);
+    if (dit != props.end()) {
+        m_deadline = time_unit_t{std::strtoll(dit->second.c_str(), nullptr, 10)};
+    }
+    m_transfer = props[gdp::prop::transfer];
+    m_transfer_last = props.count(gdp::prop::last) > 0;
+    m_transfer_failed = props.count(gdp::prop::error) > 0;
+    request = std::move(mmsg);  // 5+
+    set_busy(true);
+    return true;
+}
+
+bool Worker::wait_request(zmq::multipart_t& request)
+{
+    time_unit_t timeout = m_heartbeat;
+    if (!m_connected) {
+        const time_unit_t now = now_ms();
+        if (now >= m_reconnect_at) {
+            connect_to_broker();
+        }
+        else {
+            timeout = std::min(timeout, m_reconnect_at - now);
+        }
+    }
+
     zmq::poller_t<> poller;
     poller.add(m_sock, zmq::event_flags::pollin);
 
     std::vector< zmq::poller_event<> > events(1);
-    int rc = poller.wait_all(events, m_heartbeat);
+    int rc = poller.wait_all(events, timeout);
     if (rc > 0) {           // got one
         zmq::multipart_t mmsg;
         really_recv(m_sock, mmsg);
-        m_liveness = HEARTBEAT_LIVENESS;
+        if (!m_connected) {
+            // Left from the broker we gave up on.
+            return false;
+        }
+        m_liveness = m_liveness_max;
         std::string header = mmsg.popstr();  // 1
         assert(header == mdp::worker::ident);
         std::string command = mmsg.popstr(); // 2
+        if (mdp::worker::disconnect != command) {
+            m_backoff.reset();
+        }
         if (mdp::worker::request == command) {
-            m_reply_to = mmsg.popstr(); // 3
-            mmsg.pop();                 // 4
-            request = std::move(mmsg);  // 5+
-            return;                
+            request = std::move(mmsg);  // 3+
+            return true;
         }
         else if (mdp::worker::heartbeat == command) {
             // nothing
         }
         else if (mdp::worker::disconnect == command) {
-            connect_to_broker();
+            disconnect_from_broker();
         }
         else {
             m_log.error("worker invalid command: " + command);
         }
     }
-    else {                  // timeout
-        --m_liveness;
-        if (m_liveness == 0) {
-            m_log.debug("worker disconnect from broker - retrying...");
+    else if (m_connected) { // timeout
+        if (--m_liveness <= 0) {
+            m_log.debug("worker lost broker - retrying...");
+            disconnect_from_broker();
         }
-        sleep_ms(m_reconnect);
-        connect_to_broker();
     }
-    if (now_ms() >= m_heartbeat_at) {
+    const time_unit_t now = now_ms();
+    if (m_connected and now >= m_heartbeat_at) {
+        send_heartbeat();
+        m_heartbeat_at = now + m_heartbeat;
+    }
+
+    return false;
+}
+
+void Worker::send_credit()
+{
+    properties_t props;
+    props[gdp::prop::transfer] = m_transfer;
+    props[gdp::prop::credit] = "1";
+    zmq::multipart_t mmsg;
+    mmsg.push(encode_properties(props)); // 4
+    mmsg.pushstr(m_reply_to);          // 3
+    mmsg.pushstr(mdp::worker::reply);  // 2
+    mmsg.pushstr(mdp::worker::ident);  // 1
+    really_send(m_sock, mmsg);
+}
+
+bool Worker::recv_chunk(zmq::multipart_t& chunk)
+{
+    chunk.clear();
+    if (!streaming()) {
+        return false;
+    }
+    // The chunk given before is taken, the client may send another.
+    send_credit();
+    while (m_connected and !interrupted()) {
         zmq::multipart_t mmsg;
-        mmsg.pushstr(mdp::worker::heartbeat); // 2
-        mmsg.pushstr(mdp::worker::ident);     // 1
-        really_send(m_sock, mmsg);
-        m_heartbeat_at += m_heartbeat;
+        if (!wait_request(mmsg)) {
+            continue;
+        }
+        // The broker has given up on the transfer, the request is
+        // left for the next recv() and the reply for this one still
+        // goes to its client.
+        properties_t props = decode_properties(mmsg[1]);
+        if (props[gdp::prop::transfer] != m_transfer) {
+            m_log.error("worker got request in middle of transfer");
+            m_held = std::move(mmsg);
+            break;
+        }
+        if (!take_request(mmsg, chunk)) {
+            m_transfer_last = true;
+            return false;
+        }
+        if (m_transfer_failed) {
+            m_log.error("worker transfer failed");
+            m_transfer_last = true;
+            chunk.clear();
+            return false;
+        }
+        return true;
     }
+    m_transfer_last = true;
+    return false;
+}
 
-    return;
+time_unit_t Worker::remaining() const
+{
+    if (m_deadline.count() == 0) {
+        return time_unit_t::max();
+    }
+    auto now = now_ms();
+    if (now >= m_deadline) {
+        return time_unit_t{0};
+    }
+    return m_deadline - now;
 }
 
 zmq::multipart_t Worker::work(zmq::multipart_t& reply)
@@ -137,6 +459,25 @@ zmq::multipart_t Worker::work(zmq::multipart_t& reply)
     return zmq::multipart_t{};
 }
 
+std::vector<zmq::multipart_t>
+Worker::work_batch(std::vector<zmq::multipart_t>& replies)
+{
+    send_batch(replies);
+
+    std::vector<zmq::multipart_t> requests;
+    while (! interrupted() ) {
+        recv_batch(requests);
+        if (requests.empty()) {
+            continue;
+        }
+        return requests;
+    }
+    if (interrupted()) {
+        m_log.info("worker interupt received, killing worker");
+    }
+    return requests;
+}
+
 
 void generaldomo::echo_worker(zmq::socket_t& pipe, std::string address, int socktype)
 {
@@ -146,7 +487,9 @@ void generaldomo::echo_worker(zmq::socket_t& pipe, std::string address, int sock
     // fixme: should implement BIND actor protocol 
     zmq::context_t ctx;
     zmq::socket_t sock(ctx, socktype);
-    Worker worker(sock, address, "echo", log);
+    worker_config_t config;
+    config.transfer = true;
+    Worker worker(sock, address, "echo", log, config);
     log.debug("worker echo created on " + address);
 
     zmq::poller_t<> poller;
@@ -183,7 +526,20 @@ void generaldomo::echo_worker(zmq::socket_t& pipe, std::string address, int sock
                     break;
                 }
                 reply = std::move(request);
+                // Echo the rest of a transfer as one reply.
+                zmq::multipart_t chunk;
+                while (worker.recv_chunk(chunk)) {
+                    while (!chunk.empty()) {
+                        reply.add(chunk.pop());
+                    }
+                }
                 worker.send(reply);
+                // Rest of a batch is already here.
+                while (worker.pending()) {
+                    worker.recv(request);
+                    reply = std::move(request);
+                    worker.send(reply);
+                }
             }
         }
     }
@@ -0,0 +1,198 @@
+/*! Test scatter-gather broadcast requests.
+
+  Clients and workers are simulated through a broker frontend without
+  a socket.
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <cassert>
+
+using namespace generaldomo;
+
+typedef std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox_t;
+
+static
+void client_broadcast(Broker& broker, size_t fe, const std::string& quorum,
+                      const std::string& wait = "")
+{
+    properties_t props;
+    props[gdp::prop::broadcast] = quorum;
+    if (wait.size()) {
+        props[gdp::prop::wait] = wait;
+    }
+    zmq::multipart_t mmsg;
+    mmsg.addstr(gdp::client::ident);
+    mmsg.addstr("echo");
+    mmsg.add(encode_properties(props));
+    mmsg.addstr("hello");
+    broker.inject(fe, "client", mmsg);
+}
+
+// Have each worker with a request in the outbox answer it, by name,
+// unless it is mute.  Return the client's reply.
+static
+zmq::multipart_t workers_answer(Broker& broker, size_t fe, outbox_t& outbox,
+                                const std::string& mute = "")
+{
+    zmq::multipart_t got;
+    while (outbox.size()) {
+        auto [peer, mmsg] = std::move(outbox.front());
+        outbox.erase(outbox.begin());
+        if (peer == "client") {
+            assert(got.empty());
+            got = std::move(mmsg);
+            continue;
+        }
+        if (peer == mute) {
+            continue;
+        }
+        mmsg.pop();             // header
+        assert(mmsg.popstr() == mdp::worker::request);
+        zmq::multipart_t reply;
+        reply.addstr(mdp::worker::ident);
+        reply.addstr(mdp::worker::reply);
+        reply.add(mmsg.pop());  // client
+        mmsg.pop();             // properties
+        reply.addmem(NULL, 0);
+        assert(mmsg.popstr() == "hello");
+        reply.addstr(peer);
+        broker.inject(fe, peer, reply);
+    }
+    return got;
+}
+
+// Check the client's reply and return the number gathered.
+static
+size_t gathered(zmq::multipart_t& mmsg, bool failed = false)
+{
+    assert(mmsg.popstr() == gdp::client::ident);
+    assert(mmsg.popstr() == "echo");
+    auto props = decode_properties(mmsg.pop());
+    assert(props.count(gdp::prop::error) == failed);
+    size_t count = std::stoul(props.at(gdp::prop::broadcast));
+    if (!failed) {
+        assert(mmsg.size() == count);
+    }
+    while (mmsg.size()) {
+        zmq::multipart_t one;
+        one.decode(mmsg.pop());
+        assert(one.popstr().substr(0, 1) == "w");
+    }
+    return count;
+}
+
+// Only workers which may decode a coded request get a copy.
+static
+void test_accepts()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    Broker broker(sock, log);
+    outbox_t outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            if (mmsg.size() > 1 and mmsg.peekstr(1) == mdp::worker::heartbeat) {
+                return;
+            }
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+    for (const char* name : {"w1", "w2", "w3"}) {
+        zmq::multipart_t ready;
+        ready.addstr(mdp::worker::ident);
+        ready.addstr(mdp::worker::ready);
+        ready.addstr("echo");
+        std::string accept = name == std::string("w2") ? "zlib" : "";
+        ready.add(encode_properties({{gdp::prop::accept, accept}}));
+        broker.inject(fe, name, ready);
+    }
+
+    properties_t props;
+    props[gdp::prop::broadcast] = "0";
+    props[gdp::prop::codec] = "zlib";
+    props[gdp::prop::coded] = "1";
+    zmq::multipart_t mmsg;
+    mmsg.addstr(gdp::client::ident);
+    mmsg.addstr("echo");
+    mmsg.add(encode_properties(props));
+    mmsg.addstr("hello");
+    broker.inject(fe, "client", mmsg);
+    assert(outbox.size() == 1 and outbox[0].first == "w2");
+    auto reply = workers_answer(broker, fe, outbox);
+    assert(gathered(reply) == 1);
+}
+
+int main()
+{
+    test_accepts();
+
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind("inproc://test_broadcast");
+
+    Broker broker(sock, log);
+    outbox_t outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            if (mmsg.size() > 1 and mmsg.peekstr(1) == mdp::worker::heartbeat) {
+                return;
+            }
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+
+    for (const char* name : {"w1", "w2", "w3"}) {
+        zmq::multipart_t ready;
+        ready.addstr(mdp::worker::ident);
+        ready.addstr(mdp::worker::ready);
+        ready.addstr("echo");
+        broker.inject(fe, name, ready);
+    }
+    assert(outbox.empty());
+
+    // All of them.
+    client_broadcast(broker, fe, "0");
+    auto reply = workers_answer(broker, fe, outbox);
+    assert(gathered(reply) == 3);
+
+    // A quorum of two.
+    client_broadcast(broker, fe, "2");
+    reply = workers_answer(broker, fe, outbox);
+    assert(gathered(reply) == 2);
+
+    // More than there are.
+    client_broadcast(broker, fe, "5");
+    reply = workers_answer(broker, fe, outbox);
+    assert(gathered(reply, true) == 3);
+
+    // One does not answer so the rest are returned after the wait.
+    client_broadcast(broker, fe, "0", "50");
+    reply = workers_answer(broker, fe, outbox, "w2");
+    assert(reply.empty());
+    sleep_ms(time_unit_t{100});
+    broker.process_ready();
+    reply = workers_answer(broker, fe, outbox);
+    assert(gathered(reply) == 2);
+
+    // Without a wait or deadline, the still busy one is waited on
+    // only until the heartbeat expiry.
+    broker.set_heartbeat(time_unit_t{20}, 2);
+    client_broadcast(broker, fe, "0");
+    reply = workers_answer(broker, fe, outbox);
+    assert(reply.empty());
+    sleep_ms(time_unit_t{60});
+    for (const char* name : {"w1", "w3"}) {
+        zmq::multipart_t heartbeat;
+        heartbeat.addstr(mdp::worker::ident);
+        heartbeat.addstr(mdp::worker::heartbeat);
+        broker.inject(fe, name, heartbeat);
+    }
+    broker.process_ready();
+    reply = workers_answer(broker, fe, outbox);
+    assert(gathered(reply) == 2);
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Test a broker actor which busy polls on a pinned thread: a request
+// goes through and a hit on the pipe stops it while it spins.
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/worker.hpp"
+
+#include "zmq_actor.hpp"
+
+#include <cassert>
+#include <thread>
+
+#include <pthread.h>
+#include <unistd.h>
+
+using namespace generaldomo;
+
+int main()
+{
+    // Pin to a CPU we may run on.
+    cpu_set_t mine;
+    CPU_ZERO(&mine);
+    pthread_getaffinity_np(pthread_self(), sizeof(mine), &mine);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &mine)) {
+        ++cpu;
+    }
+    // Spin for longer than the test so the pipe is only seen while
+    // spinning.
+    setenv("GENERALDOMO_BROKER_BUSY_POLL", "60000000", 1);
+    setenv("GENERALDOMO_BROKER_CPUS", std::to_string(cpu).c_str(), 1);
+
+    const std::string address = "ipc:///tmp/generaldomo-test-busypoll-"
+        + std::to_string(getpid());
+    zmq::context_t ctx;
+    auto pipes = zmq::create_pipe(ctx);
+    std::thread actor([&]() {
+        broker_actor(pipes.first, address, ZMQ_SERVER);
+    });
+    zmq::message_t ready;
+    auto res = pipes.second.recv(ready);
+    assert(res and ready.size() == 0);
+    unsetenv("GENERALDOMO_BROKER_BUSY_POLL");
+    unsetenv("GENERALDOMO_BROKER_CPUS");
+
+    cpu_set_t pinned;
+    CPU_ZERO(&pinned);
+    pthread_getaffinity_np(actor.native_handle(), sizeof(pinned), &pinned);
+    assert(CPU_COUNT(&pinned) == 1 and CPU_ISSET(cpu, &pinned));
+
+    console_log log;
+    {
+        zmq::socket_t wsock(ctx, ZMQ_CLIENT);
+        Worker worker(wsock, address, "echo", log);
+        zmq::socket_t csock(ctx, ZMQ_CLIENT);
+        Client client(csock, address, log);
+        client.set_timeout(time_unit_t{5000});
+
+        zmq::multipart_t request("hello"), reply;
+        client.send("echo", request);
+        worker.recv(request);
+        assert(request.popstr() == "hello");
+        reply.addstr("world");
+        worker.send(reply);
+        client.recv(reply);
+        assert(reply.size() == 1 and reply.popstr() == "world");
+    }
+
+    const time_unit_t t0 = now_ms();
+    pipes.second.send(zmq::message_t{}, zmq::send_flags::none);
+    actor.join();
+    assert(now_ms() - t0 < time_unit_t{5000});
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Test the reply cache used by the broker for idempotent services.
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/cache.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <cassert>
+
+using namespace generaldomo;
+
+static
+zmq::multipart_t make_body(const std::string& str)
+{
+    zmq::multipart_t body;
+    body.addstr(str);
+    return body;
+}
+
+// Error replies are not cached, others are.
+static
+void test_broker()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    Broker broker(sock, log);
+    service_options_t opts;
+    opts.idempotent = true;
+    broker.configure("svc", opts);
+    std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+    zmq::multipart_t ready;
+    ready.addstr(mdp::worker::ident);
+    ready.addstr(mdp::worker::ready);
+    ready.addstr("svc");
+    ready.add(encode_properties({}));
+    broker.inject(fe, "w", ready);
+
+    auto request = [&]() {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr("svc");
+        mmsg.add(encode_properties({}));
+        mmsg.addstr("question");
+        broker.inject(fe, "c", mmsg);
+    };
+    auto reply = [&](const properties_t& props, const std::string& body) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::worker::ident);
+        mmsg.addstr(mdp::worker::reply);
+        mmsg.addstr("c");
+        mmsg.add(encode_properties(props));
+        if (body.size()) {
+            mmsg.addstr(body);
+        }
+        broker.inject(fe, "w", mmsg);
+    };
+
+    request();
+    assert(outbox.size() == 1 and outbox[0].first == "w");
+    reply({{gdp::prop::error, "failed"}}, "");
+    assert(outbox.size() == 2 and outbox[1].first == "c");
+
+    // Asked again, the worker gets it again.
+    request();
+    assert(outbox.size() == 3 and outbox[2].first == "w");
+    reply({}, "answer");
+    assert(outbox.size() == 4 and outbox[3].first == "c");
+
+    // And now the reply comes from the cache.
+    request();
+    assert(outbox.size() == 5 and outbox[4].first == "c");
+    assert(outbox[4].second.size() == 4);
+    assert(outbox[4].second[3].to_string() == "answer");
+}
+
+int main()
+{
+    // hashes see frame boundaries
+    {
+        zmq::multipart_t one, two;
+        one.addstr("ab");
+        one.addstr("c");
+        two.addstr("a");
+        two.addstr("bc");
+        assert(hash_frames(one) != hash_frames(two));
+        assert(hash_frames(one) == hash_frames(one));
+        assert(hash_frames(one, hash_string("x")) != hash_frames(one));
+        assert(same_frames(one, one));
+        assert(!same_frames(one, two));
+    }
+
+    // get what was put, until it expires
+    {
+        ReplyCache cache(time_unit_t{100}, 1000);
+        properties_t props{{"k","v"}}, gprops;
+        zmq::multipart_t request = make_body("hi");
+        zmq::multipart_t body = make_body("hello"), got;
+        assert(!cache.get(1, request, time_unit_t{0}, gprops, got));
+        cache.put(1, request, time_unit_t{0}, props, body);
+        assert(body.size() == 1);
+        assert(request.size() == 1);
+        assert(cache.bytes() == 7);
+        assert(cache.get(1, request, time_unit_t{50}, gprops, got));
+        assert(gprops == props);
+        assert(got.popstr() == "hello");
+        assert(!cache.get(1, request, time_unit_t{100}, gprops, got));
+        assert(cache.size() == 0);
+        assert(cache.stats().hits == 1);
+        assert(cache.stats().misses == 2);
+        assert(cache.stats().expired == 1);
+    }
+
+    // a request whose key collides with another's misses
+    {
+        ReplyCache cache(time_unit_t{100}, 1000);
+        properties_t props, gprops;
+        zmq::multipart_t one = make_body("one"), two = make_body("two");
+        zmq::multipart_t body = make_body("reply to one"), got;
+        cache.put(1, one, time_unit_t{0}, props, body);
+        assert(!cache.get(1, two, time_unit_t{0}, gprops, got));
+        assert(got.empty());
+        assert(cache.get(1, one, time_unit_t{0}, gprops, got));
+        assert(got.popstr() == "reply to one");
+    }
+
+    // least recently used goes first when over budget
+    {
+        ReplyCache cache(time_unit_t{1000}, 10);
+        properties_t props, gprops;
+        zmq::multipart_t none, got;
+        for (ReplyCache::key_t key : {1,2}) {
+            zmq::multipart_t body = make_body("1234");
+            cache.put(key, none, time_unit_t{0}, props, body);
+        }
+        assert(cache.get(1, none, time_unit_t{0}, gprops, got));
+        zmq::multipart_t body = make_body("1234");
+        cache.put(3, none, time_unit_t{0}, props, body);
+        assert(cache.size() == 2);
+        assert(cache.stats().evictions == 1);
+        assert(!cache.get(2, none, time_unit_t{0}, gprops, got));
+        assert(cache.get(1, none, time_unit_t{0}, gprops, got));
+
+        // too big to ever hold
+        body = make_body("12345678901");
+        cache.put(4, none, time_unit_t{0}, props, body);
+        assert(!cache.get(4, none, time_unit_t{0}, gprops, got));
+
+        // the request counts too
+        zmq::multipart_t request = make_body("1234567");
+        body = make_body("1234");
+        cache.put(5, request, time_unit_t{0}, props, body);
+        assert(!cache.get(5, request, time_unit_t{0}, gprops, got));
+
+        cache.invalidate(1);
+        assert(!cache.get(1, none, time_unit_t{0}, gprops, got));
+        cache.invalidate();
+        assert(cache.size() == 0);
+        assert(cache.bytes() == 0);
+    }
+
+    test_broker();
+    return 0;
+}
@@ -0,0 +1,84 @@
+// Test that identical requests to a coalescing service share a reply.
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <cassert>
+#include <set>
+
+using namespace generaldomo;
+
+int main()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    Broker broker(sock, log);
+    service_options_t opts;
+    opts.coalesce = true;
+    broker.configure("svc", opts);
+    std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+    zmq::multipart_t ready;
+    ready.addstr(mdp::worker::ident);
+    ready.addstr(mdp::worker::ready);
+    ready.addstr("svc");
+    ready.add(encode_properties({}));
+    broker.inject(fe, "w", ready);
+
+    auto request = [&](const std::string& client, const std::string& body) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr("svc");
+        mmsg.add(encode_properties({}));
+        mmsg.addstr(body);
+        broker.inject(fe, client, mmsg);
+    };
+    auto reply = [&](const std::string& client, const std::string& body) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::worker::ident);
+        mmsg.addstr(mdp::worker::reply);
+        mmsg.addstr(client);
+        mmsg.add(encode_properties({}));
+        mmsg.addstr(body);
+        broker.inject(fe, "w", mmsg);
+    };
+
+    // N identical requests make one dispatch.
+    const size_t nclients = 5;
+    for (size_t ind=0; ind<nclients; ++ind) {
+        request("c" + std::to_string(ind), "question");
+    }
+    // A different one waits its turn.
+    request("other", "another question");
+    assert(outbox.size() == 1);
+    assert(outbox[0].first == "w");
+    outbox.clear();
+
+    // The one reply goes to all N, then the different one goes.
+    reply("c0", "answer");
+    assert(outbox.size() == nclients + 1);
+    std::set<remote_identity_t> answered;
+    for (size_t ind=0; ind<nclients; ++ind) {
+        auto& [peer, mmsg] = outbox[ind];
+        answered.insert(peer);
+        assert(mmsg.size() == 4);
+        assert(mmsg[3].to_string() == "answer");
+    }
+    assert(answered.size() == nclients);
+    assert(outbox[nclients].first == "w");
+    assert(outbox[nclients].second.peekstr(4) == "another question");
+    outbox.clear();
+
+    // Its reply is its own and nothing is left waiting.
+    reply("other", "another answer");
+    assert(outbox.size() == 1);
+    assert(outbox[0].first == "other");
+    outbox.clear();
+    request("c0", "question");
+    assert(outbox.size() == 1 and outbox[0].first == "w");
+    return 0;
+}
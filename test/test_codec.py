@@ -2,6 +2,7 @@
 
 import zmq
 import struct
+from generaldomo import native
 from generaldomo.zhelpers import encode_message, decode_message
 
 def test_codec():
@@ -23,7 +24,7 @@ def test_codec():
 
     assert(enc[ptr] == 0xFF)
     ptr += 1
-    siz = struct.unpack('=I', enc[ptr:ptr+4])[0]
+    siz = struct.unpack('>I', enc[ptr:ptr+4])[0]
     ptr += 4 
     print ('big data size',siz)
     assert(siz == 512)
@@ -32,7 +33,7 @@ def test_codec():
 
     assert(enc[ptr] == 0xFF)
     ptr += 1
-    siz = struct.unpack('=I', enc[ptr:ptr+4])[0]
+    siz = struct.unpack('>I', enc[ptr:ptr+4])[0]
     assert(siz == 512)
     print ('big frame size',siz)
     ptr += 4
@@ -44,7 +45,22 @@ def test_codec():
             m1 = m1.bytes
         assert(m1 == m2)
 
+    # An empty part, even the last, survives.
+    assert(decode_message(encode_message([b"", b"x", b""])) == [b"", b"x", b""])
+
+
+def test_codec_pure_and_native():
+    'The pure Python and native codecs agree'
+    was = native.enabled()
+    try:
+        for enable in (False, True):
+            if native.use(enable) != enable:
+                continue        # native module not built
+            test_codec()
+    finally:
+        native.use(was)
+
 
 if '__main__' == __name__:
-    test_codec()
+    test_codec_pure_and_native()
     
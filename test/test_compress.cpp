@@ -0,0 +1,292 @@
+// Test GDP properties and body compression.
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/compress.hpp"
+#include "generaldomo/multiworker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <random>
+
+using namespace generaldomo;
+
+static
+void test_properties()
+{
+    properties_t props;
+    assert(encode_properties(props).size() == 0);
+    assert(decode_properties(zmq::message_t{}).empty());
+
+    props["accept"] = "zlib,lz4";
+    props["coded"] = "0110";
+    properties_t got = decode_properties(encode_properties(props));
+    assert(got == props);
+
+    auto lst = split_list("zlib,,lz4,");
+    assert(lst.size() == 2);
+    assert(lst[0] == "zlib");
+    assert(lst[1] == "lz4");
+}
+
+static
+void test_roundtrip(const std::string& codec)
+{
+    compression_t policy{{codec}};
+    policy.adaptive = false;
+    Compressor comp(policy);
+    assert(comp.enabled());
+    assert(comp.accept() == codec);
+    assert(comp.choose("foo," + codec) == codec);
+    assert(comp.choose("foo") == "");
+
+    std::string small = "hello";
+    std::string big(10000, 'x');
+    std::string noise(10000, 0);
+    std::mt19937 rng(42);
+    for (auto& c : noise) { c = rng(); }
+
+    zmq::multipart_t body;
+    body.addstr(small);
+    body.addstr(big);
+    body.addstr(noise);
+
+    properties_t props;
+    comp.compress(body, props, codec);
+    assert(props[gdp::prop::codec] == codec);
+    assert(props[gdp::prop::coded] == "010");
+    assert(comp.stats().coded == 1);
+
+    comp.decompress(body, props);
+    assert(body.size() == 3);
+    assert(body.popstr() == small);
+    assert(body.popstr() == big);
+    assert(body.popstr() == noise);
+}
+
+static
+void test_adaptive(const std::string& codec)
+{
+    compression_t policy{{codec}};
+    policy.max_backoff = 8;
+    Compressor comp(policy);
+
+    std::mt19937 rng(42);
+    std::string noise(10000, 0);
+    zmq::multipart_t body;
+    for (int ind=0; ind<32; ++ind) {
+        for (auto& c : noise) { c = rng(); }
+        body.addstr(noise);
+    }
+    properties_t props;
+    comp.compress(body, props, codec);
+    // nothing gained so nothing marked
+    assert(props.empty());
+    // and most frames were not even tried
+    assert(comp.stats().skipped == 32);
+}
+
+static
+void test_bounds(const std::string& codec)
+{
+    zmq::message_t big(100000), coded, out;
+    memset(big.data(), 'x', big.size());
+    assert(compress_frame(codec, 1, big, coded));
+
+    // The size claimed by a peer is checked before decoding.
+    bool threw = false;
+    try {
+        decompress_frame(codec, coded, out, 1000);
+    }
+    catch (const std::runtime_error& err) {
+        threw = true;
+    }
+    assert(threw);
+
+    // A frame claiming 4 GiB from a few bytes is refused.
+    auto data = static_cast<unsigned char*>(coded.data());
+    data[0] = data[1] = data[2] = data[3] = 0xff;
+    threw = false;
+    try {
+        decompress_frame(codec, coded, out, size_t(1) << 33);
+    }
+    catch (const std::runtime_error& err) {
+        threw = true;
+    }
+    assert(threw);
+}
+
+// A truncated frame is answered with a "codec" error by workers,
+// which go on, and given to a client as an error reply.
+static
+void test_truncated(const std::string& codec)
+{
+    console_log log;
+    zmq::context_t ctx;
+    const std::string address = "inproc://test_compress_truncated";
+    zmq::socket_t bsock(ctx, ZMQ_SERVER);
+    bsock.bind(address);
+
+    zmq::message_t body(1000), coded;
+    memset(body.data(), 'x', body.size());
+    assert(compress_frame(codec, 1, body, coded));
+    const std::string cut(coded.data<char>(), coded.size() - 3);
+    const properties_t props{{gdp::prop::codec, codec}, {gdp::prop::coded, "1"}};
+
+    // Take the next message other than a heartbeat.
+    auto take = [&](zmq::multipart_t& mmsg) {
+        remote_identity_t rid;
+        do {
+            mmsg.clear();
+            rid = recv_server(bsock, mmsg);
+        } while (mmsg.peekstr(1) == mdp::worker::heartbeat);
+        return rid;
+    };
+    auto request = [&](const remote_identity_t& rid, const std::string& client,
+                       const properties_t& props, const std::string& body) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::worker::ident);
+        mmsg.addstr(mdp::worker::request);
+        mmsg.addstr(client);
+        mmsg.add(encode_properties(props));
+        mmsg.addstr(body);
+        send_server(bsock, mmsg, rid);
+    };
+    // Check a reply to a client and return its error.
+    auto replied = [&](zmq::multipart_t& mmsg, const std::string& client) {
+        assert(mmsg.peekstr(1) == mdp::worker::reply);
+        assert(mmsg.peekstr(2) == client);
+        auto rprops = decode_properties(mmsg[3]);
+        return rprops[gdp::prop::error];
+    };
+
+    worker_config_t config;
+    config.compression.codecs = {codec};
+    zmq::multipart_t mmsg;
+    {
+        zmq::socket_t wsock(ctx, ZMQ_CLIENT);
+        Worker worker(wsock, address, "svc", log, config);
+        remote_identity_t rid = take(mmsg);
+        assert(mmsg.peekstr(1) == mdp::worker::ready);
+        request(rid, "c1", props, cut);
+        request(rid, "c2", {}, "good");
+
+        zmq::multipart_t got;
+        worker.recv(got);
+        assert(got.size() == 1 and got.popstr() == "good");
+        take(mmsg);
+        assert(replied(mmsg, "c1") == "codec" and mmsg.size() == 4);
+        zmq::multipart_t reply("done");
+        worker.send(reply);
+        take(mmsg);
+        assert(replied(mmsg, "c2") == "" and mmsg.peekstr(4) == "done");
+    }
+    {
+        zmq::socket_t wsock(ctx, ZMQ_CLIENT);
+        MultiWorker worker(wsock, address, {{"svc", [](zmq::multipart_t& request) {
+            return std::move(request);
+        }}}, log, config);
+        remote_identity_t rid = take(mmsg);
+        assert(mmsg.peekstr(1) == mdp::worker::ready);
+        request(rid, "c1", props, cut);
+        worker.poll(time_unit_t{100});
+        take(mmsg);
+        assert(replied(mmsg, "c1") == "codec");
+        assert(worker.busy() == 0);
+        request(rid, "c2", {}, "good");
+        worker.poll(time_unit_t{100});
+        take(mmsg);
+        assert(replied(mmsg, "c2") == "" and mmsg.peekstr(4) == "good");
+    }
+    {
+        zmq::socket_t csock(ctx, ZMQ_CLIENT);
+        client_config_t cconfig;
+        cconfig.compression.codecs = {codec};
+        Client client(csock, address, log, cconfig);
+        zmq::multipart_t got("hello");
+        client.send("svc", got);
+        remote_identity_t rid = recv_server(bsock, mmsg);
+        mmsg.clear();
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr("svc");
+        mmsg.add(encode_properties(props));
+        mmsg.addstr(cut);
+        send_server(bsock, mmsg, rid);
+        client.recv(got);
+        assert(got.empty());
+    }
+}
+
+// A coded request fails once no worker may decode it.
+static
+void test_broker()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind("inproc://test_compress");
+
+    Broker broker(sock, log);
+    std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+    auto ready = [&](const std::string& name, const std::string& accept) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::worker::ident);
+        mmsg.addstr(mdp::worker::ready);
+        mmsg.addstr("svc");
+        mmsg.add(encode_properties({{gdp::prop::accept, accept}}));
+        broker.inject(fe, name, mmsg);
+    };
+    auto request = [&](const std::string& body) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr("svc");
+        mmsg.add(encode_properties({{gdp::prop::codec, "zlib"},
+                                    {gdp::prop::coded, "1"}}));
+        mmsg.addstr(body);
+        broker.inject(fe, "client", mmsg);
+    };
+
+    // Both requests wait on the one worker which decodes them.
+    ready("z", "zlib");
+    request("one");
+    request("two");
+    assert(outbox.size() == 1 and outbox[0].first == "z");
+    outbox.clear();
+
+    // It goes and a plain worker comes, which can not take them.
+    ready("p", "");
+    zmq::multipart_t bye;
+    bye.addstr(mdp::worker::ident);
+    bye.addstr(mdp::worker::disconnect);
+    broker.inject(fe, "z", bye);
+    assert(outbox.size() == 2);
+    for (auto& [peer, mmsg] : outbox) {
+        assert(peer == "client");
+        assert(mmsg.popstr() == gdp::client::ident);
+        mmsg.pop();
+        auto props = decode_properties(mmsg.pop());
+        assert(props.at(gdp::prop::error) == "codec");
+    }
+}
+
+int main()
+{
+    test_properties();
+
+    Compressor none;
+    assert(!none.enabled());
+
+    for (const auto& codec : codecs_available()) {
+        test_roundtrip(codec);
+        test_adaptive(codec);
+        test_bounds(codec);
+        test_truncated(codec);
+    }
+    test_broker();
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*! Test loading configuration from a file and the environment. */
+
+#include "generaldomo/config.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using namespace generaldomo;
+
+static
+bool throws(std::function<void()> func)
+{
+    try {
+        func();
+    }
+    catch (const std::runtime_error& err) {
+        std::cerr << "expected: " << err.what() << std::endl;
+        return true;
+    }
+    return false;
+}
+
+static
+void test_file()
+{
+    std::string path = "test_config.cfg";
+    {
+        std::ofstream out(path);
+        out << "# a broker\n"
+            << "heartbeat = 1000\n"
+            << "\n"
+            << "liveness=5\n"
+            << "memory_budget = 1000000\n"
+            << "spill_limit = 5000000\n"
+            << "busy_poll = 50\n"
+            << "cpus = 2,3\n"
+            << "service.echo.dispatch = ewma\n"
+            << "service.echo.max_requests = 100\n"
+            << "service.a.b.coalesce = yes\n";
+    }
+    broker_config_t config;
+    load_config(config, config_file(path));
+    std::remove(path.c_str());
+
+    assert(config.heartbeat == time_unit_t{1000});
+    assert(config.liveness == 5);
+    assert(config.memory_budget == 1000000);
+    assert(config.spill_dir.empty());
+    assert(config.spill_limit == 5000000);
+    assert(config.busy_poll == std::chrono::microseconds{50});
+    assert(config.cpus == std::vector<int>({2, 3}));
+    assert(config.io_cpus.empty());
+    assert(config.services.size() == 2);
+    assert(config.services["echo"].dispatch == "ewma");
+    assert(config.services["echo"].max_requests == 100);
+    assert(config.services["a.b"].coalesce);
+
+    assert(throws([]() { config_file("/no/such/file"); }));
+}
+
+static
+void test_env()
+{
+    setenv("GDTEST_CLIENT_TIMEOUT", "42", 1);
+    setenv("GDTEST_CLIENT_BACKOFF__CAP", "9000", 1);
+    setenv("GDTEST_CLIENT_HEDGING__PERCENTILE", "0.95", 1);
+    setenv("GDTEST_CLIENT_COMPRESSION__CODECS", "zlib", 1);
+    setenv("GDTEST_CLIENT_WINDOW", "16", 1);
+    setenv("GDTEST_CLIENT_LIVENESS", "5", 1);
+    client_config_t config;
+    load_config(config, config_env("GDTEST_CLIENT_"));
+    assert(config.timeout == time_unit_t{42});
+    assert(config.backoff.cap == time_unit_t{9000});
+    assert(config.hedging.percentile == 0.95);
+    assert(config.compression.codecs.size() == 1);
+    assert(!config.deadline);
+    assert(config.window == 16);
+    assert(config.liveness == 5);
+
+    setenv("GDTEST_WORKER_BUSY_HEARTBEAT", "on", 1);
+    setenv("GDTEST_WORKER_HEARTBEAT", "500", 1);
+    setenv("GDTEST_WORKER_TRANSFER", "yes", 1);
+    worker_config_t wconfig;
+    load_config(wconfig, config_env("GDTEST_WORKER_"));
+    assert(wconfig.busy_heartbeat);
+    assert(wconfig.heartbeat == time_unit_t{500});
+    assert(wconfig.transfer);
+}
+
+static
+void test_errors()
+{
+    broker_config_t bconfig;
+    assert(throws([&]() { load_config(bconfig, {{"hearbeat", "1"}}); }));
+    assert(throws([&]() { load_config(bconfig, {{"heartbeat", "0"}}); }));
+    assert(throws([&]() { load_config(bconfig, {{"liveness", "x"}}); }));
+    assert(throws([&]() { load_config(bconfig, {{"service.echo", "1"}}); }));
+    assert(throws([&]() { load_config(bconfig, {{"service.echo.nope", "1"}}); }));
+    worker_config_t wconfig;
+    assert(throws([&]() { load_config(wconfig, {{"hedging.delay", "1"}}); }));
+    assert(throws([&]() { load_config(wconfig, {{"busy_heartbeat", "maybe"}}); }));
+}
+
+static
+void test_options()
+{
+    service_options_t opts;
+    assert(set_option(opts, "busy_expiry", "30000"));
+    assert(set_option(opts, "max_batch", "8"));
+    assert(!set_option(opts, "bogus", "1"));
+    auto got = get_options(opts);
+    assert(got["busy_expiry"] == "30000");
+    assert(got["max_batch"] == "8");
+    assert(got["dispatch"] == "lifo");
+
+    // What is got may be set back.
+    service_options_t copy;
+    for (const auto& [key, value] : got) {
+        assert(set_option(copy, key, value));
+    }
+    assert(get_options(copy) == got);
+}
+
+// A bad environment fails the broker actor, not the process.
+static
+void test_actor()
+{
+    setenv("GENERALDOMO_BROKER_HEARBEAT", "1", 1);
+    zmq::context_t ctx;
+    auto pipes = zmq::create_pipe(ctx);
+    std::thread actor([&]() {
+        broker_actor(pipes.first, "inproc://test_config", ZMQ_SERVER);
+    });
+    zmq::message_t ready;
+    auto res = pipes.second.recv(ready);
+    assert(ready.to_string().find("hearbeat") != std::string::npos);
+    pipes.second.send(zmq::message_t{}, zmq::send_flags::none);
+    actor.join();
+    unsetenv("GENERALDOMO_BROKER_HEARBEAT");
+}
+
+int main()
+{
+    test_file();
+    test_env();
+    test_errors();
+    test_options();
+    test_actor();
+    return 0;
+}
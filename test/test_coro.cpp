@@ -0,0 +1,80 @@
+/*! Test the coroutine API
+
+  One thread runs a scheduler with some async echo workers and many
+  concurrent requests from one async client, all through a broker
+  actor.  Only built if configured --with-coroutines.
+
+  $ ./build/test_coro [nrequests [nworkers]]
+
+ */
+
+#include "generaldomo/coro.hpp"
+#include "generaldomo/broker.hpp"
+
+#include <zmq_actor.hpp>
+
+using namespace generaldomo;
+
+static
+Task<void> serve(AsyncWorker& worker)
+{
+    while (true) {
+        zmq::multipart_t request = co_await worker.next();
+        co_await worker.reply(std::move(request));
+    }
+}
+
+static
+Task<void> ask(AsyncClient& client, int ind, int& ngood, int& ndone)
+{
+    zmq::multipart_t request(std::to_string(ind));
+    zmq::multipart_t reply = co_await client.request("echo", std::move(request),
+                                                     time_unit_t{10000});
+    if (reply.size() == 1 and reply.popstr() == std::to_string(ind)) {
+        ++ngood;
+    }
+    ++ndone;
+}
+
+int main(int argc, char* argv[])
+{
+    int nrequests = 1000;
+    int nworkers = 4;
+    if (argc > 1) { nrequests = atoi(argv[1]); }
+    if (argc > 2) { nworkers = atoi(argv[2]); }
+
+    console_log log;
+    zmq::context_t ctx;
+    std::string address = "tcp://127.0.0.1:5560";
+    zmq::actor_t broker(ctx, broker_actor, address, ZMQ_SERVER);
+
+    Scheduler sched;
+
+    std::vector<zmq::socket_t> wsocks;
+    std::vector<std::unique_ptr<AsyncWorker>> workers;
+    for (int ind=0; ind<nworkers; ++ind) {
+        wsocks.emplace_back(ctx, ZMQ_CLIENT);
+    }
+    for (auto& sock : wsocks) {
+        workers.push_back(std::make_unique<AsyncWorker>(sched, sock, address, "echo", log));
+        sched.spawn(serve(*workers.back()));
+    }
+
+    zmq::socket_t csock(ctx, ZMQ_CLIENT);
+    AsyncClient client(sched, csock, address, log);
+    int ngood = 0, ndone = 0;
+    for (int ind=0; ind<nrequests; ++ind) {
+        sched.spawn(ask(client, ind, ngood, ndone));
+    }
+
+    while (ndone < nrequests and !interrupted()) {
+        sched.run_once(time_unit_t{100});
+    }
+    log.info("coro test got " + std::to_string(ngood) + " of "
+             + std::to_string(nrequests) + " replies");
+    assert(ngood == nrequests);
+    assert(client.outstanding() == 0);
+
+    broker.pipe().send(zmq::message_t{}, zmq::send_flags::none);
+    return 0;
+}
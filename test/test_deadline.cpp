@@ -0,0 +1,90 @@
+// Test request deadlines: a late request is dropped and counted by
+// the broker and a worker is told the time left.
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/worker.hpp"
+
+#include <cassert>
+
+using namespace generaldomo;
+
+// Let the broker handle what has come.
+static
+void pump(Broker& broker)
+{
+    for (int count=0; count<10; ++count) {
+        broker.process_ready();
+        sleep_ms(time_unit_t{5});
+    }
+}
+
+static
+std::string stat(Client& client, Broker& broker, const std::string& name)
+{
+    zmq::multipart_t request("svc"), reply;
+    client.send("mmi.stats", request);
+    pump(broker);
+    client.recv(reply);
+    assert(reply.popstr() == "200");
+    while (reply.size() >= 2) {
+        std::string key = reply.popstr();
+        std::string value = reply.popstr();
+        if (key == name) {
+            return value;
+        }
+    }
+    return "";
+}
+
+int main()
+{
+    console_log log;
+    zmq::context_t ctx;
+    std::string address = "inproc://test_deadline";
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind(address);
+    Broker broker(sock, log);
+
+    // Given up on before any worker comes.
+    zmq::socket_t lsock(ctx, ZMQ_CLIENT);
+    Client late(lsock, address, log);
+    late.set_timeout(time_unit_t{50}, true);
+    zmq::multipart_t request("late");
+    late.send("svc", request);
+    pump(broker);
+    sleep_ms(time_unit_t{100});
+
+    // Deadlines may also be asked for by configuration.
+    zmq::socket_t csock(ctx, ZMQ_CLIENT);
+    client_config_t config;
+    config.deadline = true;
+    Client client(csock, address, log, config);
+    request = zmq::multipart_t("hello");
+    client.send("svc", request);
+    pump(broker);
+
+    zmq::socket_t wsock(ctx, ZMQ_CLIENT);
+    Worker worker(wsock, address, "svc", log);
+    pump(broker);
+    worker.recv(request);
+    assert(request.popstr() == "hello");
+    assert(worker.remaining() > time_unit_t{0});
+    assert(worker.remaining() <= HEARTBEAT_INTERVAL);
+    zmq::multipart_t reply("world");
+    worker.send(reply);
+    pump(broker);
+    client.recv(reply);
+    assert(reply.popstr() == "world");
+    assert(stat(client, broker, "expired") == "1");
+
+    // Without a deadline, as by default, there is no limit.
+    client.set_timeout(HEARTBEAT_INTERVAL);
+    request = zmq::multipart_t("hello");
+    client.send("svc", request);
+    pump(broker);
+    worker.recv(request);
+    assert(request.popstr() == "hello");
+    assert(worker.remaining() == time_unit_t::max());
+    return 0;
+}
@@ -0,0 +1,112 @@
+// Test the choice made by each built-in dispatch policy.
+
+#include "generaldomo/dispatch.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <set>
+
+using namespace generaldomo;
+
+static
+std::vector<worker_info_t> make_infos(const std::vector<double>& ewmas)
+{
+    std::vector<worker_info_t> infos;
+    for (double one : ewmas) {
+        worker_info_t info;
+        if (one > 0) {
+            info.learn(one);
+        }
+        infos.push_back(info);
+    }
+    return infos;
+}
+
+static
+std::vector<const worker_info_t*> pointers(const std::vector<worker_info_t>& infos)
+{
+    std::vector<const worker_info_t*> ret;
+    for (const auto& one : infos) {
+        ret.push_back(&one);
+    }
+    return ret;
+}
+
+static
+void test_learn()
+{
+    worker_info_t info;
+    info.learn(2.0);
+    assert(info.served == 1);
+    assert(info.ewma == 2.0);
+    info.learn(6.0);
+    assert(info.served == 2);
+    assert(std::abs(info.ewma - (2.0 + worker_info_t::weight*4.0)) < 1e-12);
+}
+
+static
+void test_order()
+{
+    auto infos = make_infos({3, 1, 2});
+    auto cands = pointers(infos);
+    auto fifo = make_dispatch("fifo");
+    auto lifo = make_dispatch("lifo");
+    // Speed does not matter, only the order of becoming ready.
+    assert(fifo->choose(cands) == 0);
+    assert(lifo->choose(cands) == 2);
+    cands.resize(1);
+    assert(fifo->choose(cands) == 0);
+    assert(lifo->choose(cands) == 0);
+}
+
+static
+void test_ewma()
+{
+    auto ewma = make_dispatch("ewma");
+    auto infos = make_infos({3, 1, 2});
+    assert(ewma->choose(pointers(infos)) == 1);
+
+    // Ties go to the one waiting longest.
+    infos = make_infos({3, 1, 1});
+    assert(ewma->choose(pointers(infos)) == 1);
+
+    // One yet to serve is tried first.
+    infos = make_infos({3, 1, 0});
+    assert(ewma->choose(pointers(infos)) == 2);
+}
+
+static
+void test_p2c()
+{
+    auto p2c = make_dispatch("p2c");
+    auto infos = make_infos({5});
+    assert(p2c->choose(pointers(infos)) == 0);
+
+    // Of two, always the faster.
+    infos = make_infos({2, 1});
+    for (int count=0; count<100; ++count) {
+        assert(p2c->choose(pointers(infos)) == 1);
+    }
+
+    // Of more, never the slowest as it always loses its pair, and
+    // each of the others some of the time.
+    infos = make_infos({1, 4, 2, 3});
+    std::set<size_t> chosen;
+    for (int count=0; count<1000; ++count) {
+        size_t ind = p2c->choose(pointers(infos));
+        assert(ind < infos.size());
+        assert(ind != 1);
+        chosen.insert(ind);
+    }
+    assert(chosen.size() == 3);
+}
+
+int main()
+{
+    test_learn();
+    test_order();
+    test_ewma();
+    test_p2c();
+    assert(make_dispatch("bogus") == nullptr);
+    return 0;
+}
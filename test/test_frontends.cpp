@@ -0,0 +1,133 @@
+/*! Test one broker serving a ROUTER and a SERVER socket
+
+  Services are shared so a DEALER client on the ROUTER is served by a
+  CLIENT worker on the SERVER and a CLIENT client on the SERVER is
+  served by a DEALER worker on the ROUTER.
+
+  $ ./build/test_frontends
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/worker.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <algorithm>
+
+using namespace generaldomo;
+
+const int nrequests = 10;
+
+static
+void echo_client(zmq::socket_t& pipe, std::string address, int socktype,
+                 std::string service)
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, socktype);
+    Client client(sock, address, log);
+    pipe.send(zmq::message_t{}, zmq::send_flags::none);
+
+    int ngood = 0;
+    for (int ind=0; ind<nrequests; ++ind) {
+        zmq::multipart_t mmsg(std::to_string(ind));
+        client.send(service, mmsg);
+        client.recv(mmsg);
+        if (mmsg.size() == 1 and mmsg.popstr() == std::to_string(ind)) {
+            ++ngood;
+        }
+    }
+    pipe.send(zmq::message_t(&ngood, sizeof(int)), zmq::send_flags::none);
+    zmq::message_t die;
+    auto res = pipe.recv(die);
+}
+
+static
+void named_worker(zmq::socket_t& pipe, std::string address, int socktype,
+                  std::string service)
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, socktype);
+    Worker worker(sock, address, service, log);
+    pipe.send(zmq::message_t{}, zmq::send_flags::none);
+
+    zmq::poller_t<> poller;
+    poller.add(pipe, zmq::event_flags::pollin);
+    poller.add(sock, zmq::event_flags::pollin);
+    while (true) {
+        std::vector< zmq::poller_event<> > events(2);
+        int nevents = poller.wait_all(events, time_unit_t{500});
+        for (int iev=0; iev < nevents; ++iev) {
+            if (events[iev].socket == pipe) {
+                zmq::message_t die;
+                auto res = pipe.recv(die);
+                return;
+            }
+            zmq::multipart_t request;
+            worker.recv(request);
+            if (request.size()) {
+                worker.send(request);
+            }
+        }
+    }
+}
+
+static
+int wait_for(zmq::actor_t& client, Broker& broker, zmq::poller_t<>& poller)
+{
+    time_unit_t give_up = now_ms() + time_unit_t{10000};
+    while (now_ms() < give_up) {
+        std::vector< zmq::poller_event<> > events(3);
+        poller.wait_all(events, std::min(broker.next_timeout(), time_unit_t{100}));
+        broker.process_ready();
+        if (client.pipe().getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN) {
+            zmq::message_t msg;
+            auto res = client.pipe().recv(msg);
+            return *msg.data<int>();
+        }
+    }
+    return -1;
+}
+
+int main()
+{
+    console_log log;
+    zmq::context_t ctx;
+    std::string saddr = "tcp://127.0.0.1:5563";
+    std::string raddr = "tcp://127.0.0.1:5564";
+    zmq::socket_t ssock(ctx, ZMQ_SERVER);
+    ssock.bind(saddr);
+    zmq::socket_t rsock(ctx, ZMQ_ROUTER);
+    rsock.bind(raddr);
+
+    Broker broker(ssock, log);
+    broker.add_socket(rsock);
+    assert(broker.fds().size() == 2);
+    assert(broker.fds()[0] == broker.fd());
+
+    zmq::poller_t<> poller;
+    poller.add(ssock, zmq::event_flags::pollin);
+    poller.add(rsock, zmq::event_flags::pollin);
+
+    // Workers and clients of each service are on opposite sockets.
+    zmq::actor_t sworker(ctx, named_worker, saddr, ZMQ_CLIENT, std::string("alpha"));
+    zmq::actor_t rworker(ctx, named_worker, raddr, ZMQ_DEALER, std::string("beta"));
+
+    zmq::actor_t rclient(ctx, echo_client, raddr, ZMQ_DEALER, std::string("alpha"));
+    int ngood = wait_for(rclient, broker, poller);
+    log.info("frontends test router client got " + std::to_string(ngood));
+    assert(ngood == nrequests);
+
+    zmq::actor_t sclient(ctx, echo_client, saddr, ZMQ_CLIENT, std::string("beta"));
+    ngood = wait_for(sclient, broker, poller);
+    log.info("frontends test server client got " + std::to_string(ngood));
+    assert(ngood == nrequests);
+
+    for (auto* actor : {&rclient, &sclient, &sworker, &rworker}) {
+        actor->pipe().send(zmq::message_t{}, zmq::send_flags::none);
+    }
+    return 0;
+}
@@ -26,8 +26,10 @@
 #include "generaldomo/broker.hpp"
 #include "generaldomo/client.hpp"
 #include "generaldomo/worker.hpp"
+#include "generaldomo/protocol.hpp"
 
 #include <zmq_actor.hpp>
+#include <cassert>
 
 using namespace generaldomo;
 
@@ -69,6 +71,26 @@ void countdown_echo(zmq::socket_t& pipe, std::string address, int socktype)
             log.info(ss.str());
         }
     }
+
+    // The same countdown, as one batch.
+    std::vector<zmq::multipart_t> batch;
+    for (std::string one : {"3...", "2...", "1...", "blast off!"}) {
+        batch.emplace_back(one);
+    }
+    client.send_batch("echo", batch);
+    client.recv_batch(batch);
+    if (batch.size() != 4) {
+        log.error("countdown echo batch timeout");
+    }
+    else {
+        std::stringstream ss;
+        ss << "countdown echo batch [" << batch.size() << "]:";
+        for (auto& one : batch) {
+            ss << "\n\t" << one.popstr();
+        }
+        log.info(ss.str());
+    }
+
     pipe.send(zmq::message_t{}, zmq::send_flags::none);
     zmq::message_t die;
     auto res = pipe.recv(die);
@@ -76,6 +98,49 @@ void countdown_echo(zmq::socket_t& pipe, std::string address, int socktype)
 }
 
 
+// An empty batch is refused by the client and, if sent anyway, by
+// the broker with an error.
+void bad_batch()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    Broker broker(sock, log);
+    std::vector<zmq::multipart_t> outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(std::move(mmsg));
+        });
+    for (const char* count : {"0", "2"}) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr("echo");
+        mmsg.add(encode_properties({{gdp::prop::batch, count}}));
+        if (count[0] == '2') {
+            mmsg.addstr("just one");
+        }
+        broker.inject(fe, "client", mmsg);
+    }
+    assert(outbox.size() == 2);
+    for (auto& reply : outbox) {
+        assert(reply.size() == 3);
+        auto props = decode_properties(reply[2]);
+        assert(props.at(gdp::prop::error) == "batch");
+    }
+
+    zmq::socket_t csock(ctx, ZMQ_CLIENT);
+    Client client(csock, "inproc://test_gdp_batch", log);
+    std::vector<zmq::multipart_t> none;
+    bool threw = false;
+    try {
+        client.send_batch("echo", none);
+    }
+    catch (const std::runtime_error& err) {
+        threw = true;
+    }
+    assert(threw);
+}
+
 void doit(int serverish, int clientish, int nclients, int nworkers)
 {
     console_log log;
@@ -140,6 +205,7 @@ int main(int argc, char* argv[])
         nworkers = atoi(argv[3]);
     }
 
+    bad_batch();
     if (which == "server") {
         doit(ZMQ_SERVER, ZMQ_CLIENT, nclients, nworkers);
     }
@@ -0,0 +1,154 @@
+/*! Test a worker heartbeating while busy
+
+  The service lets busy workers go unheard for less time than the
+  handler takes.  A worker which heartbeats in the background while
+  busy must still get its reply through.
+
+  $ ./build/test_heartbeat [busy_ms]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/worker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <cassert>
+
+using namespace generaldomo;
+
+static
+void slow_worker(zmq::socket_t& pipe, std::string address, int busy_ms)
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_CLIENT);
+    Worker worker(sock, address, "slow", log, compression_t{}, true);
+    pipe.send(zmq::message_t{}, zmq::send_flags::none);
+
+    zmq::multipart_t request;
+    while (request.empty() and !interrupted()) {
+        worker.recv(request);
+    }
+    sleep_ms(time_unit_t{busy_ms});
+    worker.send(request);
+
+    zmq::message_t die;
+    auto res = pipe.recv(die);
+}
+
+static
+void slow_client(zmq::socket_t& pipe, std::string address, int busy_ms)
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_CLIENT);
+    Client client(sock, address, log);
+    client.set_timeout(time_unit_t{2*busy_ms});
+    pipe.send(zmq::message_t{}, zmq::send_flags::none);
+
+    zmq::multipart_t mmsg("hello");
+    client.send("slow", mmsg);
+    client.recv(mmsg);
+    int ngood = mmsg.size() == 1 and mmsg.popstr() == "hello";
+    pipe.send(zmq::message_t(&ngood, sizeof(int)), zmq::send_flags::none);
+
+    zmq::message_t die;
+    auto res = pipe.recv(die);
+}
+
+// A worker which returns to recv() without a reply stops busy
+// heartbeats all the same.
+static
+void test_empty_reply()
+{
+    console_log log;
+    zmq::context_t ctx;
+    std::string address = "inproc://test_heartbeat_empty";
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind(address);
+
+    zmq::socket_t wsock(ctx, ZMQ_CLIENT);
+    worker_config_t config;
+    config.heartbeat = time_unit_t{10};
+    config.busy_heartbeat = true;
+    Worker worker(wsock, address, "svc", log, config);
+
+    zmq::multipart_t mmsg;
+    remote_identity_t rid = recv_server(sock, mmsg); // READY
+    mmsg.clear();
+    mmsg.addstr(mdp::worker::ident);
+    mmsg.addstr(mdp::worker::request);
+    mmsg.addstr("client");
+    mmsg.addmem(NULL, 0);
+    mmsg.addstr("hello");
+    send_server(sock, mmsg, rid);
+
+    zmq::multipart_t request;
+    worker.recv(request);
+    assert(request.size() == 1);
+    zmq::multipart_t none;
+    worker.send(none);
+    worker.recv(request);       // times out
+
+    // Drain, then the worker left alone must stay quiet.
+    auto ready = [&]() {
+        return sock.getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN;
+    };
+    while (ready()) {
+        recv_server(sock, mmsg);
+    }
+    sleep_ms(time_unit_t{100});
+    int heard = 0;
+    while (ready()) {
+        recv_server(sock, mmsg);
+        ++heard;
+    }
+    assert(heard <= 1);
+}
+
+int main(int argc, char* argv[])
+{
+    test_empty_reply();
+
+    int busy_ms = 10000;
+    if (argc > 1) { busy_ms = atoi(argv[1]); }
+
+    console_log log;
+    zmq::context_t ctx;
+    std::string address = "tcp://127.0.0.1:5561";
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind(address);
+    Broker broker(sock, log);
+    service_options_t opts;
+    opts.busy_expiry = time_unit_t{busy_ms/2};
+    broker.configure("slow", opts);
+
+    zmq::actor_t worker(ctx, slow_worker, address, busy_ms);
+    zmq::actor_t client(ctx, slow_client, address, busy_ms);
+
+    zmq::poller_t<> poller;
+    poller.add(sock, zmq::event_flags::pollin);
+    poller.add(client.pipe(), zmq::event_flags::pollin);
+
+    int ngood = -1;
+    time_unit_t give_up = now_ms() + time_unit_t{3*busy_ms};
+    while (ngood < 0 and now_ms() < give_up) {
+        std::vector< zmq::poller_event<> > events(2);
+        poller.wait_all(events, broker.next_timeout());
+        broker.process_ready();
+        if (client.pipe().getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN) {
+            zmq::message_t msg;
+            auto res = client.pipe().recv(msg);
+            ngood = *msg.data<int>();
+        }
+    }
+    log.info("heartbeat test got " + std::to_string(ngood) + " good reply");
+    assert(ngood == 1);
+
+    client.pipe().send(zmq::message_t{}, zmq::send_flags::none);
+    worker.pipe().send(zmq::message_t{}, zmq::send_flags::none);
+    return 0;
+}
@@ -0,0 +1,269 @@
+// Test hedged requests: the client side against a scripted broker
+// and mmi.cancel against the real one.
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace generaldomo;
+
+// Stands in for a broker.  A "fast" request is answered at once, any
+// other after a while unless a copy comes, which is answered at once
+// with "hedge".  The original is still answered later, with
+// "original", and so comes stale.
+struct Responder {
+    zmq::socket_t sock;
+    std::atomic<bool> stop{false};
+    std::mutex mutex;
+    // Ids seen per request body and ids cancelled.
+    std::map<std::string, std::vector<std::string>> ids;
+    std::vector<std::string> cancelled;
+    std::thread thread;
+
+    Responder(zmq::context_t& ctx, const std::string& address)
+        : sock(ctx, ZMQ_SERVER)
+    {
+        sock.bind(address);
+        thread = std::thread([this]() { run(); });
+    }
+    ~Responder() {
+        stop = true;
+        thread.join();
+    }
+
+    void reply(remote_identity_t rid, const std::string& service,
+               const std::string& id, const std::string& body) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr(service);
+        properties_t props;
+        if (id.size()) {
+            props[gdp::prop::id] = id;
+        }
+        mmsg.add(encode_properties(props));
+        mmsg.addstr(body);
+        send_server(sock, mmsg, rid);
+    }
+
+    void run() {
+        struct Pending {
+            remote_identity_t rid;
+            std::string service, id, body;
+            time_unit_t due;
+        };
+        std::vector<Pending> pending;
+        zmq::poller_t<> poller;
+        poller.add(sock, zmq::event_flags::pollin);
+        while (!stop) {
+            std::vector< zmq::poller_event<> > events(1);
+            if (poller.wait_all(events, time_unit_t{5}) > 0) {
+                zmq::multipart_t mmsg;
+                remote_identity_t rid = recv_server(sock, mmsg);
+                mmsg.pop();     // header
+                std::string service = mmsg.popstr();
+                properties_t props = decode_properties(mmsg.pop());
+                if (service == "mmi.cancel") {
+                    mmsg.pop();
+                    std::lock_guard<std::mutex> lock(mutex);
+                    cancelled.push_back(mmsg.popstr());
+                    reply(rid, service, "", "200");
+                    continue;
+                }
+                std::string id = props[gdp::prop::id];
+                std::string body = mmsg.popstr();
+                bool copy = false;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    copy = ids[body].size() > 0;
+                    ids[body].push_back(id);
+                }
+                if (body == "fast") {
+                    reply(rid, service, id, body);
+                }
+                else if (copy) {
+                    reply(rid, service, id, "hedge");
+                }
+                else {
+                    pending.push_back(Pending{rid, service, id, body,
+                                              now_ms() + time_unit_t{100}});
+                }
+            }
+            const time_unit_t now = now_ms();
+            for (auto it = pending.begin(); it != pending.end();) {
+                if (it->due <= now) {
+                    reply(it->rid, it->service, it->id, "original");
+                    it = pending.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+    }
+};
+
+static
+std::string ask(Client& client, const std::string& body)
+{
+    zmq::multipart_t request, reply;
+    request.addstr(body);
+    client.send("svc", request);
+    client.recv(reply);
+    assert(reply.size() == 1);
+    return reply.popstr();
+}
+
+// Replies are matched by id, stale ones dropped and hedges are
+// limited by the budget.
+static
+void test_client()
+{
+    console_log log;
+    zmq::context_t ctx;
+    Responder responder(ctx, "inproc://test_hedge_client");
+
+    hedging_t hedging;
+    hedging.delay = time_unit_t{20};
+    hedging.budget = 0.5;
+    hedging.burst = 1;
+    zmq::socket_t sock(ctx, ZMQ_CLIENT);
+    Client client(sock, "inproc://test_hedge_client", log,
+                  compression_t{}, hedging);
+    client.set_timeout(time_unit_t{2000});
+
+    // Half a credit is not enough to hedge.
+    assert(ask(client, "slow1") == "original");
+    assert(client.hedge_stats().refused == 1);
+    assert(client.hedge_stats().hedged == 0);
+
+    // A whole one is and the hedge wins.
+    assert(ask(client, "slow2") == "hedge");
+    assert(client.hedge_stats().hedged == 1);
+    assert(client.hedge_stats().won == 1);
+
+    // The stale reply to the original comes while waiting on this.
+    assert(ask(client, "slow3") == "original");
+    assert(client.hedge_stats().refused == 2);
+    assert(client.hedge_stats().requests == 3);
+
+    std::lock_guard<std::mutex> lock(responder.mutex);
+    assert(responder.ids["slow1"].size() == 1);
+    auto& copies = responder.ids["slow2"];
+    assert(copies.size() == 2);
+    assert(copies[0] != copies[1]);
+    // The loser, and only it, was cancelled.
+    assert(responder.cancelled.size() == 1);
+    assert(responder.cancelled[0] == copies[0]);
+}
+
+// Saved credit is capped by the burst.
+static
+void test_burst()
+{
+    console_log log;
+    zmq::context_t ctx;
+    Responder responder(ctx, "inproc://test_hedge_burst");
+
+    hedging_t hedging;
+    hedging.delay = time_unit_t{20};
+    hedging.budget = 0.6;
+    hedging.burst = 1;
+    zmq::socket_t sock(ctx, ZMQ_CLIENT);
+    Client client(sock, "inproc://test_hedge_burst", log,
+                  compression_t{}, hedging);
+    client.set_timeout(time_unit_t{2000});
+
+    assert(ask(client, "fast") == "fast");
+    assert(ask(client, "fast") == "fast");
+    // Uncapped there would be credit for both.
+    assert(ask(client, "slow4") == "hedge");
+    assert(ask(client, "slow5") == "original");
+    assert(client.hedge_stats().hedged == 1);
+    assert(client.hedge_stats().refused == 1);
+}
+
+// The broker drops a queued request cancelled by its own client.
+static
+void test_cancel()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    Broker broker(sock, log);
+    std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+    auto request = [&](const std::string& client, const std::string& id) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr("svc");
+        mmsg.add(encode_properties({{gdp::prop::id, id}}));
+        mmsg.addstr("request " + id);
+        broker.inject(fe, client, mmsg);
+    };
+    auto cancel = [&](const std::string& client, const std::string& id) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr("mmi.cancel");
+        mmsg.add(encode_properties({}));
+        mmsg.addstr("svc");
+        mmsg.addstr(id);
+        broker.inject(fe, client, mmsg);
+        assert(outbox.size() == 1 and outbox[0].first == client);
+        std::string code = outbox[0].second[3].to_string();
+        outbox.clear();
+        return code;
+    };
+
+    request("c", "1");
+    request("c", "2");
+    assert(outbox.empty());
+    assert(cancel("d", "1") == "404");
+    assert(cancel("c", "3") == "404");
+    assert(cancel("c", "1") == "200");
+
+    // Only the other request goes to a worker, its id goes back.
+    zmq::multipart_t ready;
+    ready.addstr(mdp::worker::ident);
+    ready.addstr(mdp::worker::ready);
+    ready.addstr("svc");
+    ready.add(encode_properties({}));
+    broker.inject(fe, "w", ready);
+    assert(outbox.size() == 1 and outbox[0].first == "w");
+    assert(outbox[0].second.peekstr(4) == "request 2");
+    outbox.clear();
+
+    zmq::multipart_t reply;
+    reply.addstr(mdp::worker::ident);
+    reply.addstr(mdp::worker::reply);
+    reply.addstr("c");
+    reply.add(encode_properties({}));
+    reply.addstr("reply");
+    broker.inject(fe, "w", reply);
+    assert(outbox.size() == 1 and outbox[0].first == "c");
+    auto props = decode_properties(outbox[0].second[2]);
+    assert(props.at(gdp::prop::id) == "2");
+
+    // Once with a worker it can not be cancelled.
+    outbox.clear();
+    request("c", "4");
+    assert(outbox.size() == 1 and outbox[0].first == "w");
+    outbox.clear();
+    assert(cancel("c", "4") == "404");
+}
+
+int main()
+{
+    test_cancel();
+    test_client();
+    test_burst();
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*! Test the latency histogram. */
+
+#include "generaldomo/histogram.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+using namespace generaldomo;
+
+// Relative difference.
+static
+double rdiff(double a, double b)
+{
+    return std::abs(a - b) / std::max(1.0, std::abs(b));
+}
+
+static
+void test_exact()
+{
+    Histogram hist;
+    for (uint64_t val=1; val<=1000; ++val) {
+        hist.record(val);
+    }
+    assert(hist.count() == 1000);
+    assert(hist.min() == 1);
+    assert(hist.max() == 1000);
+    assert(hist.percentile(50) == 500);
+    assert(hist.percentile(99) == 990);
+    assert(hist.percentile(100) == 1000);
+    assert(hist.percentile(0) == 1);
+    assert(rdiff(hist.mean(), 500.5) < 1e-9);
+}
+
+static
+void test_precision()
+{
+    Histogram hist(1000000000);
+    for (uint64_t val = 1; val < 1000000000; val = val * 3 + 1) {
+        hist.record(val);
+        Histogram one;
+        one.record(val);
+        assert(one.percentile(50) >= val);
+        assert(rdiff(one.percentile(50), val) < 1.0/1024);
+    }
+    // Clamped above highest.
+    hist.record(5000000000);
+    assert(hist.max() == 1000000000);
+}
+
+static
+void test_add()
+{
+    Histogram a, b;
+    a.record(10, 99);
+    b.record(100000);
+    a.add(b);
+    assert(a.count() == 100);
+    assert(a.max() == 100000);
+    assert(a.percentile(99) == 10);
+    assert(a.percentile(100) >= 100000);
+    a.reset();
+    assert(a.count() == 0 and a.percentile(50) == 0);
+}
+
+static
+void test_print()
+{
+    Histogram hist;
+    for (uint64_t val=1; val<=10000; ++val) {
+        hist.record(val);
+    }
+    std::stringstream ss;
+    hist.print(ss, 1000.0);
+    std::string text = ss.str();
+    std::cerr << text;
+    assert(text.find("Percentile") != std::string::npos);
+    assert(text.find("Total count    =        10000") != std::string::npos);
+    // Last value line is the max at percentile 1.
+    assert(text.find("10.000 1.000000000000      10000\n") != std::string::npos);
+}
+
+int main()
+{
+    test_exact();
+    test_precision();
+    test_add();
+    test_print();
+    return 0;
+}
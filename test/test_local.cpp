@@ -0,0 +1,164 @@
+// Test in-process handlers: inline and pooled, failing, sharing a
+// queue with a remote worker and seen by mmi.service.
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <atomic>
+#include <cassert>
+
+using namespace generaldomo;
+
+struct harness_t {
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock{ctx, ZMQ_SERVER};
+    Broker broker{sock, log};
+    std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox;
+    size_t fe{0};
+
+    harness_t() {
+        fe = broker.add_outlet(
+            [this](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+                if (mmsg.size() > 1 and mmsg.peekstr(1) == mdp::worker::heartbeat) {
+                    return;
+                }
+                outbox.emplace_back(peer, std::move(mmsg));
+            });
+    }
+
+    void request(const std::string& service, const std::string& body,
+                 const std::string& client = "c") {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr(service);
+        mmsg.add(encode_properties({}));
+        mmsg.addstr(body);
+        broker.inject(fe, client, mmsg);
+    }
+
+    // Wait on pool threads for n messages to come out.
+    void await(size_t nmsgs) {
+        for (int count=0; count<1000 and outbox.size() < nmsgs; ++count) {
+            broker.process_ready();
+            sleep_ms(time_unit_t{1});
+        }
+        assert(outbox.size() == nmsgs);
+    }
+
+    // Take the one reply to the client, its error and body.
+    std::pair<std::string, std::string> reply(const std::string& client = "c") {
+        assert(outbox.size() == 1 and outbox[0].first == client);
+        zmq::multipart_t mmsg = std::move(outbox[0].second);
+        outbox.clear();
+        mmsg.pop();             // header
+        mmsg.pop();             // service
+        auto props = decode_properties(mmsg.pop());
+        std::string error;
+        if (props.count(gdp::prop::error)) {
+            error = props.at(gdp::prop::error);
+        }
+        return {error, mmsg.empty() ? "" : mmsg.popstr()};
+    }
+};
+
+static
+zmq::multipart_t echo(zmq::multipart_t& request, std::atomic<int>& calls)
+{
+    ++calls;
+    std::string body = request.popstr();
+    if (body == "bad") {
+        throw std::runtime_error("bad request");
+    }
+    if (body == "worse") {
+        throw 42;
+    }
+    return zmq::multipart_t(body);
+}
+
+// Failures are told as errors and not cached.
+static
+void test_handler(size_t nthreads)
+{
+    harness_t out;
+    service_options_t opts;
+    opts.idempotent = true;
+    out.broker.configure("svc", opts);
+    std::atomic<int> calls{0};
+    out.broker.add_handler("svc", [&](zmq::multipart_t& request) {
+        return echo(request, calls);
+    }, nthreads);
+
+    out.request("svc", "hello");
+    out.await(1);
+    assert(out.reply() == std::make_pair(std::string{}, std::string{"hello"}));
+
+    // Cached, so not handled again.
+    out.request("svc", "hello");
+    out.await(1);
+    assert(out.reply().second == "hello");
+    assert(calls == 1);
+
+    for (std::string body : {"bad", "worse", "bad"}) {
+        out.request("svc", body);
+        out.await(1);
+        assert(out.reply() == std::make_pair(std::string{"handler"}, std::string{}));
+    }
+    assert(calls == 4);
+}
+
+// Local and remote workers take turns from one queue and mmi sees
+// the local one.
+static
+void test_shared()
+{
+    harness_t out;
+    service_options_t opts;
+    opts.dispatch = "fifo";
+    out.broker.configure("svc", opts);
+    std::atomic<int> calls{0};
+    out.broker.add_handler("svc", [&](zmq::multipart_t& request) {
+        return echo(request, calls);
+    });
+
+    out.request("mmi.service", "svc");
+    assert(out.reply().second == "200");
+    out.request("mmi.service", "other");
+    assert(out.reply().second == "404");
+
+    zmq::multipart_t ready;
+    ready.addstr(mdp::worker::ident);
+    ready.addstr(mdp::worker::ready);
+    ready.addstr("svc");
+    ready.add(encode_properties({}));
+    out.broker.inject(out.fe, "w", ready);
+    assert(out.outbox.empty());
+
+    // The local worker waited longest so goes first, then the remote.
+    out.request("svc", "one");
+    assert(out.reply().second == "one");
+    out.request("svc", "two");
+    assert(out.outbox.size() == 1 and out.outbox[0].first == "w");
+    assert(out.outbox[0].second.peekstr(4) == "two");
+    out.outbox.clear();
+    out.request("svc", "three");
+    assert(out.reply().second == "three");
+    assert(calls == 2);
+
+    zmq::multipart_t mmsg;
+    mmsg.addstr(mdp::worker::ident);
+    mmsg.addstr(mdp::worker::reply);
+    mmsg.addstr("c");
+    mmsg.add(encode_properties({}));
+    mmsg.addstr("remote two");
+    out.broker.inject(out.fe, "w", mmsg);
+    assert(out.reply().second == "remote two");
+}
+
+int main()
+{
+    test_handler(0);
+    test_handler(2);
+    test_shared();
+    return 0;
+}
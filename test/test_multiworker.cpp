@@ -0,0 +1,222 @@
+/*! Test workers offering several services over one connection.
+
+  The broker side is tested with a worker simulated through a
+  frontend without a socket, then a MultiWorker is run against a
+  broker actor.
+
+  $ ./build/test_multiworker [address]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/multiworker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <atomic>
+#include <cassert>
+
+using namespace generaldomo;
+
+typedef std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox_t;
+
+static
+void client_send(Broker& broker, size_t fe, const std::string& service)
+{
+    zmq::multipart_t mmsg;
+    mmsg.addstr(mdp::client::ident);
+    mmsg.addstr(service);
+    mmsg.addstr("hello " + service);
+    broker.inject(fe, "client", mmsg);
+}
+
+static
+void test_broker()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind("inproc://test_multiworker");
+
+    Broker broker(sock, log);
+    outbox_t outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+
+    properties_t props;
+    props[gdp::prop::services] = "b,c";
+    zmq::multipart_t ready;
+    ready.addstr(mdp::worker::ident);
+    ready.addstr(mdp::worker::ready);
+    ready.addstr("a");
+    ready.add(encode_properties(props));
+    broker.inject(fe, "w", ready);
+
+    // One request of each service is in hand at once.
+    for (const char* service : {"a", "b", "c"}) {
+        client_send(broker, fe, service);
+    }
+    assert(outbox.size() == 3);
+    std::vector<zmq::multipart_t> requests;
+    for (auto& [peer, mmsg] : outbox) {
+        assert(peer == "w");
+        mmsg.pop();             // header
+        assert(mmsg.popstr() == mdp::worker::request);
+        zmq::multipart_t reply;
+        reply.addstr(mdp::worker::ident);
+        reply.addstr(mdp::worker::reply);
+        reply.add(mmsg.pop());  // client
+        auto rprops = decode_properties(mmsg.pop());
+        const std::string service = rprops.at(gdp::prop::service);
+        assert(mmsg.popstr() == "hello " + service);
+        reply.add(encode_properties(properties_t{{gdp::prop::service, service}}));
+        reply.addstr("done " + service);
+        requests.emplace_back(std::move(reply));
+    }
+    outbox.clear();
+
+    // Replies, in any order, go back as from their service.
+    for (size_t ind : {2, 0, 1}) {
+        broker.inject(fe, "w", requests[ind]);
+        assert(outbox.size() == 1);
+        auto& mmsg = outbox.front().second;
+        mmsg.pop();
+        std::string service = mmsg.popstr();
+        assert(mmsg.popstr() == "done " + service);
+        outbox.clear();
+    }
+
+    // One heartbeat for the connection.
+    broker.proc_heartbeat(time_unit_t{0});
+    assert(outbox.size() == 1);
+    outbox.clear();
+
+    // Leaving takes all of its services.
+    zmq::multipart_t bye;
+    bye.addstr(mdp::worker::ident);
+    bye.addstr(mdp::worker::disconnect);
+    broker.inject(fe, "w", bye);
+    for (const char* service : {"a", "b", "c"}) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::client::ident);
+        mmsg.addstr("mmi.service");
+        mmsg.addstr(service);
+        broker.inject(fe, "client", mmsg);
+        assert(outbox.size() == 1);
+        auto& reply = outbox.front().second;
+        assert(reply.size() == 3 and reply[2].to_string() == "404");
+        outbox.clear();
+    }
+}
+
+// A service named twice is offered once, so each reply finds the
+// request it answers.
+static
+void test_duplicate()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    Broker broker(sock, log);
+    outbox_t outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+
+    properties_t props;
+    props[gdp::prop::services] = "b,b,a";
+    zmq::multipart_t ready;
+    ready.addstr(mdp::worker::ident);
+    ready.addstr(mdp::worker::ready);
+    ready.addstr("a");
+    ready.add(encode_properties(props));
+    broker.inject(fe, "w", ready);
+
+    client_send(broker, fe, "b");
+    client_send(broker, fe, "b");
+    size_t nreplies = 0;
+    for (int count=0; count<2; ++count) {
+        // Only one request of b is in hand at a time.
+        assert(outbox.size() == 1 and outbox[0].first == "w");
+        zmq::multipart_t reply;
+        reply.addstr(mdp::worker::ident);
+        reply.addstr(mdp::worker::reply);
+        reply.addstr("client");
+        reply.add(encode_properties(properties_t{{gdp::prop::service, "b"}}));
+        reply.addstr("done b");
+        outbox.clear();
+        broker.inject(fe, "w", reply);
+        for (auto it = outbox.begin(); it != outbox.end();) {
+            if (it->first == "client") {
+                ++nreplies;
+                it = outbox.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    assert(nreplies == 2);
+    assert(outbox.empty());
+}
+
+static
+void test_worker(const std::string& address)
+{
+    console_log log;
+    zmq::context_t ctx;
+    auto broker = new zmq::actor_t(ctx, broker_actor, address, ZMQ_SERVER);
+
+    std::map<std::string, handler_t> handlers;
+    for (const char* name : {"up", "down"}) {
+        std::string service = name;
+        handlers[service] = [service](zmq::multipart_t& request) {
+            zmq::multipart_t reply;
+            reply.addstr(service + " " + request.popstr());
+            return reply;
+        };
+    }
+    std::atomic<bool> stop{false};
+    std::thread worker([&]() {
+        zmq::socket_t sock(ctx, ZMQ_CLIENT);
+        MultiWorker mw(sock, address, handlers, log, worker_config_t{}, 2);
+        while (!stop) {
+            mw.poll(time_unit_t{100});
+        }
+    });
+
+    {
+        zmq::socket_t sock(ctx, ZMQ_CLIENT);
+        Client client(sock, address, log);
+        for (int ind=0; ind<10; ++ind) {
+            for (const char* name : {"up", "down"}) {
+                zmq::multipart_t mmsg(std::to_string(ind));
+                client.send(name, mmsg);
+                client.recv(mmsg);
+                assert(mmsg.popstr() == std::string(name) + " " + std::to_string(ind));
+            }
+        }
+    }
+
+    stop = true;
+    worker.join();
+    broker->pipe().send(zmq::message_t{}, zmq::send_flags::none);
+    delete broker;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string address = "tcp://127.0.0.1:5568";
+    if (argc > 1) {
+        address = argv[1];
+    }
+    test_broker();
+    test_duplicate();
+    test_worker(address);
+    return 0;
+}
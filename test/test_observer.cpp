@@ -0,0 +1,159 @@
+/*! Test the broker observers.
+
+  A worker and client are simulated through a frontend without a
+  socket and what each built-in observer gathers is checked, as is
+  that of an observer not known to the library.
+
+  $ ./build/test_observer
+
+ */
+
+#include "generaldomo/broker_impl.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <cassert>
+#include <sstream>
+
+using namespace generaldomo;
+
+typedef std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox_t;
+
+// Remembers who was refused and why.
+struct RejectObserver : public NullObserver {
+    std::vector<std::string> rejects;
+    void on_reject(const std::string& service, const std::string& why) {
+        rejects.push_back(service + " " + why);
+    }
+};
+
+// Built here as the library knows only its own observers.
+template class generaldomo::BasicBroker<RejectObserver>;
+
+// Have a worker serve echo and make three requests with room to
+// queue one, then answer the first.
+template<class Observer>
+void exercise(BasicBroker<Observer>& broker)
+{
+    service_options_t opts;
+    opts.max_requests = 1;
+    broker.configure("echo", opts);
+
+    outbox_t outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+
+    zmq::multipart_t ready;
+    ready.addstr(mdp::worker::ident);
+    ready.addstr(mdp::worker::ready);
+    ready.addstr("echo");
+    broker.inject(fe, "w", ready);
+
+    for (int ind=0; ind<3; ++ind) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::client::ident);
+        mmsg.addstr("echo");
+        mmsg.addstr("hello");
+        broker.inject(fe, "c", mmsg);
+    }
+    // One given to the worker and one refused.
+    assert(outbox.size() == 2);
+    assert(outbox[0].first == "w");
+
+    zmq::multipart_t reply;
+    reply.addstr(mdp::worker::ident);
+    reply.addstr(mdp::worker::reply);
+    reply.addstr("c");
+    reply.addmem(nullptr, 0);
+    reply.addstr("hi");
+    broker.inject(fe, "w", reply);
+    // The reply and the queued request to the worker.
+    assert(outbox.size() == 4);
+}
+
+static
+void test_counting(zmq::socket_t& sock, logbase_t& log)
+{
+    BasicBroker<CountingObserver> broker(sock, log);
+    exercise(broker);
+    const auto& obs = broker.observer();
+    assert(obs.ready == 1);
+    assert(obs.accepted == 3);
+    assert(obs.bytes_in == 15);
+    assert(obs.enqueued == 2);
+    assert(obs.max_depth == 1);
+    assert(obs.rejected == 1);
+    assert(obs.dispatched == 2);
+    assert(obs.replied == 1);
+    assert(obs.bytes_out == 2);
+    assert(obs.expired == 0);
+    log.info(obs.summary());
+}
+
+static
+void test_profiling(zmq::socket_t& sock, logbase_t& log)
+{
+    BasicBroker<ProfilingObserver> broker(sock, log);
+    exercise(broker);
+    const auto& obs = broker.observer();
+    assert(obs.messages == 5);
+    for (size_t ind=0; ind<nphases; ++ind) {
+        assert(obs.ticks[ind] > 0);
+    }
+    log.info(obs.summary());
+    broker.observer().reset();
+    assert(broker.observer().messages == 0);
+}
+
+static
+void test_sampling(zmq::socket_t& sock, logbase_t& log)
+{
+    std::ostringstream out;
+    BasicBroker<SamplingObserver> broker(sock, log);
+    broker.observer().out = &out;
+    broker.observer().every = 2;
+    exercise(broker);
+
+    // Of 10 events, every other one starting with the first.  The
+    // worker identity is tagged with its frontend.
+    std::istringstream in(out.str());
+    std::vector<std::string> events;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream words(line);
+        std::string when, event, service;
+        words >> when >> event >> service;
+        assert(service == "echo");
+        events.push_back(event);
+    }
+    assert(events.size() == 5);
+    assert(events[0] == "ready");
+    assert(events[1] == "enqueue");
+    assert(events[2] == "accept");
+    assert(events[4] == "reply");
+    assert(out.str().find("ready echo 0177\n") != std::string::npos);
+}
+
+static
+void test_custom(zmq::socket_t& sock, logbase_t& log)
+{
+    BasicBroker<RejectObserver> broker(sock, log);
+    exercise(broker);
+    const auto& rejects = broker.observer().rejects;
+    assert(rejects.size() == 1 and rejects[0] == "echo overload");
+}
+
+int main()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind("inproc://test_observer");
+
+    test_counting(sock, log);
+    test_profiling(sock, log);
+    test_sampling(sock, log);
+    test_custom(sock, log);
+    return 0;
+}
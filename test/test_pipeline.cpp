@@ -0,0 +1,123 @@
+/*! Test server-side request pipelines.
+
+  Clients and workers are simulated through a broker frontend without
+  a socket.  Each worker appends its name to the body it is given.
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <cassert>
+
+using namespace generaldomo;
+
+typedef std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox_t;
+
+static
+void client_send(Broker& broker, size_t fe, const std::string& service,
+                 const std::string& pipeline)
+{
+    properties_t props;
+    props[gdp::prop::pipeline] = pipeline;
+    props[gdp::prop::id] = "42";
+    zmq::multipart_t mmsg;
+    mmsg.addstr(gdp::client::ident);
+    mmsg.addstr(service);
+    mmsg.add(encode_properties(props));
+    mmsg.addstr("hello");
+    broker.inject(fe, "client", mmsg);
+}
+
+// Have workers answer until the client has its reply, which is
+// returned.  The worker named by fail replies with an error.
+static
+zmq::multipart_t run(Broker& broker, size_t fe, outbox_t& outbox,
+                     std::vector<std::string>& seen, const std::string& fail = "")
+{
+    while (outbox.size()) {
+        auto [peer, mmsg] = std::move(outbox.front());
+        outbox.erase(outbox.begin());
+        if (peer == "client") {
+            assert(outbox.empty());
+            return std::move(mmsg);
+        }
+        seen.push_back(peer);
+        mmsg.pop();             // header
+        assert(mmsg.popstr() == mdp::worker::request);
+        zmq::multipart_t reply;
+        reply.addstr(mdp::worker::ident);
+        reply.addstr(mdp::worker::reply);
+        reply.add(mmsg.pop());  // client
+        auto props = decode_properties(mmsg.pop());
+        assert(props.at(gdp::prop::id) == "42");
+        properties_t rprops;
+        if (peer == fail) {
+            rprops[gdp::prop::error] = "failed";
+        }
+        reply.add(encode_properties(rprops));
+        reply.addstr(mmsg.popstr() + "," + peer);
+        broker.inject(fe, peer, reply);
+    }
+    assert(false);
+    return zmq::multipart_t{};
+}
+
+int main()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind("inproc://test_pipeline");
+
+    Broker broker(sock, log);
+    outbox_t outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+
+    for (const char* name : {"a", "b", "c"}) {
+        zmq::multipart_t ready;
+        ready.addstr(mdp::worker::ident);
+        ready.addstr(mdp::worker::ready);
+        ready.addstr(name);
+        ready.add(encode_properties(properties_t{}));
+        broker.inject(fe, name, ready);
+    }
+
+    // Stage replies go from worker to worker, only the last to the
+    // client.
+    std::vector<std::string> seen;
+    client_send(broker, fe, "a", "b,c");
+    auto reply = run(broker, fe, outbox, seen);
+    assert((seen == std::vector<std::string>{"a", "b", "c"}));
+    assert(reply.popstr() == gdp::client::ident);
+    assert(reply.popstr() == "c");
+    auto props = decode_properties(reply.pop());
+    assert(props.at(gdp::prop::id) == "42");
+    assert(!props.count(gdp::prop::error));
+    assert(reply.popstr() == "hello,a,b,c");
+
+    // The first error ends the pipeline.
+    seen.clear();
+    client_send(broker, fe, "a", "b,c");
+    reply = run(broker, fe, outbox, seen, "b");
+    assert((seen == std::vector<std::string>{"a", "b"}));
+    reply.pop();
+    assert(reply.popstr() == "b");
+    props = decode_properties(reply.pop());
+    assert(props.at(gdp::prop::error) == "failed");
+
+    // An empty pipeline is a plain request.
+    seen.clear();
+    client_send(broker, fe, "c", "");
+    reply = run(broker, fe, outbox, seen);
+    assert((seen == std::vector<std::string>{"c"}));
+    reply.pop();
+    reply.pop();
+    reply.pop();
+    assert(reply.popstr() == "hello,c");
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*! Test embedding a broker in an epoll loop
+
+  The broker socket is made in the main thread and brokered from an
+  epoll loop which also watches the pipe of a client actor.  An echo
+  worker actor serves the client.
+
+  $ ./build/test_reactor [server|router]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/worker.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+using namespace generaldomo;
+
+const int nrequests = 10;
+
+static
+void echo_client(zmq::socket_t& pipe, std::string address, int socktype)
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, socktype);
+    Client client(sock, address, log);
+    pipe.send(zmq::message_t{}, zmq::send_flags::none);
+
+    int ngood = 0;
+    for (int ind=0; ind<nrequests; ++ind) {
+        zmq::multipart_t mmsg(std::to_string(ind));
+        client.send("echo", mmsg);
+        client.recv(mmsg);
+        if (mmsg.size() == 1 and mmsg.popstr() == std::to_string(ind)) {
+            ++ngood;
+        }
+    }
+    pipe.send(zmq::message_t(&ngood, sizeof(int)), zmq::send_flags::none);
+    zmq::message_t die;
+    auto res = pipe.recv(die);
+}
+
+// Return true if a zmq socket, after its fd signaled, has input.
+static
+bool readable(zmq::socket_t& sock)
+{
+    return sock.getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN;
+}
+
+int main(int argc, char* argv[])
+{
+    int serverish = ZMQ_SERVER, clientish = ZMQ_CLIENT;
+    if (argc > 1 and std::string(argv[1]) == "router") {
+        serverish = ZMQ_ROUTER;
+        clientish = ZMQ_DEALER;
+    }
+
+    console_log log;
+    zmq::context_t ctx;
+    std::string address = "tcp://127.0.0.1:5559";
+    zmq::socket_t sock(ctx, serverish);
+    sock.bind(address);
+    Broker broker(sock, log);
+
+    zmq::actor_t worker(ctx, echo_worker, address, clientish);
+    zmq::actor_t client(ctx, echo_client, address, clientish);
+
+    int epfd = epoll_create1(0);
+    assert(epfd >= 0);
+    int pipe_fd = client.pipe().getsockopt<int>(ZMQ_FD);
+    for (int fd : {broker.fd(), pipe_fd}) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        int rc = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        assert(rc == 0);
+    }
+
+    int ngood = -1;
+    time_unit_t give_up = now_ms() + time_unit_t{10000};
+    while (ngood < 0 and now_ms() < give_up) {
+        epoll_event evs[2];
+        int nev = epoll_wait(epfd, evs, 2, broker.next_timeout().count());
+        assert(nev >= 0);
+        const size_t budget = 10;
+        while (broker.process_ready(budget) == budget) {
+            ;                   // more may be ready
+        }
+        if (readable(client.pipe())) {
+            zmq::message_t msg;
+            auto res = client.pipe().recv(msg);
+            assert(msg.size() == sizeof(int));
+            ngood = *msg.data<int>();
+        }
+    }
+    close(epfd);
+    log.info("reactor test got " + std::to_string(ngood) + " good replies");
+    assert(ngood == nrequests);
+
+    client.pipe().send(zmq::message_t{}, zmq::send_flags::none);
+    worker.pipe().send(zmq::message_t{}, zmq::send_flags::none);
+    return 0;
+}
@@ -0,0 +1,279 @@
+/*! Test a fleet of workers coming back after a broker restart
+
+  A large fleet of workers is simulated in one loop over a broker
+  frontend without a socket (Broker::add_outlet()).  Each simulated
+  worker acts as Worker does: it heartbeats, takes the broker as lost
+  after missing liveness heartbeats or on DISCONNECT and then sends
+  READY after a wait from its own Backoff.  The broker is torn down,
+  left down for a while and a new one put in its place.  The time
+  until mmi.stats again counts every worker is reported, as is the
+  most READY seen by the new broker in any 10 ms, which must be a
+  small part of the fleet if jitter spreads the fleet out.
+
+  A Client is also checked to ride out a slow reply and to reconnect
+  only once replies keep timing out.
+
+  $ ./build/test_reconnect [nworkers]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <cassert>
+#include <map>
+#include <memory>
+
+using namespace generaldomo;
+
+static const time_unit_t heartbeat{100};
+static const int liveness = 3;
+
+struct peer_t {
+    remote_identity_t id;
+    bool connected{true};
+    time_unit_t reconnect_at{0};
+    time_unit_t heartbeat_at{0};
+    int liveness{::liveness};
+    Backoff backoff;
+};
+
+struct fleet_t {
+    zmq::context_t ctx;
+    zmq::socket_t sock{ctx, ZMQ_SERVER};
+    console_log log;
+    std::unique_ptr<Broker> broker;
+    size_t frontend{0};
+    std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox;
+    std::vector<peer_t> peers;
+    std::map<remote_identity_t, size_t> index;
+    // READY taken by the current broker, per 10 ms since it began.
+    std::map<long, size_t> readies;
+    time_unit_t up_at{0};
+
+    void start() {
+        broker = std::make_unique<Broker>(sock, log);
+        broker->set_heartbeat(heartbeat, liveness);
+        frontend = broker->add_outlet(
+            [this](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+                outbox.emplace_back(peer, std::move(mmsg));
+            });
+        readies.clear();
+        up_at = now_ms();
+    }
+
+    // Messages to a broker which is down are lost.
+    void worker_send(peer_t& peer, const char* command) {
+        if (!broker) {
+            return;
+        }
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::worker::ident);
+        mmsg.addstr(command);
+        if (command == mdp::worker::ready) {
+            mmsg.addstr("echo");
+            ++readies[(now_ms() - up_at).count() / 10];
+        }
+        broker->inject(frontend, peer.id, mmsg);
+    }
+
+    void disconnect(peer_t& peer, time_unit_t now) {
+        peer.connected = false;
+        peer.reconnect_at = now + peer.backoff.next();
+    }
+
+    // Run the fleet and any broker for a while.
+    void run(time_unit_t duration) {
+        const time_unit_t until = now_ms() + duration;
+        while (now_ms() < until) {
+            step();
+            sleep_ms(time_unit_t{1});
+        }
+    }
+
+    void step() {
+        const time_unit_t now = now_ms();
+        if (broker) {
+            broker->process_ready();
+        }
+        for (auto& [to, mmsg] : outbox) {
+            auto it = index.find(to);
+            if (it == index.end()) {
+                continue;
+            }
+            peer_t& peer = peers[it->second];
+            if (!peer.connected) {
+                continue;
+            }
+            peer.liveness = liveness;
+            peer.backoff.reset();
+            if (mmsg.peekstr(1) == mdp::worker::disconnect) {
+                disconnect(peer, now);
+            }
+        }
+        outbox.clear();
+        for (auto& peer : peers) {
+            if (!peer.connected) {
+                if (now >= peer.reconnect_at) {
+                    peer.connected = true;
+                    peer.liveness = liveness;
+                    peer.heartbeat_at = now + heartbeat;
+                    worker_send(peer, mdp::worker::ready);
+                }
+                continue;
+            }
+            if (now < peer.heartbeat_at) {
+                continue;
+            }
+            if (--peer.liveness <= 0) {
+                disconnect(peer, now);
+                continue;
+            }
+            peer.heartbeat_at = now + heartbeat;
+            worker_send(peer, mdp::worker::heartbeat);
+        }
+    }
+
+    size_t known() {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr("mmi.stats");
+        mmsg.add(encode_properties({}));
+        mmsg.addstr("echo");
+        broker->inject(frontend, "admin", mmsg);
+        size_t have = 0;
+        for (auto it = outbox.begin(); it != outbox.end();) {
+            if (it->first != "admin") {
+                ++it;
+                continue;
+            }
+            zmq::multipart_t& reply = it->second;
+            reply.pop();        // header
+            reply.pop();        // service
+            reply.pop();        // properties
+            if (reply.popstr() == "200") {
+                while (reply.size() >= 2) {
+                    std::string name = reply.popstr();
+                    std::string value = reply.popstr();
+                    if (name == "workers") {
+                        have = std::stoul(value);
+                    }
+                }
+            }
+            it = outbox.erase(it);
+        }
+        return have;
+    }
+
+    // Run until every worker is known or give_up, return how long.
+    time_unit_t recover(time_unit_t give_up) {
+        const time_unit_t t0 = now_ms();
+        time_unit_t ask_at{0};
+        while (now_ms() < give_up) {
+            step();
+            if (now_ms() >= ask_at) {
+                if (known() == peers.size()) {
+                    break;
+                }
+                ask_at = now_ms() + time_unit_t{10};
+            }
+            sleep_ms(time_unit_t{1});
+        }
+        return now_ms() - t0;
+    }
+
+    size_t peak() const {
+        size_t most = 0;
+        for (auto [bucket, count] : readies) {
+            most = std::max(most, count);
+        }
+        return most;
+    }
+};
+
+static
+void test_fleet(size_t nworkers)
+{
+    fleet_t fleet;
+    fleet.start();
+    for (size_t ind=0; ind<nworkers; ++ind) {
+        peer_t peer;
+        peer.id = "w" + std::to_string(ind);
+        peer.connected = false;
+        fleet.index[peer.id] = ind;
+        fleet.peers.push_back(std::move(peer));
+    }
+    const time_unit_t limit{60000};
+    time_unit_t took = fleet.recover(now_ms() + limit);
+    size_t have = fleet.known();
+    fleet.log.info("reconnect test: " + std::to_string(have) + " workers up after "
+                   + std::to_string(took.count()) + " ms");
+    assert(have == nworkers);
+
+    // The broker goes away long enough to be missed, then a new one
+    // which knows no worker comes.
+    fleet.broker.reset();
+    fleet.outbox.clear();
+    fleet.run(heartbeat * (liveness + 7));
+    fleet.start();
+    took = fleet.recover(now_ms() + limit);
+    have = fleet.known();
+    fleet.log.info("reconnect test: " + std::to_string(have) + " workers back after "
+                   + std::to_string(took.count()) + " ms with at most "
+                   + std::to_string(fleet.peak()) + " READY in 10 ms");
+    assert(have == nworkers);
+    assert(fleet.peak() <= std::max<size_t>(10, nworkers/10));
+}
+
+// The client waits out a slow reply but not a lost broker.
+static
+void test_client()
+{
+    console_log log;
+    zmq::context_t ctx;
+    std::string address = "inproc://test_reconnect_client";
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind(address);
+    zmq::socket_t csock(ctx, ZMQ_CLIENT);
+    client_config_t config;
+    config.timeout = time_unit_t{20};
+    config.liveness = 2;
+    Client client(csock, address, log, config);
+
+    zmq::multipart_t request("slow"), reply;
+    client.send("echo", request);
+    client.recv(reply);
+    assert(reply.empty());
+    assert(client.connected());
+
+    // The late reply comes and is taken for the next one.
+    zmq::multipart_t mmsg;
+    remote_identity_t rid = recv_server(sock, mmsg);
+    mmsg.clear();
+    mmsg.addstr(gdp::client::ident);
+    mmsg.addstr("echo");
+    mmsg.add(encode_properties({}));
+    mmsg.addstr("late");
+    send_server(sock, mmsg, rid);
+    request = zmq::multipart_t("next");
+    client.send("echo", request);
+    client.recv(reply);
+    assert(reply.size() == 1 and reply.popstr() == "late");
+
+    // Having heard from the broker, two more timeouts make it lost.
+    client.recv(reply);
+    assert(client.connected());
+    client.recv(reply);
+    assert(!client.connected());
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nworkers = 5000;
+    if (argc > 1) { nworkers = atoi(argv[1]); }
+
+    test_client();
+    test_fleet(nworkers);
+    return 0;
+}
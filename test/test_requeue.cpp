@@ -0,0 +1,139 @@
+// Test that the request of a worker which dies is requeued and that
+// one which keeps killing workers is quarantined, and that a slow
+// worker which does not heartbeat is not taken for dead.
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <cassert>
+
+using namespace generaldomo;
+
+int main()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    Broker broker(sock, log);
+    broker.set_heartbeat(time_unit_t{10}, 1);
+    service_options_t opts;
+    opts.max_attempts = 2;
+    opts.busy_expiry = time_unit_t{100};
+    broker.configure("svc", opts);
+    std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            if (mmsg.size() > 1 and mmsg.peekstr(1) == mdp::worker::heartbeat) {
+                return;
+            }
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+    auto worker = [&](const std::string& name, const std::string& command,
+                      const std::string& service = "svc") {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::worker::ident);
+        mmsg.addstr(command);
+        if (command == mdp::worker::ready) {
+            mmsg.addstr(service);
+            mmsg.add(encode_properties({}));
+        }
+        broker.inject(fe, name, mmsg);
+    };
+    auto mmi = [&](const std::string& service) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr(service);
+        mmsg.add(encode_properties({}));
+        mmsg.addstr("svc");
+        broker.inject(fe, "admin", mmsg);
+        assert(outbox.size() == 1 and outbox[0].first == "admin");
+        zmq::multipart_t reply = std::move(outbox[0].second);
+        outbox.clear();
+        reply.pop();
+        reply.pop();
+        reply.pop();
+        return reply;
+    };
+    auto stat = [&](const std::string& name) {
+        zmq::multipart_t reply = mmi("mmi.stats");
+        assert(reply.popstr() == "200");
+        while (reply.size() >= 2) {
+            std::string key = reply.popstr();
+            std::string value = reply.popstr();
+            if (key == name) {
+                return value;
+            }
+        }
+        return std::string{};
+    };
+
+    worker("w1", mdp::worker::ready);
+    zmq::multipart_t request;
+    request.addstr(gdp::client::ident);
+    request.addstr("svc");
+    request.add(encode_properties({}));
+    request.addstr("poison pill");
+    broker.inject(fe, "c", request);
+    assert(outbox.size() == 1 and outbox[0].first == "w1");
+    outbox.clear();
+
+    // The worker goes silent while busy and is taken for dead.
+    sleep_ms(time_unit_t{150});
+    broker.process_ready();
+    assert(outbox.empty());
+    assert(stat("workers") == "0");
+    assert(stat("requeued") == "1");
+    assert(stat("requests") == "1");
+
+    // Another gets it and dies too.
+    worker("w2", mdp::worker::ready);
+    assert(outbox.size() == 1 and outbox[0].first == "w2");
+    assert(outbox[0].second.peekstr(4) == "poison pill");
+    outbox.clear();
+    worker("w2", mdp::worker::disconnect);
+
+    // Which is enough to quarantine it and fail the client.
+    assert(outbox.size() == 1 and outbox[0].first == "c");
+    auto props = decode_properties(outbox[0].second[2]);
+    assert(props.at(gdp::prop::error) == "poison");
+    assert(outbox[0].second.size() == 3);
+    outbox.clear();
+    assert(stat("quarantined") == "1");
+    assert(stat("requests") == "0");
+
+    zmq::multipart_t held = mmi("mmi.quarantine");
+    assert(held.popstr() == "200");
+    assert(held.size() == 1);
+    zmq::multipart_t body;
+    body.decode(held.pop());
+    assert(body.popstr() == "poison pill");
+
+    // It is forgotten once told.
+    held = mmi("mmi.quarantine");
+    assert(held.popstr() == "200");
+    assert(held.empty());
+
+    // Without a busy_expiry, a worker silent for well past ten
+    // heartbeat expiries still has its request.
+    worker("w3", mdp::worker::ready, "slow");
+    request.addstr(gdp::client::ident);
+    request.addstr("slow");
+    request.add(encode_properties({}));
+    request.addstr("long job");
+    broker.inject(fe, "c", request);
+    assert(outbox.size() == 1 and outbox[0].first == "w3");
+    outbox.clear();
+    sleep_ms(time_unit_t{250});
+    broker.process_ready();
+    assert(outbox.empty());
+    zmq::multipart_t reply;
+    reply.addstr(mdp::worker::ident);
+    reply.addstr(mdp::worker::reply);
+    reply.addstr("c");
+    reply.add(encode_properties({}));
+    reply.addstr("done");
+    broker.inject(fe, "w3", reply);
+    assert(outbox.size() == 1 and outbox[0].first == "c");
+    assert(outbox[0].second.peekstr(3) == "done");
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*! Test spilling queued request bodies beyond the memory budget.
+
+  Clients and a worker are simulated through a broker frontend
+  without a socket.
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/protocol.hpp"
+
+#include <cassert>
+#include <climits>
+
+#include <unistd.h>
+
+using namespace generaldomo;
+
+static
+void test_file()
+{
+    SpillFile spill;
+    zmq::message_t one("hello", 5), two("world!", 6);
+    size_t at1 = spill.write(one);
+    size_t at2 = spill.write(two);
+    assert(at1 == 0 and at2 == 5 and spill.size() == 11);
+    assert(spill.read(at2, 6).to_string() == "world!");
+    assert(spill.read(at1, 5).to_string() == "hello");
+    spill.clear();
+    assert(spill.size() == 0);
+    assert(spill.write(two) == 0);
+}
+
+static
+void test_broker()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind("inproc://test_spill");
+
+    broker_config_t config;
+    config.memory_budget = 1000;
+    Broker broker(sock, log, config);
+    std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+
+    // A backlog ten times the budget.
+    const size_t nrequests = 100;
+    for (size_t ind=0; ind<nrequests; ++ind) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::client::ident);
+        mmsg.addstr("echo");
+        mmsg.addstr(std::to_string(ind) + std::string(96, '.'));
+        broker.inject(fe, "client", mmsg);
+    }
+    assert(outbox.empty());
+    assert(broker.resident_bytes() <= 1000);
+    assert(broker.spilled_bytes() > 0);
+
+    // One worker takes them all, in order.
+    zmq::multipart_t ready;
+    ready.addstr(mdp::worker::ident);
+    ready.addstr(mdp::worker::ready);
+    ready.addstr("echo");
+    broker.inject(fe, "worker", ready);
+    size_t nreplies = 0;
+    while (outbox.size()) {
+        auto [peer, mmsg] = std::move(outbox.front());
+        outbox.erase(outbox.begin());
+        if (peer == "client") {
+            mmsg.pop();         // header
+            mmsg.pop();         // service
+            std::string body = mmsg.popstr();
+            assert(body == std::to_string(nreplies) + std::string(96, '.'));
+            ++nreplies;
+            continue;
+        }
+        assert(peer == "worker");
+        mmsg.pop();             // header
+        assert(mmsg.popstr() == mdp::worker::request);
+        zmq::multipart_t reply;
+        reply.addstr(mdp::worker::ident);
+        reply.addstr(mdp::worker::reply);
+        reply.add(mmsg.pop());  // client
+        mmsg.pop();             // properties
+        reply.addmem(NULL, 0);
+        reply.append(std::move(mmsg));
+        broker.inject(fe, "worker", reply);
+    }
+    assert(nreplies == nrequests);
+    assert(broker.resident_bytes() == 0);
+    assert(broker.spilled_bytes() == 0);
+}
+
+// A broker with one worker on "echo" behind an outlet.
+struct harness_t {
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock{ctx, ZMQ_SERVER};
+    Broker broker;
+    std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox;
+    size_t fe{0};
+
+    explicit harness_t(const broker_config_t& config)
+        : broker(sock, log, config) {
+        fe = broker.add_outlet(
+            [this](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+                outbox.emplace_back(peer, std::move(mmsg));
+            });
+        zmq::multipart_t ready;
+        ready.addstr(mdp::worker::ident);
+        ready.addstr(mdp::worker::ready);
+        ready.addstr("echo");
+        broker.inject(fe, "worker", ready);
+    }
+
+    void request(size_t ind) {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(gdp::client::ident);
+        mmsg.addstr("echo");
+        mmsg.add(encode_properties({}));
+        mmsg.addstr(std::to_string(ind) + std::string(96, '.'));
+        broker.inject(fe, "client", mmsg);
+    }
+
+    // Answer what the worker has, return the errors told the client.
+    std::vector<std::string> step() {
+        std::vector<std::string> errors;
+        auto msgs = std::move(outbox);
+        outbox.clear();
+        for (auto& [peer, mmsg] : msgs) {
+            if (peer == "client") {
+                auto props = decode_properties(mmsg[2]);
+                if (props.count(gdp::prop::error)) {
+                    errors.push_back(props.at(gdp::prop::error));
+                }
+                continue;
+            }
+            zmq::multipart_t reply;
+            reply.addstr(mdp::worker::ident);
+            reply.addstr(mdp::worker::reply);
+            reply.add(zmq::message_t(mmsg[2].data(), mmsg[2].size()));
+            reply.add(encode_properties({}));
+            reply.addstr("done");
+            broker.inject(fe, "worker", reply);
+        }
+        return errors;
+    }
+};
+
+// A backlog which never drains keeps the file small.
+static
+void test_sustained()
+{
+    broker_config_t config;
+    config.memory_budget = 1000;
+    config.spill_limit = 20000;
+    harness_t har(config);
+    size_t sent = 0;
+    for (; sent<100; ++sent) {
+        har.request(sent);
+    }
+    assert(har.broker.spilled_bytes() > 5000);
+    // Each one taken is replaced, many times what the file may hold.
+    for (int count=0; count<2000; ++count) {
+        har.request(sent++);
+        auto errors = har.step();
+        assert(errors.empty());
+    }
+    assert(har.broker.spilled_bytes() > 5000);
+}
+
+// Past the limit requests are refused.
+static
+void test_limit()
+{
+    broker_config_t config;
+    config.memory_budget = 1000;
+    config.spill_limit = 2000;
+    harness_t har(config);
+    for (size_t ind=0; ind<100; ++ind) {
+        har.request(ind);
+    }
+    size_t refused = 0;
+    for (auto& [peer, mmsg] : har.outbox) {
+        if (peer == "client") {
+            assert(decode_properties(mmsg[2]).at(gdp::prop::error) == "overload");
+            ++refused;
+        }
+    }
+    assert(refused > 50);
+    assert(har.broker.spilled_bytes() <= 2000);
+    assert(har.broker.resident_bytes() <= 1200);
+}
+
+// Lose the spill file under the broker.
+static
+void truncate_spill()
+{
+    for (int fd=3; fd<1024; ++fd) {
+        char link[PATH_MAX] = {0};
+        std::string proc = "/proc/self/fd/" + std::to_string(fd);
+        if (readlink(proc.c_str(), link, sizeof(link)-1) > 0
+            and std::string(link).find("generaldomo-spill-") != std::string::npos) {
+            assert(ftruncate(fd, 0) == 0);
+        }
+    }
+}
+
+// A body which can not be read back fails its request, not the broker.
+static
+void test_lost()
+{
+    broker_config_t config;
+    config.memory_budget = 1000;
+    harness_t har(config);
+    for (size_t ind=0; ind<30; ++ind) {
+        har.request(ind);
+    }
+    assert(har.broker.spilled_bytes() > 0);
+    truncate_spill();
+    size_t lost = 0, served = 0;
+    for (int count=0; count<100 and har.outbox.size(); ++count) {
+        for (auto& [peer, mmsg] : har.outbox) {
+            if (peer == "client" and mmsg.size() > 3) {
+                ++served;
+            }
+        }
+        for (auto& error : har.step()) {
+            assert(error == "spill");
+            ++lost;
+        }
+    }
+    assert(lost > 0 and served > 0 and lost + served == 30);
+    assert(har.broker.spilled_bytes() == 0);
+}
+
+int main()
+{
+    test_file();
+    test_broker();
+    test_sustained();
+    test_limit();
+    test_lost();
+    return 0;
+}
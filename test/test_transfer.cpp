@@ -0,0 +1,419 @@
+/*! Test requests sent in chunks.
+
+  The broker side is tested with clients and workers simulated
+  through a frontend without a socket, then a Client sends a transfer
+  through a broker actor to the echo worker.
+
+  $ ./build/test_transfer [address]
+
+ */
+
+#include "generaldomo/broker.hpp"
+#include "generaldomo/client.hpp"
+#include "generaldomo/protocol.hpp"
+#include "generaldomo/worker.hpp"
+
+#include <zmq_actor.hpp>
+
+#include <cassert>
+
+using namespace generaldomo;
+
+typedef std::vector<std::pair<remote_identity_t, zmq::multipart_t>> outbox_t;
+
+static
+void client_chunk(Broker& broker, size_t fe, const std::string& service,
+                  const std::string& transfer, size_t chunk, bool last,
+                  size_t window = 3)
+{
+    properties_t props;
+    props[gdp::prop::transfer] = transfer;
+    props[gdp::prop::chunk] = std::to_string(chunk);
+    if (chunk == 0) {
+        props[gdp::prop::window] = std::to_string(window);
+    }
+    if (last) {
+        props[gdp::prop::last] = "1";
+    }
+    zmq::multipart_t mmsg;
+    mmsg.addstr(gdp::client::ident);
+    mmsg.addstr(service);
+    mmsg.add(encode_properties(props));
+    mmsg.addstr("part" + std::to_string(chunk));
+    broker.inject(fe, "client", mmsg);
+}
+
+static
+void worker_ready(Broker& broker, size_t fe, const std::string& name,
+                  const std::string& service)
+{
+    properties_t props;
+    props[gdp::prop::transfer] = "1";
+    zmq::multipart_t ready;
+    ready.addstr(mdp::worker::ident);
+    ready.addstr(mdp::worker::ready);
+    ready.addstr(service);
+    ready.add(encode_properties(props));
+    broker.inject(fe, name, ready);
+}
+
+static
+void worker_reply(Broker& broker, size_t fe, const std::string& name,
+                  const properties_t& props, const std::string& body)
+{
+    zmq::multipart_t reply;
+    reply.addstr(mdp::worker::ident);
+    reply.addstr(mdp::worker::reply);
+    reply.addstr("client");
+    reply.add(encode_properties(props));
+    if (body.size()) {
+        reply.addstr(body);
+    }
+    broker.inject(fe, name, reply);
+}
+
+// Return the properties of a REQUEST given to a worker and check its
+// body.
+static
+properties_t given(zmq::multipart_t& mmsg, const std::string& body)
+{
+    assert(mmsg.popstr() == mdp::worker::ident);
+    assert(mmsg.popstr() == mdp::worker::request);
+    mmsg.pop();                 // client
+    auto props = decode_properties(mmsg.pop());
+    assert(mmsg.size() == (body.empty() ? 0 : 1));
+    if (body.size()) {
+        assert(mmsg.popstr() == body);
+    }
+    return props;
+}
+
+// Return the properties of a reply to the client.
+static
+properties_t replied(zmq::multipart_t& mmsg)
+{
+    assert(mmsg.popstr() == gdp::client::ident);
+    mmsg.pop();                 // service
+    return decode_properties(mmsg.pop());
+}
+
+static
+void test_broker()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+    sock.bind("inproc://test_transfer");
+
+    Broker broker(sock, log);
+    outbox_t outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+
+    // Chunks before there is a worker are held, up to the window.
+    for (size_t chunk=0; chunk<3; ++chunk) {
+        client_chunk(broker, fe, "big", "t1", chunk, false);
+    }
+    assert(outbox.empty());
+    worker_ready(broker, fe, "w", "big");
+    assert(outbox.size() == 3);
+    for (size_t chunk=0; chunk<3; ++chunk) {
+        assert(outbox[chunk].first == "w");
+        auto props = given(outbox[chunk].second, "part" + std::to_string(chunk));
+        assert(props.at(gdp::prop::transfer) == "t1");
+        assert(props.at(gdp::prop::chunk) == std::to_string(chunk));
+    }
+    outbox.clear();
+
+    // Once bound, credit goes back and chunks go straight through.
+    worker_reply(broker, fe, "w", {{gdp::prop::transfer, "t1"},
+                                   {gdp::prop::credit, "1"}}, "");
+    assert(outbox.size() == 1 and outbox[0].first == "client");
+    auto props = replied(outbox[0].second);
+    assert(props.at(gdp::prop::transfer) == "t1");
+    assert(props.at(gdp::prop::credit) == "1");
+    outbox.clear();
+    client_chunk(broker, fe, "big", "t1", 3, true);
+    assert(outbox.size() == 1);
+    props = given(outbox[0].second, "part3");
+    assert(props.count(gdp::prop::last));
+    outbox.clear();
+
+    // The real reply ends the transfer.
+    worker_reply(broker, fe, "w", {}, "whole");
+    assert(outbox.size() == 1);
+    props = replied(outbox[0].second);
+    assert(props.at(gdp::prop::transfer) == "t1");
+    assert(!props.count(gdp::prop::credit));
+    assert(outbox[0].second.popstr() == "whole");
+    outbox.clear();
+
+    // Too many chunks before a worker fails the transfer and drops
+    // the first chunk from the queue.
+    for (size_t chunk=0; chunk<3; ++chunk) {
+        client_chunk(broker, fe, "none", "t2", chunk, false, 2);
+    }
+    assert(outbox.size() == 1);
+    props = replied(outbox[0].second);
+    assert(props.at(gdp::prop::error) == "window");
+    outbox.clear();
+    client_chunk(broker, fe, "none", "t2", 3, true);
+    assert(outbox.empty());
+    worker_ready(broker, fe, "n", "none");
+    assert(outbox.empty());
+
+    // A chunk out of order ends the worker's stream and its reply is
+    // dropped.
+    client_chunk(broker, fe, "big", "t3", 0, false);
+    assert(outbox.size() == 1);
+    outbox.clear();
+    client_chunk(broker, fe, "big", "t3", 2, false);
+    assert(outbox.size() == 2);
+    for (auto& [peer, mmsg] : outbox) {
+        if (peer == "client") {
+            props = replied(mmsg);
+        }
+        else {
+            props = given(mmsg, "");
+            assert(props.count(gdp::prop::last));
+        }
+        assert(props.at(gdp::prop::error) == "transfer");
+    }
+    outbox.clear();
+    worker_reply(broker, fe, "w", {}, "late");
+    assert(outbox.empty());
+
+    // A client sending past its window and the credit given floods
+    // the worker no further.
+    client_chunk(broker, fe, "big", "t5", 0, false, 2);
+    client_chunk(broker, fe, "big", "t5", 1, false, 2);
+    assert(outbox.size() == 2 and outbox[1].first == "w");
+    outbox.clear();
+    client_chunk(broker, fe, "big", "t5", 2, false, 2);
+    assert(outbox.size() == 2);
+    for (auto& [peer, mmsg] : outbox) {
+        if (peer == "client") {
+            props = replied(mmsg);
+        }
+        else {
+            props = given(mmsg, "");
+            assert(props.count(gdp::prop::last));
+        }
+        assert(props.at(gdp::prop::error) == "window");
+    }
+    outbox.clear();
+    client_chunk(broker, fe, "big", "t5", 3, true, 2);
+    assert(outbox.empty());
+    worker_reply(broker, fe, "w", {}, "late");
+    assert(outbox.empty());
+
+    // The worker dying fails the transfer as it can not be requeued.
+    client_chunk(broker, fe, "big", "t4", 0, false);
+    assert(outbox.size() == 1);
+    outbox.clear();
+    zmq::multipart_t bye;
+    bye.addstr(mdp::worker::ident);
+    bye.addstr(mdp::worker::disconnect);
+    broker.inject(fe, "w", bye);
+    assert(outbox.size() == 1 and outbox[0].first == "client");
+    props = replied(outbox[0].second);
+    assert(props.at(gdp::prop::error) == "transfer");
+    outbox.clear();
+    client_chunk(broker, fe, "big", "t4", 1, true);
+    assert(outbox.empty());
+}
+
+// A client which holds credit but sends nothing is taken as gone: it
+// is told and the worker's stream is ended.  One waiting on credit
+// is not.
+static
+void test_idle()
+{
+    console_log log;
+    zmq::context_t ctx;
+    zmq::socket_t sock(ctx, ZMQ_SERVER);
+
+    Broker broker(sock, log);
+    broker.set_heartbeat(time_unit_t{10}, 2);
+    outbox_t outbox;
+    size_t fe = broker.add_outlet(
+        [&](const remote_identity_t& peer, zmq::multipart_t& mmsg) {
+            if (mmsg.peekstr(1) == mdp::worker::heartbeat) {
+                return;
+            }
+            outbox.emplace_back(peer, std::move(mmsg));
+        });
+    // The worker keeps itself alive.
+    auto beat = [&]() {
+        zmq::multipart_t mmsg;
+        mmsg.addstr(mdp::worker::ident);
+        mmsg.addstr(mdp::worker::heartbeat);
+        broker.inject(fe, "w", mmsg);
+    };
+
+    worker_ready(broker, fe, "w", "big");
+    client_chunk(broker, fe, "big", "t1", 0, false, 2);
+    client_chunk(broker, fe, "big", "t1", 1, false, 2);
+    assert(outbox.size() == 2);
+    outbox.clear();
+
+    // The window is used up so the client waits on the worker.
+    sleep_ms(time_unit_t{30});
+    beat();
+    broker.proc_heartbeat(time_unit_t{0});
+    assert(outbox.empty());
+
+    // Given credit, the client must go on.
+    worker_reply(broker, fe, "w", {{gdp::prop::transfer, "t1"},
+                                   {gdp::prop::credit, "1"}}, "");
+    assert(outbox.size() == 1 and outbox[0].first == "client");
+    outbox.clear();
+    broker.proc_heartbeat(time_unit_t{0});
+    assert(outbox.empty());
+    sleep_ms(time_unit_t{30});
+    beat();
+    broker.proc_heartbeat(time_unit_t{0});
+    assert(outbox.size() == 2);
+    for (auto& [peer, mmsg] : outbox) {
+        properties_t props;
+        if (peer == "client") {
+            props = replied(mmsg);
+        }
+        else {
+            props = given(mmsg, "");
+            assert(props.count(gdp::prop::last));
+            assert(props.at(gdp::prop::chunk) == "2");
+        }
+        assert(props.at(gdp::prop::error) == "idle");
+    }
+    outbox.clear();
+
+    // Told once and the worker's reply is dropped, after which the
+    // worker is free again.
+    beat();
+    broker.proc_heartbeat(time_unit_t{0});
+    assert(outbox.empty());
+    worker_reply(broker, fe, "w", {}, "late");
+    assert(outbox.empty());
+    client_chunk(broker, fe, "big", "t2", 0, true);
+    assert(outbox.size() == 1 and outbox[0].first == "w");
+}
+
+// A request which comes while the worker waits on a chunk is kept
+// for the next recv() and the reply in hand still goes to its client.
+static
+void test_worker()
+{
+    console_log log;
+    zmq::context_t ctx;
+    const std::string address = "inproc://test_transfer_worker";
+    zmq::socket_t bsock(ctx, ZMQ_SERVER);
+    bsock.bind(address);
+    zmq::socket_t wsock(ctx, ZMQ_CLIENT);
+    worker_config_t config;
+    config.transfer = true;
+    Worker worker(wsock, address, "big", log, config);
+
+    // Take the next message from the worker other than a heartbeat.
+    auto take = [&](zmq::multipart_t& mmsg) {
+        do {
+            mmsg.clear();
+            recv_server(bsock, mmsg);
+        } while (mmsg.peekstr(1) == mdp::worker::heartbeat);
+        return mmsg.peekstr(1);
+    };
+    zmq::multipart_t mmsg;
+    remote_identity_t rid = recv_server(bsock, mmsg);
+    assert(mmsg.peekstr(1) == mdp::worker::ready);
+
+    auto request = [&](const std::string& client, const properties_t& props,
+                       const std::string& body) {
+        zmq::multipart_t req;
+        req.addstr(mdp::worker::ident);
+        req.addstr(mdp::worker::request);
+        req.addstr(client);
+        req.add(encode_properties(props));
+        req.addstr(body);
+        send_server(bsock, req, rid);
+    };
+    request("c1", {{gdp::prop::transfer, "t1"}, {gdp::prop::chunk, "0"}}, "part0");
+    request("c2", {}, "other");
+
+    zmq::multipart_t chunk;
+    worker.recv(chunk);
+    assert(chunk.popstr() == "part0");
+    assert(worker.streaming());
+    assert(!worker.recv_chunk(chunk));
+    assert(chunk.empty() and !worker.streaming());
+    assert(take(mmsg) == mdp::worker::reply); // credit
+    assert(mmsg.peekstr(2) == "c1");
+
+    zmq::multipart_t reply("partial");
+    worker.send(reply);
+    assert(take(mmsg) == mdp::worker::reply);
+    assert(mmsg.peekstr(2) == "c1" and mmsg.peekstr(4) == "partial");
+
+    worker.recv(chunk);
+    assert(chunk.size() == 1 and chunk.popstr() == "other");
+    assert(!worker.streaming());
+    reply = zmq::multipart_t("done");
+    worker.send(reply);
+    assert(take(mmsg) == mdp::worker::reply);
+    assert(mmsg.peekstr(2) == "c2" and mmsg.peekstr(4) == "done");
+}
+
+static
+void test_client(const std::string& address)
+{
+    console_log log;
+    zmq::context_t ctx;
+    auto broker = new zmq::actor_t(ctx, broker_actor, address, ZMQ_SERVER);
+    auto worker = new zmq::actor_t(ctx, echo_worker, address, ZMQ_CLIENT);
+
+    {
+        zmq::socket_t sock(ctx, ZMQ_CLIENT);
+        Client client(sock, address, log);
+        client.set_window(4);
+        sleep_ms(time_unit_t{500}); // let the worker say READY
+
+        // More chunks than the window need credit from the worker.
+        const size_t nchunks = 20;
+        for (size_t ind=0; ind<nchunks; ++ind) {
+            zmq::multipart_t chunk(std::to_string(ind));
+            assert(client.send_chunk("echo", chunk, ind+1 == nchunks));
+            assert(chunk.empty());
+        }
+        zmq::multipart_t reply;
+        client.recv(reply);
+        assert(reply.size() == nchunks);
+        for (size_t ind=0; ind<nchunks; ++ind) {
+            assert(reply.popstr() == std::to_string(ind));
+        }
+
+        // The client may go on as usual.
+        zmq::multipart_t mmsg("hello");
+        client.send("echo", mmsg);
+        client.recv(mmsg);
+        assert(mmsg.popstr() == "hello");
+    }
+
+    for (auto* actor : {worker, broker}) {
+        actor->pipe().send(zmq::message_t{}, zmq::send_flags::none);
+        delete actor;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string address = "tcp://127.0.0.1:5569";
+    if (argc > 1) {
+        address = argv[1];
+    }
+    test_broker();
+    test_idle();
+    test_worker();
+    test_client(address);
+    return 0;
+}